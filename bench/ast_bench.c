@@ -0,0 +1,194 @@
+// AST layout: parses a file into pointer trees (malloc'd and arena) and the
+// flat node pool, then reports their size and the time and cache misses of
+// a full traversal of each, the way the evaluator visits them.
+// Cache misses come from perf_event_open and read n/a where it is missing.
+// usage: ast_bench <file> [iterations]
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/source.h"
+#include "../src/arena.h"
+#include "../src/flat.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int misses_open(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long misses_read(int fd) {
+    long long n = -1;
+    if (fd < 0 || read(fd, &n, sizeof(n)) != sizeof(n)) return -1;
+    return n;
+}
+
+// explicit stacks, as trees can be a million nodes deep
+static struct AST** ast_stack;
+static uint32_t* flat_stack;
+
+static long walk_ast(struct AST* root, size_t* bytes) {
+    long n = 0, top = 0;
+    ast_stack[top++] = root;
+    while (top) {
+        struct AST* a = ast_stack[--top];
+        n++;
+        *bytes += sizeof(struct AST);
+        switch (a->tag) {
+            case AST_ABS: ast_stack[top++] = a->u.abs.body; ast_stack[top++] = a->u.abs.id; break;
+            case AST_APP:
+                if (a->u.app.alist) ast_stack[top++] = a->u.app.alist;
+                ast_stack[top++] = a->u.app.fn;
+                break;
+            case AST_ARGLIST:
+                if (a->u.app_list.next) ast_stack[top++] = a->u.app_list.next;
+                ast_stack[top++] = a->u.app_list.arg;
+                break;
+            case AST_SUCC: case AST_DEC: case AST_POS: case AST_NEG: ast_stack[top++] = a->u.succ.arg; break;
+            case AST_LET_IN:
+                ast_stack[top++] = a->u.binding.expr;
+                ast_stack[top++] = a->u.binding.value;
+                break;
+            case AST_LETREC:
+                ast_stack[top++] = a->u.letrec.expr;
+                ast_stack[top++] = a->u.letrec.fn;
+                break;
+            case AST_IF_ELSE:
+                ast_stack[top++] = a->u.if_else.else_branch;
+                ast_stack[top++] = a->u.if_else.then_branch;
+                ast_stack[top++] = a->u.if_else.cond;
+                break;
+            default: break;
+        }
+    }
+    return n;
+}
+
+static long walk_flat(struct FlatProgram* p) {
+    long n = 0, top = 0;
+    flat_stack[top++] = p->root;
+    while (top) {
+        struct FlatNode node = p->nodes[flat_stack[--top]];
+        n++;
+        switch (node.tag) {
+            case AST_ABS: flat_stack[top++] = node.b; break;
+            case AST_APP:
+                for (uint32_t i = node.c; i > 0; i--) flat_stack[top++] = p->args[node.b + i - 1];
+                flat_stack[top++] = node.a;
+                break;
+            case AST_SUCC: case AST_DEC: case AST_POS: case AST_NEG: flat_stack[top++] = node.a; break;
+            case AST_LET_IN: case AST_LETREC: flat_stack[top++] = node.c; flat_stack[top++] = node.b; break;
+            case AST_IF_ELSE: flat_stack[top++] = node.c; flat_stack[top++] = node.b; flat_stack[top++] = node.a; break;
+            default: break;
+        }
+    }
+    return n;
+}
+
+static void report(const char* name, long nodes, size_t bytes, double best, long long misses) {
+    printf("  %-8s %9ld nodes %9.1f KB   walk %8.3f ms", name, nodes, bytes / 1024.0, best * 1e3);
+    if (misses < 0) printf("   cache misses n/a\n");
+    else printf("   cache misses %lld\n", misses);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file> [iterations]\n", argv[0]);
+        return 1;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : 10;
+    struct Source* src = source_open(argv[1]);
+    if (!src) {
+        fprintf(stderr, "ast_bench: cannot open \"%s\"\n", argv[1]);
+        return 1;
+    }
+    struct Lexer* lx = lexer_init(src->chars, src->len);
+    struct TokenBuffer* tb = scan_source(lx);
+    ast_stack = malloc(sizeof(struct AST*) * 2 * tb->len);
+    flat_stack = malloc(sizeof(uint32_t) * 2 * tb->len);
+    int fd = misses_open();
+    printf("%s: %d tokens, best of %d\n", argv[1], tb->len, iterations);
+
+    for (int use_arena = 0; use_arena <= 1; use_arena++) {
+        struct Arena* arena = use_arena ? arena_create(ARENA_DEFAULT_CHUNK, false) : NULL;
+        struct Parser* ps = parser_init(tb, src->chars, arena);
+        struct AST* ast = parse(ps);
+        if (ast->tag == AST_ERR) {
+            printf("%s\n", ast->u.err.error_message.b);
+            return 1;
+        }
+        long nodes = 0;
+        size_t bytes = 0;
+        double best = 1e30;
+        long long misses = -1;
+        for (int i = 0; i < iterations; i++) {
+            size_t b = 0;
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+            double t0 = now_sec();
+            nodes = walk_ast(ast, &b);
+            double t = now_sec() - t0;
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (t < best) {
+                best = t;
+                misses = misses_read(fd);
+            }
+            bytes = b;
+        }
+        report(use_arena ? "arena" : "malloc", nodes, bytes, best, misses);
+
+        if (use_arena) {
+            struct FlatProgram* prog = flatten(ast);
+            best = 1e30;
+            misses = -1;
+            for (int i = 0; i < iterations; i++) {
+                if (fd >= 0) {
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+                double t0 = now_sec();
+                nodes = walk_flat(prog);
+                double t = now_sec() - t0;
+                if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (t < best) {
+                    best = t;
+                    misses = misses_read(fd);
+                }
+            }
+            report("flat", nodes, flat_bytes(prog), best, misses);
+            flat_free(prog);
+            arena_free(arena);
+        } else {
+            free_ast(ast);
+        }
+        parser_free(ps);
+    }
+    if (fd >= 0) close(fd);
+    free(ast_stack);
+    free(flat_stack);
+    tb_free(tb);
+    lexer_free(lx);
+    source_close(src);
+    return 0;
+}
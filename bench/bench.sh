@@ -0,0 +1,462 @@
+#!/bin/sh
+# Benchmarks for the lamb front end and evaluator. Inputs are generated into
+# $BENCH_DIR (default /tmp/lamb-bench). Build optimised first:
+#   make clean; make bench CFLAGS="-O2 -g"
+set -e
+cd "$(dirname "$0")/.."
+BENCH_DIR=${BENCH_DIR:-/tmp/lamb-bench}
+mkdir -p "$BENCH_DIR"
+
+# repeats file $1 (in place) until it is $2 MB, possibly cutting the last line
+grow_to() {
+    while [ "$(wc -c < "$1")" -lt $(($2 * 1000000)) ]; do
+        cat "$1" "$1" > "$1.tmp" && mv "$1.tmp" "$1"
+    done
+    head -c $(($2 * 1000000)) "$1" > "$1.tmp" && mv "$1.tmp" "$1"
+}
+
+# the sample programs (and their comments) repeated to ~$2 MB; lexically
+# valid but not a single program
+gen_corpus() {
+    [ -f "$BENCH_DIR/$1" ] && return
+    cat sample_programs/*.code > "$BENCH_DIR/$1"
+    grow_to "$BENCH_DIR/$1" "$2"
+}
+
+bench_lex() {
+    gen_corpus corpus16.code 16
+    ./build/lex_bench "$BENCH_DIR/corpus16.code" 10
+}
+
+# ~$2 MB of commented-out library code around a small program
+gen_commented() {
+    [ -f "$BENCH_DIR/$1" ] && return
+    sed 's/^/# /' sample_programs/*.code > "$BENCH_DIR/$1"
+    grow_to "$BENCH_DIR/$1" "$2"
+    echo >> "$BENCH_DIR/$1"
+    cat sample_programs/Z.code >> "$BENCH_DIR/$1"
+}
+
+# startup time and peak RSS: mmap'd file vs the buffered stdin reader
+bench_load() {
+    gen_commented commented100.code 100
+    echo "file (mmap):"
+    LAMB_STATS=1 ./build/lamb "$BENCH_DIR/commented100.code" 2>&1 >/dev/null | grep -E "load|lex|peak"
+    echo "pipe (buffered):"
+    cat "$BENCH_DIR/commented100.code" |
+        LAMB_STATS=1 ./build/lamb - 2>&1 >/dev/null | grep -E "load|lex|peak"
+}
+
+# $3 copies of $2, then $4, then $5 copies of $6 (all on one line)
+gen_nested() {
+    [ -f "$BENCH_DIR/$1" ] && return
+    awk -v n="$3" -v pre="$2" -v mid="$4" -v m="$5" -v post="$6" 'BEGIN {
+        for (i = 0; i < n; i++) printf "%s", pre
+        printf "%s", mid
+        for (i = 0; i < m; i++) printf "%s", post
+        printf "\n"
+    }' > "$BENCH_DIR/$1"
+}
+
+# 10^6-deep nesting of each recursive construct
+bench_parse_deep() {
+    gen_nested deep_let.code "let x 1 in " 1000000 "x" 0 ""
+    gen_nested deep_letrec.code "letrec f fn x x in " 1000000 "f" 0 ""
+    gen_nested deep_fn.code "fn x " 1000000 "x" 0 ""
+    gen_nested deep_unary.code "+" 1000000 "1" 0 ""
+    gen_nested deep_paren.code "(" 1000000 "1" 1000000 ")"
+    gen_nested deep_if.code "if 1 then " 1000000 "1" 1000000 " else 0"
+    for f in let letrec fn unary paren if; do
+        ./build/parse_bench "$BENCH_DIR/deep_$f.code" 3
+    done
+}
+
+# $2 unused letrec helpers with non-trivial bodies, then multiply.code
+gen_library() {
+    [ -f "$BENCH_DIR/$1" ] && return
+    awk -v n="$2" 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "letrec helper%d\n    fn x fn y fn z\n", i
+            printf "    if y then helper%d(+x)(-y)(let t (fn a a)(z) in t(z))\n", i
+            printf "    else if z then (fn k k(x))(fn v +v) else <(-x)\nin\n"
+        }
+    }' > "$BENCH_DIR/$1"
+    cat sample_programs/multiply.code >> "$BENCH_DIR/$1"
+}
+
+# AST allocation: malloc per node vs the arena, on the largest programs
+bench_parse_alloc() {
+    gen_library library.code 20000
+    ./build/parse_bench "$BENCH_DIR/library.code" 5
+    gen_nested deep_let.code "let x 1 in " 1000000 "x" 0 ""
+    ./build/parse_bench "$BENCH_DIR/deep_let.code" 3
+}
+
+# startup with mostly-unused library code, eager vs lazy fn bodies
+bench_lazy_parse() {
+    gen_library library.code 20000
+    for mode in "" --lazy-parse; do
+        echo "lamb $mode:"
+        LAMB_STATS=1 ./build/lamb $mode "$BENCH_DIR/library.code" 2>&1 >/dev/null |
+            grep -E "parse|eval"
+    done
+}
+
+# AST layouts (malloc'd, arena, flat): size and a full traversal
+bench_ast() {
+    gen_library library.code 20000
+    ./build/ast_bench "$BENCH_DIR/library.code" 10
+    gen_nested deep_let.code "let x 1 in " 1000000 "x" 0 ""
+    ./build/ast_bench "$BENCH_DIR/deep_let.code" 3
+}
+
+# sample program $2 with its final call's argument replaced by $3
+gen_call() {
+    [ -f "$BENCH_DIR/$1" ] && return
+    sed "s/^in \([a-z]*\)([0-9]*)/in \1($3)/" "sample_programs/$2" > "$BENCH_DIR/$1"
+}
+
+# evaluator on fib/factorial workloads; LAMB=<binary> to compare builds
+bench_eval() {
+    gen_call fib15.code fibonacci.code 15
+    gen_call fib18.code fibonacci.code 18
+    gen_call fact6.code factorial.code 6
+    gen_call fact7.code factorial.code 7
+    for f in fib15 fib18 fact6 fact7; do
+        echo "$f:"
+        LAMB_STATS=1 ${LAMB:-./build/lamb} "$BENCH_DIR/$f.code" 2>&1 >/dev/null |
+            grep -E "eval|peak"
+    done
+}
+
+# a list of $2 pairs built from closures, then summed
+gen_closures() {
+    [ -f "$BENCH_DIR/$1" ] && return
+    cat > "$BENCH_DIR/$1" <<EOF
+letrec add fn x fn y if y then add(+x)(-y) else x in
+let pair fn x fn y fn f f(x)(y) in
+let fst fn x fn y x in
+let snd fn x fn y y in
+letrec build fn n fn acc if n then build(-n)(pair(n)(acc)) else acc in
+letrec sum fn l fn s if l(fst) then sum(l(snd))(add(s)(l(fst))) else s in
+sum(build($2)(pair(0)(0)))(0)
+EOF
+}
+
+# eval time and peak RSS of closure-heavy programs; LAMB=<binary> to compare
+bench_closures() {
+    gen_closures pairs1000.code 1000
+    gen_closures pairs2000.code 2000
+    for f in sample_programs/encoding.code "$BENCH_DIR/pairs1000.code" "$BENCH_DIR/pairs2000.code"; do
+        echo "$f:"
+        LAMB_STATS=1 ${LAMB:-./build/lamb} "$f" 2>&1 >/dev/null | grep -E "eval|peak"
+    done
+}
+
+# reference counting against --gc at a few nursery sizes: eval time, pauses,
+# promotion and peak RSS
+bench_gc() {
+    gen_call fib20.code fibonacci.code 20
+    gen_call fact7.code factorial.code 7
+    gen_closures pairs2000.code 2000
+    for f in fib20 fact7 pairs2000; do
+        echo "$f:"
+        for mode in "" "--gc --gc-nursery 64" "--gc" "--gc --gc-nursery 4096"; do
+            printf "  %-25s" "${mode:-rc}"
+            LAMB_STATS=1 ./build/lamb $mode "$BENCH_DIR/$f.code" 2>&1 >/dev/null |
+                grep -E "eval|gc |heap|peak" | sed 's/\[stats\] //' | tr -s ' ' |
+                paste -sd ',' - | sed 's/,/, /g'
+        done
+    done
+}
+
+# the tree walker against the bytecode VM: eval time and peak RSS
+bench_vm() {
+    gen_call fib20.code fibonacci.code 20
+    gen_call fact7.code factorial.code 7
+    gen_closures pairs2000.code 2000
+    for f in fib20 fact7 pairs2000; do
+        echo "$f:"
+        for mode in "" --vm; do
+            printf "  %-6s" "${mode:-tree}"
+            LAMB_STATS=1 ./build/lamb $mode "$BENCH_DIR/$f.code" 2>&1 >/dev/null |
+                grep -E "eval|steps|vm |peak rss" | sed 's/\[stats\] //' | tr -s ' ' |
+                paste -sd ',' - | sed 's/,/, /g'
+        done
+    done
+}
+
+# the template JIT against the tree walker it compiles for, at the default
+# threshold and compiling every fn on its first call, with the VM for
+# comparison
+bench_jit() {
+    gen_call fib20.code fibonacci.code 20
+    gen_call fact7.code factorial.code 7
+    gen_closures pairs2000.code 2000
+    for f in fib20 fact7 pairs2000; do
+        echo "$f:"
+        for mode in --no-jit "" "--jit-threshold 0" --vm; do
+            printf "  %-18s" "${mode:-jit}"
+            LAMB_STATS=1 ./build/lamb $mode "$BENCH_DIR/$f.code" 2>&1 >/dev/null |
+                grep -E "eval|jit |peak rss" | sed 's/\[stats\] //' | tr -s ' ' |
+                paste -sd ',' - | sed 's/,/, /g'
+        done
+    done
+}
+
+# tail calls in constant space: loops of $2 iterations, two-argument and
+# one, under --cek and --vm; frames and continuations at peak stay flat
+# as $2 grows. Deep non-tail recursion, for contrast, grows with its depth.
+gen_tail() {
+    [ -f "$BENCH_DIR/add$1.code" ] && return
+    echo "letrec add fn x fn y if y then add(+x)(-y) else x in add(0)($1)" > "$BENCH_DIR/add$1.code"
+    echo "letrec count fn n if n then count(-n) else 0 in count($1)" > "$BENCH_DIR/count$1.code"
+    echo "letrec sum fn n if n then +(sum(-n)) else 0 in sum($1)" > "$BENCH_DIR/sum$1.code"
+}
+
+bench_tail() {
+    for n in 100000 1000000 10000000; do
+        gen_tail $n
+    done
+    fails=0
+    for f in add100000 add10000000 count100000 count10000000 sum100000 sum1000000; do
+        echo "$f:"
+        # add and sum give their count back, count gives 0
+        n=${f#add}; n=${n#sum}
+        case $f in count*) want=0 ;; *) want=$n ;; esac
+        for mode in --cek --vm; do
+            printf "  %-6s" "$mode"
+            status=0
+            LAMB_STATS=1 ./build/lamb $mode "$BENCH_DIR/$f.code" >"$BENCH_DIR/tail.out" \
+                2>"$BENCH_DIR/tail.err" || status=$?
+            got=$(grep '^> ' "$BENCH_DIR/tail.out") || true
+            if [ "$got" != "> $want" ] || [ $status -ne 0 ]; then
+                echo "FAIL: want '> $want', got '$got' (status $status)"
+                fails=$((fails + 1))
+                continue
+            fi
+            grep -E "eval|frames|conts|peak rss" "$BENCH_DIR/tail.err" | sed 's/\[stats\] //' |
+                tr -s ' ' | paste -sd ',' - | sed 's/,/, /g'
+        done
+    done
+    [ $fails -eq 0 ]
+}
+
+# programs that discard work: a pair of which only fst is used, let
+# bindings never used, and a list of which only the first elements are read
+gen_lazy() {
+    [ -f "$BENCH_DIR/lazy_pair.code" ] && return
+    fib="letrec add fn x fn y if y then add(+x)(-y) else x in
+letrec fib fn n if n then if <(-n) then add(fib(-n))(fib(--n)) else 1 else 0 in
+let pair fn x fn y fn f f(x)(y) in
+let fst fn x fn y x in
+let snd fn x fn y y in"
+    cat > "$BENCH_DIR/lazy_pair.code" <<EOF
+$fib
+let p pair(fib(10))(fib(22)) in
+p(fst)
+EOF
+    cat > "$BENCH_DIR/lazy_let.code" <<EOF
+$fib
+let unused fib(21) in
+let also_unused fib(20) in
+fib(10)
+EOF
+    cat > "$BENCH_DIR/lazy_list.code" <<EOF
+$fib
+letrec build fn n fn acc if n then build(-n)(pair(fib(12))(acc)) else acc in
+letrec sum fn l fn k fn s if k then sum(l(snd))(-k)(add(s)(l(fst))) else s in
+sum(build(2000)(pair(0)(0)))(10)(0)
+EOF
+}
+
+# call by need against call by value, on programs that discard work and on
+# ones that use everything (the JIT is off under --lazy, so --no-jit is the
+# like-for-like baseline)
+bench_lazy() {
+    gen_lazy
+    gen_call fib20.code fibonacci.code 20
+    gen_call fact7.code factorial.code 7
+    gen_closures pairs2000.code 2000
+    for f in lazy_pair lazy_let lazy_list fib20 fact7 pairs2000; do
+        echo "$f:"
+        for mode in "" --no-jit --lazy; do
+            printf "  %-9s" "${mode:-jit}"
+            LAMB_STATS=1 ./build/lamb $mode "$BENCH_DIR/$f.code" 2>&1 >/dev/null |
+                grep -E "eval|thunks|peak rss" | sed 's/\[stats\] //' | tr -s ' ' |
+                paste -sd ',' - | sed 's/,/, /g'
+        done
+    done
+    # a letrec value other than a fn must give call by value's result
+    echo "let d fn x x in letrec d d in d(3)" > "$BENCH_DIR/lazy_letrec_outer.code"
+    echo "letrec f 5 in f" > "$BENCH_DIR/lazy_letrec_num.code"
+    fails=0
+    for f in "$BENCH_DIR"/lazy_letrec_*.code; do
+        want=$(./build/lamb "$f" | grep '^> ')
+        got=$(./build/lamb --lazy "$f" | grep '^> ')
+        if [ "$want" = "$got" ]; then
+            echo "ok    $f"
+        else
+            echo "FAIL  $f: want '$want', got '$got'"
+            fails=$((fails + 1))
+        fi
+    done
+    [ $fails -eq 0 ]
+}
+
+# each sample program compiled by `lamb emit-c` must print the interpreter's
+# result line; needs `make runtime` and a C compiler ($CC, default cc)
+aot_build() {
+    ./build/lamb emit-c "$1" -o "$2.c" &&
+        ${CC:-cc} -O2 -Isrc "$2.c" build/liblamb.a -pthread -o "$2"
+}
+
+bench_aot_check() {
+    # a letrec name read in its own value, other than a fn, before it is
+    # bound: directly, through a closure, and with an outer binding
+    echo "letrec d d in 5" > "$BENCH_DIR/unbound_read.code"
+    echo "letrec d (fn x d)(1) in d" > "$BENCH_DIR/unbound_capture.code"
+    echo "let d fn x x in letrec d d in d(3)" > "$BENCH_DIR/unbound_outer.code"
+    fails=0
+    for f in sample_programs/*.code "$BENCH_DIR"/unbound_*.code; do
+        exe="$BENCH_DIR/aot_$(basename "$f" .code)"
+        want=$(./build/lamb "$f" | grep '^> ')
+        got=$(aot_build "$f" "$exe" && "$exe") || true
+        if [ "$want" = "$got" ]; then
+            echo "ok    $f"
+        else
+            echo "FAIL  $f: want '$want', got '$got'"
+            fails=$((fails + 1))
+        fi
+    done
+    [ $fails -eq 0 ]
+}
+
+# wall time in ms of a command, its output dropped
+wall_ms() {
+    start=$(date +%s%N)
+    "$@" >/dev/null 2>&1
+    echo $((($(date +%s%N) - start) / 1000000))
+}
+
+# the compiled executable against the tree walker, the JIT and the VM, in
+# wall time (so startup and parsing included)
+bench_aot() {
+    gen_call fib20.code fibonacci.code 20
+    gen_call fact7.code factorial.code 7
+    gen_closures pairs2000.code 2000
+    for f in fib20 fact7 pairs2000; do
+        echo "$f:"
+        for mode in --no-jit "" --vm; do
+            printf "  %-10s%6s ms\n" "${mode:-jit}" "$(wall_ms ./build/lamb $mode "$BENCH_DIR/$f.code")"
+        done
+        aot_build "$BENCH_DIR/$f.code" "$BENCH_DIR/aot_$f"
+        printf "  %-10s%6s ms\n" emit-c "$(wall_ms "$BENCH_DIR/aot_$f")"
+    done
+}
+
+# heap footprint of the closure pairs with 64-bit captures and with
+# --compressed: objects and bytes live at peak, bytes per object, peak RSS
+bench_footprint() {
+    for n in 1000 2000 3000; do
+        gen_closures pairs$n.code $n
+    done
+    for f in pairs1000 pairs2000 pairs3000; do
+        echo "$f:"
+        for mode in "" --compressed; do
+            printf "  %-14s" "${mode:-default}"
+            LAMB_STATS=1 ./build/lamb $mode "$BENCH_DIR/$f.code" 2>&1 >/dev/null |
+                grep -E "objs|bytes|eval|peak rss" | sed 's/\[stats\] //' | tr -s ' ' |
+                paste -sd ',' - | sed 's/,/, /g'
+        done
+    done
+}
+
+# mallocs, reference counting and allocations per step while evaluating
+# fib, factorial and the closure pairs, with and without ownership inference
+bench_eval_alloc() {
+    for n in 15 18 20; do
+        gen_call fib$n.code fibonacci.code $n
+    done
+    for n in 6 7; do
+        gen_call fact$n.code factorial.code $n
+    done
+    gen_closures pairs1000.code 1000
+    for f in fib15 fib18 fib20 fact6 fact7 pairs1000; do
+        for mode in --no-ownership ""; do
+            ./build/eval_bench $mode "$BENCH_DIR/$f.code" >/dev/null
+        done
+    done
+}
+
+# startup from source (eager and lazy) vs from a compiled .lambc
+bench_lambc() {
+    gen_library library.code 20000
+    ./build/lamb compile "$BENCH_DIR/library.code" -o "$BENCH_DIR/library.lambc"
+    ls -l "$BENCH_DIR/library.code" "$BENCH_DIR/library.lambc"
+    for mode in "" --lazy-parse; do
+        echo "lamb $mode library.code:"
+        LAMB_STATS=1 ./build/lamb $mode "$BENCH_DIR/library.code" 2>&1 >/dev/null |
+            grep -E "load|lex|parse|flat|peak"
+    done
+    echo "lamb run library.lambc:"
+    LAMB_STATS=1 ./build/lamb run "$BENCH_DIR/library.lambc" 2>&1 >/dev/null |
+        grep -E "load|peak"
+}
+
+# struct Table against the HashMap it replaced
+bench_table() {
+    ./build/table_bench 100000
+}
+
+# flat node counts with and without hash-consing, over the samples and a
+# generated library
+bench_hash_cons() {
+    gen_library library.code 20000
+    for f in sample_programs/*.code "$BENCH_DIR/library.code"; do
+        echo "$f:"
+        for mode in "" --hash-cons; do
+            printf "  %-12s" "${mode:-tree}"
+            LAMB_STATS=1 ./build/lamb $mode "$f" 2>&1 >/dev/null |
+                grep -E "nodes|shared|parse|peak" | sed 's/\[stats\] //' | tr -s ' ' |
+                paste -sd ',' - | sed 's/,/, /g'
+        done
+    done
+}
+
+# parallel lexer on 1..nproc threads (and a few beyond, to show the overhead)
+bench_lex_scaling() {
+    gen_corpus corpus64.code 64
+    for t in 1 2 4 8 16; do
+        ./build/lex_bench "$BENCH_DIR/corpus64.code" 5 $t
+    done
+}
+
+case "${1:-all}" in
+    lex) bench_lex ;;
+    lex-scaling) bench_lex_scaling ;;
+    load) bench_load ;;
+    parse-deep) bench_parse_deep ;;
+    lazy-parse) bench_lazy_parse ;;
+    parse-alloc) bench_parse_alloc ;;
+    ast) bench_ast ;;
+    eval) bench_eval ;;
+    eval-alloc) bench_eval_alloc ;;
+    closures) bench_closures ;;
+    gc) bench_gc ;;
+    footprint) bench_footprint ;;
+    vm) bench_vm ;;
+    tail) bench_tail ;;
+    jit) bench_jit ;;
+    aot-check) bench_aot_check ;;
+    aot) bench_aot ;;
+    lazy) bench_lazy ;;
+    lambc) bench_lambc ;;
+    hash-cons) bench_hash_cons ;;
+    table) bench_table ;;
+    all) bench_lex; bench_lex_scaling; bench_load; bench_parse_deep; bench_lazy_parse
+        bench_parse_alloc; bench_ast; bench_eval; bench_eval_alloc
+        bench_closures; bench_gc; bench_footprint; bench_vm; bench_tail; bench_jit; bench_aot_check; bench_aot; bench_lazy; bench_lambc; bench_hash_cons; bench_table ;;
+    *) echo "usage: $0 [lex|lex-scaling|load|parse-deep|lazy-parse|parse-alloc|ast|eval|eval-alloc|closures|gc|footprint|vm|tail|jit|aot-check|aot|lazy|lambc|hash-cons|table|all]" >&2
+        exit 1 ;;
+esac
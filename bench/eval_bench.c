@@ -0,0 +1,74 @@
+// Evaluator cost: runs a program once and reports the time, the number of
+// mallocs made by interpret(), and per eval step the references taken and
+// dropped and the objects and frames allocated. Linked with
+// -Wl,--wrap=malloc. The program's own output goes to stdout as usual.
+// usage: eval_bench [--no-ownership] <file>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/source.h"
+#include "../src/arena.h"
+#include "../src/flat.h"
+#include "../src/interpreter.h"
+#include "../src/resolver.h"
+#include "../src/slab.h"
+#include "../src/stack.h"
+
+static long n_mallocs = 0;
+
+void* __real_malloc(size_t size);
+
+void* __wrap_malloc(size_t size) {
+    n_mallocs++;
+    return __real_malloc(size);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s [--no-ownership] <file>\n", argv[0]);
+        return 1;
+    }
+    bool ownership = !(argc > 2 && !strcmp(argv[1], "--no-ownership"));
+    const char* path = argv[argc - 1];
+    struct Source* src = source_open(path);
+    if (!src) {
+        fprintf(stderr, "eval_bench: cannot open \"%s\"\n", path);
+        return 1;
+    }
+    struct Lexer* lx = lexer_init(src->chars, src->len);
+    struct TokenBuffer* tb = scan_source(lx);
+    struct Arena* arena = arena_create(ARENA_DEFAULT_CHUNK, false);
+    struct Parser* ps = parser_init(tb, src->chars, arena);
+    struct FlatProgram* prog = flatten(parse(ps));
+    if (!resolve(prog, ownership)) return 1;
+    struct Interpreter state = {.prog = prog};
+
+    long m0 = n_mallocs;
+    double t0 = now_sec();
+    interpret(&state);
+    double t = now_sec() - t0;
+    fflush(stdout);
+    double steps = state.n_steps;
+    fprintf(stderr, "%s%s: eval %.3f ms, %ld mallocs, %zu steps; per step %.3f dups, %.3f drops, %.3f allocs\n",
+            path, ownership ? "" : " (--no-ownership)", t * 1e3, n_mallocs - m0, state.n_steps,
+            state.n_dups / steps, state.n_drops / steps,
+            (state.objects->n_allocs + state.frames->n_allocs) / steps);
+
+    interpreter_free(&state);
+    flat_free(prog);
+    arena_free(arena);
+    parser_free(ps);
+    tb_free(tb);
+    lexer_free(lx);
+    source_close(src);
+    return 0;
+}
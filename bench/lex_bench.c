@@ -0,0 +1,52 @@
+// Lexer throughput: lexes a file repeatedly and reports MB/s.
+// usage: lex_bench <file> [iterations] [threads]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../src/lexer.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file> [iterations] [threads]\n", argv[0]);
+        return 1;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : 10;
+    int threads = argc > 3 ? atoi(argv[3]) : 1;
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        fprintf(stderr, "lex_bench: cannot open \"%s\"\n", argv[1]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* src = malloc(len);
+    if (fread(src, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "lex_bench: short read\n");
+        return 1;
+    }
+    fclose(f);
+
+    int n_tokens = 0;
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        double t0 = now_sec();
+        struct Lexer* lx = lexer_init(src, len);
+        struct TokenBuffer* tb = threads > 1 ? scan_source_parallel(lx, threads) : scan_source(lx);
+        double dt = now_sec() - t0;
+        if (dt < best) best = dt;
+        n_tokens = tb->len;
+        tb_free(tb);
+        lexer_free(lx);
+    }
+    printf("%s: %.1f MB, %d tokens, %d thread(s), best of %d: %.3f ms, %.1f MB/s\n",
+        argv[1], len / 1e6, n_tokens, threads, iterations, best * 1e3, len / 1e6 / best);
+    free(src);
+    return 0;
+}
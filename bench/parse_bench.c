@@ -0,0 +1,83 @@
+// Parser throughput: lexes a file once, then parses and frees it repeatedly,
+// with malloc'd nodes and with the AST arena. Linked with -Wl,--wrap=malloc
+// so that mallocs made by the front end can be counted.
+// usage: parse_bench <file> [iterations]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/source.h"
+#include "../src/arena.h"
+
+static long n_mallocs = 0;
+
+void* __real_malloc(size_t size);
+
+void* __wrap_malloc(size_t size) {
+    n_mallocs++;
+    return __real_malloc(size);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum Mode { MODE_MALLOC, MODE_ARENA, MODE_ARENA_HUGE };
+static const char* mode_names[] = {"malloc", "arena", "arena+huge"};
+
+static void bench(const char* path, struct TokenBuffer* tb, const char* src, enum Mode mode, int iterations) {
+    double best_parse = 1e30, best_free = 1e30;
+    long mallocs = 0;
+    size_t chunks = 0;
+    for (int i = 0; i < iterations; i++) {
+        struct Arena* arena = mode == MODE_MALLOC ? NULL
+            : arena_create(ARENA_DEFAULT_CHUNK, mode == MODE_ARENA_HUGE);
+        struct Parser* ps = parser_init(tb, src, arena);
+        long m0 = n_mallocs;
+        double t0 = now_sec();
+        struct AST* ast = parse(ps);
+        double t1 = now_sec();
+        mallocs = n_mallocs - m0;
+        if (ast->tag == AST_ERR) {
+            printf("%s\n", ast->u.err.error_message.b);
+            exit(1);
+        }
+        if (arena) {
+            chunks = arena->n_chunks;
+            arena_free(arena);
+        } else {
+            free_ast(ast);
+        }
+        double t2 = now_sec();
+        if (t1 - t0 < best_parse) best_parse = t1 - t0;
+        if (t2 - t1 < best_free) best_free = t2 - t1;
+        parser_free(ps);
+    }
+    printf("%s [%s]: %d tokens, %ld mallocs (%zu chunks), best of %d: parse %.3f ms (%.1f Mtok/s), free %.3f ms\n",
+        path, mode_names[mode], tb->len, mallocs, chunks, iterations,
+        best_parse * 1e3, tb->len / 1e6 / best_parse, best_free * 1e3);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file> [iterations]\n", argv[0]);
+        return 1;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : 5;
+    struct Source* src = source_open(argv[1]);
+    if (!src) {
+        fprintf(stderr, "parse_bench: cannot open \"%s\"\n", argv[1]);
+        return 1;
+    }
+    struct Lexer* lx = lexer_init(src->chars, src->len);
+    struct TokenBuffer* tb = scan_source(lx);
+    for (enum Mode m = MODE_MALLOC; m <= MODE_ARENA_HUGE; m++)
+        bench(argv[1], tb, src->chars, m, iterations);
+    tb_free(tb);
+    lexer_free(lx);
+    source_close(src);
+    return 0;
+}
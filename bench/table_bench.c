@@ -0,0 +1,191 @@
+// Hash tables: struct Table against the chained HashMap it replaced (kept
+// here as it was), on integer keys. For each size, reports the time per
+// insert, per lookup of a present key and per lookup of a missing one, and
+// the bytes held and mallocs made per entry (not counting malloc's own
+// headers, which HashMap pays once per entry). Keys are symbol-like
+// (0, 1, 2, ...) or scattered. Linked with -Wl,--wrap=malloc.
+// usage: table_bench [max entries]
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "../src/table.h"
+
+static long n_mallocs = 0;
+
+void* __real_malloc(size_t size);
+
+void* __wrap_malloc(size_t size) {
+    n_mallocs++;
+    return __real_malloc(size);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+HASHMAP (as removed from src/interpreter.c)
+*/
+
+// --wrap only catches calls from other objects
+#define malloc(size) __wrap_malloc(size)
+
+struct HashMapBucket {
+    void *item;
+    uint32_t key; // symbol
+    void *next;
+};
+
+struct HashMap {
+    struct HashMapBucket** buckets;
+    int len_buckets;
+    int n_items;
+};
+
+const int INITIAL_BUCKET_COUNT = 16;
+
+static unsigned int hash(struct HashMap* hm, uint32_t key) {
+    return (key * 2654435761u) % hm->len_buckets;
+}
+
+static struct HashMap* hashmap_create() {
+    struct HashMap* hm = malloc(sizeof(struct HashMap));
+    hm->buckets = malloc(sizeof(struct HashMapBucket*) * INITIAL_BUCKET_COUNT);
+    hm->len_buckets = INITIAL_BUCKET_COUNT;
+    hm->n_items = 0;
+    for (int i = 0; i < INITIAL_BUCKET_COUNT; i++){
+        hm->buckets[i] = NULL;
+    }
+    return hm;
+}
+
+static void hashmap_put(struct HashMap* hm, uint32_t key, void* item) {
+    unsigned int index = hash(hm, key);
+    struct HashMapBucket* curr = hm->buckets[index];
+    while (curr) {
+        if (curr->key == key) {
+            curr->item = item;
+            return;
+        }
+        curr = curr->next;
+    }
+    struct HashMapBucket* bucket = malloc(sizeof(struct HashMapBucket));
+    bucket->item = item;
+    bucket->key = key;
+    bucket->next = hm->buckets[index];
+    hm->buckets[index] = bucket;
+    hm->n_items++;
+}
+
+static void* hashmap_get(struct HashMap* hm, uint32_t key) {
+    unsigned int index = hash(hm, key);
+    struct HashMapBucket* curr = hm->buckets[index];
+    while (curr) {
+        if (curr->key == key) {
+            return curr->item;
+        }
+        curr = curr->next;
+    }
+    return NULL;
+}
+
+static void hashmap_free(struct HashMap* hm) {
+    for (int i = 0; i < hm->len_buckets; i++) {
+        struct HashMapBucket* curr = hm->buckets[i];
+        while (curr) {
+            struct HashMapBucket* to_free = curr;
+            curr = curr->next;
+            free(to_free);
+        }
+    }
+    free(hm->buckets);
+    free(hm);
+}
+
+#undef malloc
+
+/*
+RUNS
+*/
+
+struct Result {
+    double insert, hit, miss; // ns per operation
+    double bytes, mallocs;    // per entry
+};
+
+static void report(const char* name, uint32_t n, struct Result r) {
+    printf("  %-8s %7u   insert %7.1f ns   hit %7.1f ns   miss %7.1f ns   %5.1f B %5.2f mallocs /entry\n",
+           name, n, r.insert, r.hit, r.miss, r.bytes, r.mallocs);
+}
+
+// keys[0..n) are inserted, keys[n..2n) are missing
+static struct Result run_hashmap(const uint32_t* keys, uint32_t n) {
+    struct Result r;
+    uintptr_t sum = 0;
+    long mallocs0 = n_mallocs;
+    double t0 = now_sec();
+    struct HashMap* hm = hashmap_create();
+    for (uint32_t i = 0; i < n; i++) hashmap_put(hm, keys[i], (void*)(uintptr_t)(i + 1));
+    double t1 = now_sec();
+    r.mallocs = (double)(n_mallocs - mallocs0) / n;
+    r.bytes = (double)(sizeof(struct HashMap) + sizeof(struct HashMapBucket*) * hm->len_buckets
+                       + sizeof(struct HashMapBucket) * hm->n_items) / n;
+    for (uint32_t i = 0; i < n; i++) sum += (uintptr_t)hashmap_get(hm, keys[i]);
+    double t2 = now_sec();
+    for (uint32_t i = 0; i < n; i++) sum += (uintptr_t)hashmap_get(hm, keys[n + i]);
+    double t3 = now_sec();
+    if (sum != (uintptr_t)n * (n + 1) / 2) fprintf(stderr, "table_bench: HashMap lost entries\n");
+    hashmap_free(hm);
+    r.insert = (t1 - t0) * 1e9 / n;
+    r.hit = (t2 - t1) * 1e9 / n;
+    r.miss = (t3 - t2) * 1e9 / n;
+    return r;
+}
+
+static struct Result run_table(const uint32_t* keys, uint32_t n) {
+    struct Result r;
+    uint64_t sum = 0, v;
+    long mallocs0 = n_mallocs;
+    double t0 = now_sec();
+    struct Table* t = table_create(0);
+    for (uint32_t i = 0; i < n; i++) table_put(t, keys[i], i + 1);
+    double t1 = now_sec();
+    r.mallocs = (double)(n_mallocs - mallocs0) / n;
+    r.bytes = (double)table_bytes(t) / n;
+    for (uint32_t i = 0; i < n; i++) if (table_get(t, keys[i], &v)) sum += v;
+    double t2 = now_sec();
+    for (uint32_t i = 0; i < n; i++) if (table_get(t, keys[n + i], &v)) sum += v;
+    double t3 = now_sec();
+    if (sum != (uint64_t)n * (n + 1) / 2) fprintf(stderr, "table_bench: Table lost entries\n");
+    table_free(t);
+    r.insert = (t1 - t0) * 1e9 / n;
+    r.hit = (t2 - t1) * 1e9 / n;
+    r.miss = (t3 - t2) * 1e9 / n;
+    return r;
+}
+
+// a bijection, so distinct for distinct i
+static uint32_t scatter(uint32_t i) {
+    i = (i ^ (i >> 16)) * 0x45d9f3bu;
+    i = (i ^ (i >> 16)) * 0x45d9f3bu;
+    return i ^ (i >> 16);
+}
+
+int main(int argc, char** argv) {
+    uint32_t max = argc > 1 ? (uint32_t)atol(argv[1]) : 100000;
+    uint32_t* keys = malloc(sizeof(uint32_t) * 2 * max);
+    for (int scattered = 0; scattered <= 1; scattered++) {
+        printf("%s keys:\n", scattered ? "scattered" : "sequential");
+        for (uint32_t n = 100; n <= max; n *= 10) {
+            // n present, then n missing
+            for (uint32_t i = 0; i < 2 * n; i++) keys[i] = scattered ? scatter(i) : i;
+            report("HashMap", n, run_hashmap(keys, n));
+            report("Table", n, run_table(keys, n));
+        }
+    }
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_MAX_CHUNK (4 * 1024 * 1024)
+#define ALIGN_UP(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+static size_t page_size(void) {
+    static size_t page = 0;
+    if (!page) page = sysconf(_SC_PAGESIZE);
+    return page;
+}
+
+static struct ArenaChunk* chunk_map(struct Arena* a, size_t size) {
+    void* mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (a->huge_pages && size % ARENA_HUGE_CHUNK == 0)
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (mem == MAP_FAILED) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            fprintf(stderr, "lamb: err: out of memory (arena).\n");
+            exit(1);
+        }
+#ifdef MADV_HUGEPAGE
+        if (a->huge_pages)
+            madvise(mem, size, MADV_HUGEPAGE);
+#endif
+    }
+    struct ArenaChunk* c = mem;
+    c->size = size;
+    c->used = ALIGN_UP(sizeof(struct ArenaChunk), ARENA_ALIGN);
+    a->n_chunks++;
+    return c;
+}
+
+struct Arena* arena_create(size_t chunk_size, bool huge_pages) {
+    struct Arena* a = malloc(sizeof(struct Arena));
+    if (huge_pages && chunk_size < ARENA_HUGE_CHUNK)
+        chunk_size = ARENA_HUGE_CHUNK;
+    a->chunk_size = ALIGN_UP(chunk_size, page_size());
+    a->huge_pages = huge_pages;
+    a->chunks = NULL;
+    a->n_allocs = 0;
+    a->n_chunks = 0;
+    a->bytes_used = 0;
+    return a;
+}
+
+void* arena_alloc(struct Arena* a, size_t size) {
+    size = ALIGN_UP(size, ARENA_ALIGN);
+    struct ArenaChunk* c = a->chunks;
+    if (!c || c->used + size > c->size) {
+        size_t header = ALIGN_UP(sizeof(struct ArenaChunk), ARENA_ALIGN);
+        size_t want = size + header > a->chunk_size
+            ? ALIGN_UP(size + header, page_size())
+            : a->chunk_size;
+        struct ArenaChunk* fresh = chunk_map(a, want);
+        if (a->chunk_size < ARENA_MAX_CHUNK && !(c && want > a->chunk_size))
+            a->chunk_size *= 2; // fewer mmaps for big trees, small ones stay small
+        if (c && want > a->chunk_size) {
+            // an oversized block gets a chunk of its own, behind the one
+            // that is still being bumped
+            fresh->next = c->next;
+            c->next = fresh;
+        } else {
+            fresh->next = c;
+            a->chunks = fresh;
+        }
+        c = fresh;
+    }
+    void* p = (char*)c + c->used;
+    c->used += size;
+    a->n_allocs++;
+    a->bytes_used += size;
+    return p;
+}
+
+void arena_free(struct Arena* a) {
+    if (!a) return;
+    struct ArenaChunk* c = a->chunks;
+    while (c) {
+        struct ArenaChunk* next = c->next;
+        munmap(c, c->size);
+        c = next;
+    }
+    free(a);
+}
@@ -0,0 +1,34 @@
+#ifndef LAMB_ARENA_H
+#define LAMB_ARENA_H
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bump allocator: memory comes from mmap'd chunks of whole pages, each twice
+// the size of the last up to 4 MB, and is only ever released all at once by
+// arena_free.
+struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t size; // mapped bytes, including this header
+    size_t used;
+};
+
+struct Arena {
+    struct ArenaChunk* chunks; // newest first; allocation bumps the head
+    size_t chunk_size; // size of the next chunk
+    bool huge_pages;
+    // statistics
+    size_t n_allocs;
+    size_t n_chunks;
+    size_t bytes_used;
+};
+
+#define ARENA_DEFAULT_CHUNK (64 * 1024)
+#define ARENA_HUGE_CHUNK (2 * 1024 * 1024)
+
+// chunk_size is rounded up to whole pages; with huge_pages the chunks are
+// 2 MB and backed by hugetlb pages if available, else marked for THP
+struct Arena* arena_create(size_t chunk_size, bool huge_pages);
+void* arena_alloc(struct Arena* a, size_t size);
+void arena_free(struct Arena* a);
+
+#endif
@@ -1,5 +1,8 @@
 #include <stdio.h>
+#include <string.h>
 #include "ast.h"
+#include "symbol.h"
+#include "table.h"
 
 void pprint_ast_helper(struct AST* ast) {
     if (!ast) return;
@@ -45,7 +48,7 @@ void pprint_ast_helper(struct AST* ast) {
             printf(")");
             break;
         case AST_IDENTIFIER:
-            printf("%s", ast->u.identifier.name.b);
+            printf("%s", symbol_name(ast->u.identifier.sym).b);
             break;
         case AST_ERR:
             printf("%s", ast->u.err.error_message.b);
@@ -61,7 +64,7 @@ void pprint_ast_helper(struct AST* ast) {
             }
             break;
         case AST_LET_IN:
-            printf("%s", ast->u.binding.id.b);
+            printf("%s", symbol_name(ast->u.binding.id).b);
             printf("=");
             pprint_ast_helper(ast->u.binding.value);
             printf(" in (");
@@ -77,12 +80,15 @@ void pprint_ast_helper(struct AST* ast) {
             pprint_ast_helper(ast->u.if_else.else_branch);
             break;
         case AST_LETREC:
-            printf("def %s=", ast->u.letrec.id.b);
+            printf("def %s=", symbol_name(ast->u.letrec.id).b);
             pprint_ast_helper(ast->u.letrec.fn);
             printf(" in (");
             pprint_ast_helper(ast->u.letrec.expr);
             printf(")");
             break;
+        case AST_LAZY:
+            printf("...");
+            break;
         default:
             fprintf(stderr, "lamb: err: [pprint_ast_helper] Unknown AST type.\n");
     }
@@ -93,158 +99,266 @@ void pprint_ast(struct AST* ast) {
     printf("\n");
 }
 
-struct AST* make_abs(struct AST* id, struct AST* body) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_ABS;
-    ast->u.abs.id = id;
-    ast->u.abs.body = body;
-    return ast;
+struct String ast_string(struct Arena* arena, const char* chars, int len) {
+    if (!arena) return string_ncreate(chars, len);
+    char* b = arena_alloc(arena, len + 1);
+    memcpy(b, chars, len);
+    b[len] = '\0';
+    return (struct String) {.b = b, .length = len};
 }
 
-struct AST* make_app(struct AST* fn, struct AST* alist) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_APP;
-    ast->u.app.fn = fn;
-    ast->u.app.alist = alist;
-    return ast;
+// the (up to 3) child nodes of ast
+static int ast_kids(struct AST* ast, struct AST* kids[3]) {
+    switch (ast->tag) {
+        case AST_ABS:
+            kids[0] = ast->u.abs.id;
+            kids[1] = ast->u.abs.body;
+            return 2;
+        case AST_APP:
+            kids[0] = ast->u.app.fn;
+            kids[1] = ast->u.app.alist;
+            return 2;
+        case AST_ARGLIST:
+            kids[0] = ast->u.app_list.arg;
+            kids[1] = ast->u.app_list.next;
+            return 2;
+        case AST_SUCC:
+        case AST_DEC:
+        case AST_POS:
+        case AST_NEG:
+            kids[0] = ast->u.succ.arg;
+            return 1;
+        case AST_LET_IN:
+            kids[0] = ast->u.binding.value;
+            kids[1] = ast->u.binding.expr;
+            return 2;
+        case AST_LETREC:
+            kids[0] = ast->u.letrec.fn;
+            kids[1] = ast->u.letrec.expr;
+            return 2;
+        case AST_IF_ELSE:
+            kids[0] = ast->u.if_else.cond;
+            kids[1] = ast->u.if_else.then_branch;
+            kids[2] = ast->u.if_else.else_branch;
+            return 3;
+        default:
+            return 0;
+    }
 }
 
-struct AST* make_identifier(struct String name) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_IDENTIFIER;
-    ast->u.identifier.name = name;
-    return ast;
+// the symbol of an identifier or binding, or -1
+static int64_t ast_sym(struct AST* ast) {
+    switch (ast->tag) {
+        case AST_IDENTIFIER: return ast->u.identifier.sym;
+        case AST_LET_IN: return ast->u.binding.id;
+        case AST_LETREC: return ast->u.letrec.id;
+        default: return -1;
+    }
 }
 
-struct AST* make_cond(struct AST* cond, struct AST* then_branch, struct AST* else_branch) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_IF_ELSE;
-    ast->u.if_else.cond = cond;
-    ast->u.if_else.then_branch = then_branch;
-    ast->u.if_else.else_branch = else_branch;
-    return ast;
+/*
+HASH-CONSING
+*/
+
+static uint64_t node_hash(struct AST* ast) {
+    uint64_t h = ast->tag;
+    struct AST* kids[3] = {NULL, NULL, NULL};
+    int n = ast_kids(ast, kids);
+    for (int i = 0; i < n; i++)
+        h = table_mix(h ^ (uintptr_t)kids[i]);
+    h = table_mix(h ^ (uint32_t)ast_sym(ast));
+    if (ast->tag == AST_NUM)
+        h = table_mix(h ^ (uint32_t)ast->u.num.value);
+    return h;
 }
 
-struct AST* make_num(int value) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_NUM;
-    ast->u.num.value = value;
-    return ast;
+static bool node_equal(void* ctx, uint64_t node) {
+    struct AST* a = (struct AST*)(uintptr_t)node;
+    struct AST* b = ctx;
+    if (a->tag != b->tag) return false;
+    struct AST* ka[3] = {NULL, NULL, NULL};
+    struct AST* kb[3] = {NULL, NULL, NULL};
+    ast_kids(a, ka);
+    ast_kids(b, kb);
+    if (ka[0] != kb[0] || ka[1] != kb[1] || ka[2] != kb[2]) return false;
+    if (ast_sym(a) != ast_sym(b)) return false;
+    return a->tag != AST_NUM || a->u.num.value == b->u.num.value;
 }
 
-struct AST* make_succ(struct AST* arg) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_SUCC;
-    ast->u.succ.arg = arg;
-    return ast;
+struct ASTCons* ast_cons_create(bool malloced_nodes) {
+    struct ASTCons* cons = calloc(1, sizeof(struct ASTCons));
+    cons->nodes = table_create(1024);
+    cons->malloced = malloced_nodes;
+    return cons;
 }
 
-struct AST* make_pos(struct AST* arg) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_POS;
-    ast->u.pos.arg = arg;
-    return ast;
+static void free_node(void* ctx, uint64_t node) {
+    free_ast((struct AST*)(uintptr_t)node);
 }
 
-struct AST* make_neg(struct AST* arg) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_NEG;
-    ast->u.neg.arg = arg;
+void ast_cons_free(struct ASTCons* cons) {
+    if (!cons) return;
+    if (cons->malloced) table_each(cons->nodes, free_node, NULL);
+    table_free(cons->nodes);
+    free(cons);
+}
+
+/*
+CONSTRUCTORS
+
+Each make_* fills in the node it wants on the stack and hands it to build(),
+which copies it into a new node or, when hash-consing, may return an equal
+node instead. The caller's references to children are passed in either
+way.
+*/
+
+static struct AST* ast_alloc(struct ASTAlloc* alloc) {
+    struct Arena* arena = alloc ? alloc->arena : NULL;
+    struct AST* ast = arena ? arena_alloc(arena, sizeof(struct AST)) : malloc(sizeof(struct AST));
+    ast->refs = 1;
     return ast;
 }
 
-struct AST* make_dec(struct AST* arg) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_DEC;
-    ast->u.dec.arg = arg;
+static struct AST* build(struct ASTAlloc* alloc, struct AST* proto) {
+    struct ASTCons* cons = alloc ? alloc->cons : NULL;
+    if (!cons) {
+        struct AST* ast = ast_alloc(alloc);
+        ast->u = proto->u;
+        ast->tag = proto->tag;
+        return ast;
+    }
+    cons->n_made++;
+    uint64_t hash = node_hash(proto);
+    uint64_t* entry = table_find(cons->nodes, hash, node_equal, proto);
+    if (entry) {
+        struct AST* found = (struct AST*)(uintptr_t)*entry;
+        // found already holds these same children, so this never frees one
+        struct AST* kids[3] = {NULL, NULL, NULL};
+        int n = ast_kids(proto, kids);
+        for (int k = 0; k < n; k++) {
+            if (kids[k]) kids[k]->refs--;
+        }
+        cons->n_shared++;
+        found->refs++;
+        return found;
+    }
+    struct AST* ast = ast_alloc(alloc);
+    ast->u = proto->u;
+    ast->tag = proto->tag;
+    ast->refs = 2; // the caller's and the table's
+    table_add(cons->nodes, hash, (uintptr_t)ast);
     return ast;
 }
 
-struct AST* make_err(struct String error_message) {
-    struct AST* ast = malloc(sizeof(struct AST));
+struct AST* make_abs(struct ASTAlloc* alloc, struct AST* id, struct AST* body) {
+    struct AST proto = {.tag = AST_ABS, .u.abs = {id, body}};
+    if (body->tag == AST_LAZY) { // force_abs_body will rewrite it
+        struct AST* ast = ast_alloc(alloc);
+        *ast = proto;
+        ast->refs = 1;
+        return ast;
+    }
+    return build(alloc, &proto);
+}
+
+struct AST* make_app(struct ASTAlloc* alloc, struct AST* fn, struct AST* alist) {
+    struct AST proto = {.tag = AST_APP, .u.app = {fn, alist}};
+    return build(alloc, &proto);
+}
+
+struct AST* make_identifier(struct ASTAlloc* alloc, uint32_t sym) {
+    struct AST proto = {.tag = AST_IDENTIFIER, .u.identifier = {sym}};
+    return build(alloc, &proto);
+}
+
+struct AST* make_cond(struct ASTAlloc* alloc, struct AST* cond, struct AST* then_branch, struct AST* else_branch) {
+    struct AST proto = {.tag = AST_IF_ELSE, .u.if_else = {cond, then_branch, else_branch}};
+    return build(alloc, &proto);
+}
+
+struct AST* make_num(struct ASTAlloc* alloc, int value) {
+    struct AST proto = {.tag = AST_NUM, .u.num = {value}};
+    return build(alloc, &proto);
+}
+
+struct AST* make_succ(struct ASTAlloc* alloc, struct AST* arg) {
+    struct AST proto = {.tag = AST_SUCC, .u.succ = {arg}};
+    return build(alloc, &proto);
+}
+
+struct AST* make_pos(struct ASTAlloc* alloc, struct AST* arg) {
+    struct AST proto = {.tag = AST_POS, .u.pos = {arg}};
+    return build(alloc, &proto);
+}
+
+struct AST* make_neg(struct ASTAlloc* alloc, struct AST* arg) {
+    struct AST proto = {.tag = AST_NEG, .u.neg = {arg}};
+    return build(alloc, &proto);
+}
+
+struct AST* make_dec(struct ASTAlloc* alloc, struct AST* arg) {
+    struct AST proto = {.tag = AST_DEC, .u.dec = {arg}};
+    return build(alloc, &proto);
+}
+
+// never shared: error paths free their partial trees as they go
+struct AST* make_err(struct ASTAlloc* alloc, struct String error_message) {
+    struct AST* ast = ast_alloc(alloc);
     ast->tag = AST_ERR;
-    ast->u.err.error_message = error_message;
+    if (alloc && alloc->arena) { // messages are built with malloc'd string_concat chains
+        ast->u.err.error_message = ast_string(alloc->arena, error_message.b, error_message.length);
+        string_free(&error_message);
+    } else {
+        ast->u.err.error_message = error_message;
+    }
     return ast;
 }
 
-struct AST* make_binding(struct String id, struct AST* value, struct AST* expr) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_LET_IN;
-    ast->u.binding.id = id;
-    ast->u.binding.value = value;
-    ast->u.binding.expr = expr;
-    return ast;
+struct AST* make_binding(struct ASTAlloc* alloc, uint32_t id, struct AST* value, struct AST* expr) {
+    struct AST proto = {.tag = AST_LET_IN, .u.binding = {id, value, expr}};
+    return build(alloc, &proto);
 }
 
-struct AST* make_letrec(struct String id, struct AST* fn, struct AST* expr) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_LETREC;
-    ast->u.letrec.id = id;
-    ast->u.letrec.fn = fn;
-    ast->u.letrec.expr = expr;
-    return ast;
+struct AST* make_letrec(struct ASTAlloc* alloc, uint32_t id, struct AST* fn, struct AST* expr) {
+    struct AST proto = {.tag = AST_LETREC, .u.letrec = {id, fn, expr}};
+    return build(alloc, &proto);
 }
 
-struct AST* cons_alist(struct AST* arg, struct AST* next) {
-    struct AST* ast = malloc(sizeof(struct AST));
-    ast->tag = AST_ARGLIST;
-    ast->u.app_list.arg = arg;
-    ast->u.app_list.next = next;
+struct AST* make_lazy(struct ASTAlloc* alloc, struct Parser* parser, int start, int end) {
+    struct AST* ast = ast_alloc(alloc);
+    ast->tag = AST_LAZY;
+    ast->u.lazy.parser = parser;
+    ast->u.lazy.start = start;
+    ast->u.lazy.end = end;
     return ast;
 }
 
+struct AST* cons_alist(struct ASTAlloc* alloc, struct AST* arg, struct AST* next) {
+    struct AST proto = {.tag = AST_ARGLIST, .u.app_list = {arg, next}};
+    return build(alloc, &proto);
+}
+
+// Iterative so that freeing a deeply nested program cannot overflow the C
+// stack: children are pushed on a heap stack before their parent is freed.
 void free_ast(struct AST* ast) {
     if (!ast) return;
-    switch (ast->tag) {
-        case AST_ABS:
-            free_ast(ast->u.abs.id);
-            free_ast(ast->u.abs.body);
-            break;
-        case AST_APP:
-            free_ast(ast->u.app.fn);
-            free_ast(ast->u.app.alist);
-            break;
-        case AST_NUM:
-            break;
-        case AST_SUCC:
-            free_ast(ast->u.succ.arg);
-            break;
-        case AST_POS:
-            free_ast(ast->u.pos.arg);
-            break;
-        case AST_NEG:
-            free_ast(ast->u.neg.arg);
-            break;
-        case AST_IDENTIFIER:
-            string_free(&ast->u.identifier.name);
-            break;
-        case AST_ERR:
-            string_free(&ast->u.err.error_message);
-            break;
-        case AST_ARGLIST:
-            free_ast(ast->u.app_list.arg);
-            free_ast(ast->u.app_list.next);
-            break;
-        case AST_DEC:
-            free_ast(ast->u.dec.arg);
-            break;
-        case AST_LET_IN:
-            string_free(&ast->u.binding.id);
-            free_ast(ast->u.binding.value);
-            free_ast(ast->u.binding.expr);
-            break;
-        case AST_IF_ELSE:
-            free_ast(ast->u.if_else.cond);
-            free_ast(ast->u.if_else.then_branch);
-            free_ast(ast->u.if_else.else_branch);
-            break;
-        case AST_LETREC:
-            string_free(&ast->u.letrec.id);
-            free_ast(ast->u.letrec.fn);
-            free_ast(ast->u.letrec.expr);
-            break;
-        default:
-            fprintf(stderr, "lamb: err: [free_ast] Unknown AST type.\n");
+    int len = 0, cap = 64;
+    struct AST** stack = malloc(sizeof(struct AST*) * cap);
+    stack[len++] = ast;
+    while (len) {
+        ast = stack[--len];
+        if (--ast->refs > 0) continue; // still shared
+        if (cap - len < 3) {
+            cap *= 2;
+            stack = realloc(stack, sizeof(struct AST*) * cap);
+        }
+        struct AST* kids[3] = {NULL, NULL, NULL};
+        int n = ast_kids(ast, kids);
+        if (ast->tag == AST_ERR) string_free(&ast->u.err.error_message);
+        for (int i = 0; i < n; i++) {
+            if (kids[i]) stack[len++] = kids[i];
+        }
+        free(ast);
     }
-    free(ast);
-}
\ No newline at end of file
+    free(stack);
+}
@@ -1,6 +1,10 @@
 #ifndef LAMB_AST_H
 #define LAMB_AST_H
+#include <stdint.h>
 #include "stringt.h"
+#include "arena.h"
+#include <stdbool.h>
+#include <stddef.h>
 
 enum ASTType {
     AST_ABS,
@@ -15,43 +19,80 @@ enum ASTType {
     AST_POS,
     AST_NEG,
     AST_ERR,
+    AST_LAZY, // unparsed fn body, see force_abs_body
 };
 
 struct AST;
+struct Parser;
 
 struct AST {
     enum ASTType tag;
+    unsigned int refs; // parents and owners sharing this node, see ASTCons
     union {
         struct {struct AST* fn; struct AST* alist; } app;
         struct {struct AST* arg; struct AST* next; } app_list;
         struct {struct AST* id; struct AST* body; } abs;
-        struct {struct String name; } identifier;
+        struct {uint32_t sym; } identifier; // see symbol.h
         struct {int value; } num;
         struct {struct AST* arg; } succ;
         struct {struct AST* arg; } dec;
         struct {struct AST* arg; } neg;
         struct {struct AST* arg; } pos;
         struct {struct String error_message; } err;
-        struct {struct String id; struct AST* value; struct AST* expr; } binding; //syntactic sugar for (fn id expr)(value)
-        struct {struct String id; struct AST* fn; struct AST* expr; } letrec;        
+        struct {uint32_t id; struct AST* value; struct AST* expr; } binding; //syntactic sugar for (fn id expr)(value)
+        struct {uint32_t id; struct AST* fn; struct AST* expr; } letrec;        
         struct {struct AST* cond; struct AST* then_branch; struct AST* else_branch;} if_else;
+        struct {struct Parser* parser; int start; int end; } lazy; // token range
     } u;
 };
+// Hash-consing: make_* look up the node they would build, by tag, child
+// pointers, number and symbol, and return the existing one if there is one.
+// Children are shared already, so equal subtrees come out as one node and
+// the tree is a DAG. The table holds a reference to each of its nodes; a
+// malloc'd DAG is released with free_ast on the root and ast_cons_free, in
+// either order. Error and lazy nodes, and fns with lazy bodies, are never
+// shared: force_abs_body rewrites the latter in place.
+struct Table;
+
+struct ASTCons {
+    struct Table* nodes; // node_hash -> node
+    bool malloced; // nodes are not in an arena: release them on free
+    // statistics
+    size_t n_made; // make_* calls that could share
+    size_t n_shared; // of those, calls that returned an existing node
+};
+
+// Where make_* put their nodes: an arena, or malloc if it is NULL, and the
+// hash-consing table if cons is set.
+struct ASTAlloc {
+    struct Arena* arena;
+    struct ASTCons* cons;
+};
+
 void pprint_ast(struct AST* ast);
 void pprint_ast_helper(struct AST* ast);
-struct AST* make_abs(struct AST* id, struct AST* body);
-struct AST* make_app(struct AST* fn, struct AST* alist);
-struct AST* cons_alist(struct AST* arg, struct AST* next); //bruh
-struct AST* make_identifier(struct String name);
-struct AST* make_num(int value);
-struct AST* make_cond(struct AST* cond, struct AST* then_branch, struct AST* else_branch);
-struct AST* make_succ(struct AST* arg);
-struct AST* make_dec(struct AST* arg);
-struct AST* make_pos(struct AST* arg);
-struct AST* make_neg(struct AST* arg);
-struct AST* make_err(struct String error_message);
-struct AST* make_binding(struct String id, struct AST* value, struct AST* expr);
-struct AST* make_letrec(struct String id, struct AST* fn, struct AST* expr);
+struct AST* make_abs(struct ASTAlloc* alloc, struct AST* id, struct AST* body);
+struct AST* make_app(struct ASTAlloc* alloc, struct AST* fn, struct AST* alist);
+struct AST* cons_alist(struct ASTAlloc* alloc, struct AST* arg, struct AST* next); //bruh
+struct AST* make_identifier(struct ASTAlloc* alloc, uint32_t sym);
+struct AST* make_num(struct ASTAlloc* alloc, int value);
+struct AST* make_cond(struct ASTAlloc* alloc, struct AST* cond, struct AST* then_branch, struct AST* else_branch);
+struct AST* make_succ(struct ASTAlloc* alloc, struct AST* arg);
+struct AST* make_dec(struct ASTAlloc* alloc, struct AST* arg);
+struct AST* make_pos(struct ASTAlloc* alloc, struct AST* arg);
+struct AST* make_neg(struct ASTAlloc* alloc, struct AST* arg);
+struct AST* make_err(struct ASTAlloc* alloc, struct String error_message);
+struct AST* make_binding(struct ASTAlloc* alloc, uint32_t id, struct AST* value, struct AST* expr);
+struct AST* make_letrec(struct ASTAlloc* alloc, uint32_t id, struct AST* fn, struct AST* expr);
+struct AST* make_lazy(struct ASTAlloc* alloc, struct Parser* parser, int start, int end);
+// Constructors allocate from the arena, or with malloc if there is none (or
+// alloc is NULL). Only trees built without an arena are freed with
+// free_ast; arena_free releases the rest.
+struct String ast_string(struct Arena* arena, const char* chars, int len);
+// drops one reference, freeing the node (and so on down) if it was the last
 void free_ast(struct AST* ast);
 
+struct ASTCons* ast_cons_create(bool malloced_nodes);
+void ast_cons_free(struct ASTCons* cons);
+
 #endif
\ No newline at end of file
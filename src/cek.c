@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "cek.h"
+#include "interpreter.h"
+#include "flat.h"
+#include "resolver.h"
+#include "symbol.h"
+#include "stack.h"
+#include "gc.h"
+
+// Nodes are read through these rather than cached, since forcing a lazy fn
+// body appends to (and may move) the node arrays.
+
+// what to do with the value being returned
+enum ContTag {
+    K_RET,        // env: the frame of a call, freed on return; flag: it owns its closure
+    K_UNARY,      // node: +, -, pos or neg of the value
+    K_LET,        // node, env: bind the value, then the body
+    K_LETREC,     // node, env
+    K_IF,         // node, env: the value is the condition
+    K_APP_ARG,    // node, env: the single argument is in; the fn is next
+    K_APP_FN,     // node, env, value (the argument): the fn is in
+    K_CHAIN_FN,   // node, env: the fn of a chain is in
+    K_CHAIN_ARG,  // node, env, index, value (the fn), flag (it is borrowed)
+    K_CHAIN_NEXT, // node, env, index: a call of a chain returned, with more to go
+};
+
+struct Cont {
+    struct Cont* prev;
+    uint32_t tag; // enum ContTag
+    uint32_t node;
+    uint32_t index; // of the next argument, in FlatProgram.args
+    bool flag;
+    struct Environment* env;
+    struct LambValue value; // rooted under --gc
+};
+
+static struct Cont* cont_push(struct Interpreter* state, struct Cont* k, enum ContTag tag, uint32_t node, struct Environment* env) {
+    struct Cont* c = stack_push(state->conts, sizeof(struct Cont));
+    c->prev = k;
+    c->tag = tag;
+    c->node = node;
+    c->index = 0;
+    c->flag = false;
+    c->env = env;
+    c->value = LV_NONE;
+    return c;
+}
+
+static struct Cont* cont_pop(struct Interpreter* state, struct Cont* k) {
+    struct Cont* prev = k->prev;
+    stack_pop(state->conts, k);
+    return prev;
+}
+
+// the top record takes v; roots go in LIFO order, as the records do
+static void cont_hold(struct Interpreter* state, struct Cont* k, struct LambValue v) {
+    k->value = v;
+    if (state->gc) gc_push_root(state->gc, &k->value);
+}
+
+static struct LambValue cont_release(struct Interpreter* state, struct Cont* k) {
+    if (state->gc) state->gc->n_shadow--;
+    return k->value;
+}
+
+// frees a call's frame, then its closure if the frame owned it
+static void frame_free(struct Interpreter* state, struct Environment* frame, bool owns) {
+    struct LambObject* closure = frame->closure;
+    env_free(state, frame);
+    if (owns) lv_release(state, LV_FROM_OBJ(closure));
+}
+
+static void trace(struct Interpreter* state, bool debug, const char* what, uint32_t expr) {
+    if (!debug) return;
+    printf("%s", what);
+    flat_pprint(state->prog, expr);
+}
+
+static struct LambValue error(struct Interpreter* state, struct String message) {
+    return LV_FROM_OBJ(make_lamb_err(state, message));
+}
+
+struct LambValue cek_eval(struct Interpreter* state, uint32_t expr, struct Environment* env) {
+    bool debug = getenv("DEBUG") != NULL;
+    if (!state->conts) state->conts = stack_create("conts");
+    struct Cont* k = NULL;
+    struct LambValue v, fn, arg;
+    struct FlatNode n;
+    bool borrowed;
+    uint32_t index;
+
+eval:
+    state->n_steps++;
+    if (debug) pprint_env(env);
+    n = NODE(state, expr);
+    switch (n.tag) {
+        case AST_APP:
+            trace(state, debug, "[eval_app] ", expr);
+            if (!n.c) {
+                expr = n.a;
+                goto eval;
+            }
+            if (n.c == 1) {
+                k = cont_push(state, k, K_APP_ARG, expr, env);
+                expr = ARG(state, n.b);
+                goto eval;
+            }
+            // a fn that is a name is only borrowed for the first call (see resolver.h)
+            if (n.slot & APP_BORROW) {
+                state->n_steps++; // as if evaluated
+                fn = env_get(env, NODE(state, n.a).b);
+                if (!LV_IS_NONE(fn)) {
+                    borrowed = true;
+                    index = n.b;
+                    goto chain;
+                }
+            }
+            k = cont_push(state, k, K_CHAIN_FN, expr, env);
+            expr = n.a;
+            goto eval;
+        case AST_NUM:
+            trace(state, debug, "[eval_num] ", expr);
+            v = make_lamb_num((int)n.a);
+            goto ret;
+        case AST_SUCC:
+        case AST_DEC:
+        case AST_POS:
+        case AST_NEG:
+            trace(state, debug, n.tag == AST_SUCC ? "[eval_succ] " : n.tag == AST_DEC ? "[eval_dec] "
+                              : n.tag == AST_POS ? "[eval_is_pos] " : "[eval_is_neg] ", expr);
+            k = cont_push(state, k, K_UNARY, expr, env);
+            expr = n.a;
+            goto eval;
+        case AST_ABS:
+            trace(state, debug, "[eval_abs] ", expr);
+            v = LV_FROM_OBJ(close_over(state, expr, env));
+            goto ret;
+        case AST_IDENTIFIER:
+            // empty only where a letrec value reads its name (see resolver.h)
+            v = env_take(state, env, n.b);
+            if (LV_IS_NONE(v)) {
+                v = error(state, string_concat(string_create("[run-time error] attempted to use an undefined name: "), string_clone(symbol_name(n.a))));
+            }
+            goto ret;
+        case AST_LET_IN:
+            trace(state, debug, "[eval_let] ", expr);
+            k = cont_push(state, k, K_LET, expr, env);
+            expr = n.b;
+            goto eval;
+        case AST_IF_ELSE:
+            trace(state, debug, "[eval_if_else] ", expr);
+            k = cont_push(state, k, K_IF, expr, env);
+            expr = n.a;
+            goto eval;
+        case AST_LETREC:
+            trace(state, debug, "[eval_letrec] ", expr);
+            k = cont_push(state, k, K_LETREC, expr, env);
+            expr = n.b;
+            goto eval;
+        case AST_ERR:
+            printf("%s\n", flat_string(state->prog, n.a).b);
+            v = LV_NONE;
+            goto ret;
+        default:
+            assert(0);
+    }
+
+ret:
+    if (!k) return v;
+    switch (k->tag) {
+        case K_RET:
+            env = k->env;
+            borrowed = !k->flag;
+            k = cont_pop(state, k);
+            frame_free(state, env, !borrowed);
+            goto ret;
+        case K_UNARY:
+            n = NODE(state, k->node);
+            k = cont_pop(state, k);
+            if (LV_IS_NUM(v)) {
+                int num = LV_NUM(v);
+                v = make_lamb_num(n.tag == AST_SUCC ? NUM_SUCC(num) : n.tag == AST_DEC ? NUM_DEC(num)
+                                : n.tag == AST_POS ? num > 0 : num < 0);
+                goto ret;
+            }
+            lv_release(state, v);
+            v = error(state, string_create(n.tag == AST_DEC
+                ? "[type error] - applied to a non-Num argument."
+                : "[type error] + applied to a non-Num argument."));
+            goto ret;
+        case K_LET:
+        case K_LETREC:
+            n = NODE(state, k->node);
+            env = k->env;
+            k = cont_pop(state, k);
+            if (LV_TYPE(v) == LOBJ_ERR) goto ret;
+            if (n.tag == AST_LETREC && LV_TYPE(v) != LOBJ_CLOSURE) {
+                lv_release(state, v);
+                v = error(state, string_create("[type error] Expected a function to be recursively defined in letrec expression"));
+                goto ret;
+            }
+            env_put(state, env, n.slot, v);
+            expr = n.c;
+            goto eval;
+        case K_IF:
+            n = NODE(state, k->node);
+            env = k->env;
+            k = cont_pop(state, k);
+            if (LV_TYPE(v) == LOBJ_ERR) goto ret;
+            if (LV_TYPE(v) != LOBJ_NUM) {
+                lv_release(state, v);
+                v = error(state, string_create("[type error] - tried to use a non-Num condition in if-else expression."));
+                goto ret;
+            }
+            expr = LV_NUM(v) ? n.b : n.c;
+            lv_release(state, v);
+            goto eval;
+        case K_APP_ARG:
+            if (LV_TYPE(v) == LOBJ_ERR) {
+                k = cont_pop(state, k);
+                goto ret;
+            }
+            arg = v;
+            expr = k->node;
+            env = k->env;
+            n = NODE(state, expr);
+            if (n.slot & APP_BORROW) {
+                state->n_steps++; // as if evaluated
+                fn = env_get(env, NODE(state, n.a).b);
+                if (!LV_IS_NONE(fn)) {
+                    k = cont_pop(state, k);
+                    borrowed = true;
+                    goto call;
+                }
+            }
+            k->tag = K_APP_FN;
+            cont_hold(state, k, arg);
+            expr = n.a;
+            goto eval;
+        case K_APP_FN:
+            arg = cont_release(state, k);
+            k = cont_pop(state, k);
+            if (LV_TYPE(v) == LOBJ_ERR) {
+                lv_release(state, arg);
+                goto ret;
+            }
+            fn = v;
+            borrowed = false;
+            goto call;
+        case K_CHAIN_FN:
+            expr = k->node;
+            env = k->env;
+            k = cont_pop(state, k);
+            if (LV_TYPE(v) == LOBJ_ERR) goto ret;
+            fn = v;
+            borrowed = false;
+            index = NODE(state, expr).b;
+            goto chain;
+        case K_CHAIN_ARG:
+            fn = cont_release(state, k);
+            borrowed = k->flag;
+            if (LV_TYPE(v) == LOBJ_ERR) {
+                k = cont_pop(state, k);
+                if (!borrowed) lv_release(state, fn);
+                goto ret;
+            }
+            arg = v;
+            n = NODE(state, k->node);
+            if (k->index + 1 == n.b + n.c) {
+                k = cont_pop(state, k); // the last call's result is the chain's
+            } else {
+                k->tag = K_CHAIN_NEXT;
+                k->index++;
+            }
+            goto call;
+        case K_CHAIN_NEXT:
+            expr = k->node;
+            env = k->env;
+            index = k->index;
+            k = cont_pop(state, k);
+            if (LV_TYPE(v) == LOBJ_ERR) goto ret;
+            fn = v;
+            borrowed = false;
+            goto chain;
+    }
+
+// fn, to be applied to the argument at index of the chain expr, then the rest
+chain:
+    if (LV_TYPE(fn) != LOBJ_CLOSURE) {
+        if (!borrowed) lv_release(state, fn);
+        v = error(state, string_create("[type error] Expected a function to be applied"));
+        goto ret;
+    }
+    k = cont_push(state, k, K_CHAIN_ARG, expr, env);
+    k->index = index;
+    k->flag = borrowed;
+    cont_hold(state, k, fn);
+    expr = ARG(state, index);
+    goto eval;
+
+// fn applied to arg; the new frame takes over fn unless it is borrowed
+call:
+    if (LV_TYPE(fn) != LOBJ_CLOSURE) {
+        lv_release(state, arg);
+        v = error(state, string_create("[run-time error]: tried to apply something that's not a function"));
+        if (!borrowed) lv_release(state, fn);
+        goto ret;
+    }
+    expr = LOBJ_CLOSURE(LV_OBJ(fn))->code;
+    flat_force_body(state->prog, expr);
+    if (k && k->tag == K_RET) {
+        // a tail call: the caller's frame goes first, fn surviving it
+        if (borrowed) lv_use(state, fn);
+        borrowed = false;
+        env = k->env;
+        bool owns = k->flag;
+        k = cont_pop(state, k);
+        frame_free(state, env, owns);
+    }
+    env = env_create(state, LV_OBJ(fn), RECORD(state, expr)[0]);
+    env_put(state, env, 0, arg);
+    k = cont_push(state, k, K_RET, 0, env);
+    k->flag = !borrowed;
+    expr = NODE(state, expr).b;
+    goto eval;
+}
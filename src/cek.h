@@ -0,0 +1,24 @@
+#ifndef LAMB_CEK_H
+#define LAMB_CEK_H
+#include <stdint.h>
+
+// The tree walker as an explicit machine, used under --cek: a control (the
+// node being evaluated or the value being returned), an environment (the
+// frame) and a continuation, a stack of records on the interpreter's conts
+// region (see stack.h) for what is left to do with each value. Nothing
+// recurses in C, so nesting is bounded by the heap alone.
+//
+// A call whose continuation is only the return from the caller's frame
+// is in tail position: the branches of an if, the body of a let or letrec,
+// the last call of a chain. That frame is freed before the callee's is
+// made, so a loop written as tail recursion runs in constant space.
+//
+// Results, errors, steps and the DEBUG trace are the recursive walker's.
+struct Interpreter;
+struct Environment;
+struct LambValue;
+
+// the caller owns the result
+struct LambValue cek_eval(struct Interpreter* state, uint32_t expr, struct Environment* env);
+
+#endif
@@ -0,0 +1,532 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <assert.h>
+#include "emitc.h"
+#include "resolver.h"
+#include "symbol.h"
+
+// Code is written as straight-line statements, each value landing in a
+// fresh temporary tN. An error leaves by goto: to the +, -, pos or neg whose
+// operand it is in (uN, eN), which makes an error of its own, or else out of
+// the fn (r, out), releasing on the way the temporaries that hold a
+// reference meanwhile.
+struct EmitC {
+    struct FlatProgram* prog;
+    FILE* out;
+    uint32_t* fn_id; // by AST_ABS node
+    uint32_t* fns;   // AST_ABS node of each lifted fn
+    uint32_t n_fns;
+    // in the fn being written
+    uint32_t n_temps;
+    uint32_t n_unary;
+    uint32_t indent;
+    uint32_t* held; // temporaries holding a reference, innermost last
+    uint32_t n_held, cap_held;
+    uint32_t fail; // where an error goes: 0 for out of the fn, else the uN
+    uint32_t fail_held; // n_held there
+    uint32_t depth;
+    bool too_deep;
+    // a letrec's slot is empty while its value, if not a fn, is evaluated:
+    // there, and in closures made there, reading its name is an error
+    uint8_t* unbound; // by closure record entry: a capture that may be empty
+    uint8_t* seen;    // by AST_ABS node: walked by mark_unbound
+    uint32_t abs;     // fn being written, 0 for the root
+    uint32_t* pending; // by slot of it: letrec values it is in
+};
+
+static void* emit_realloc(void* p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        fprintf(stderr, "lamb: err: out of memory (emit-c).\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void line(struct EmitC* e, const char* fmt, ...) {
+    fprintf(e->out, "%*s", 4 * e->indent, "");
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(e->out, fmt, ap);
+    va_end(ap);
+    fputc('\n', e->out);
+}
+
+static void put_string(FILE* out, const char* s, size_t len) {
+    fputc('"', out);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = s[i];
+        if (ch == '"' || ch == '\\') {
+            fprintf(out, "\\%c", ch);
+        } else if (ch < ' ' || ch > '~') {
+            fprintf(out, "\\%03o", ch);
+        } else {
+            fputc(ch, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void hold(struct EmitC* e, uint32_t t) {
+    if (e->n_held == e->cap_held) {
+        e->cap_held = e->cap_held ? 2 * e->cap_held : 16;
+        e->held = emit_realloc(e->held, sizeof(uint32_t) * e->cap_held);
+    }
+    e->held[e->n_held++] = t;
+}
+
+// the error in tN goes where errors go from here
+static void fail(struct EmitC* e, uint32_t t) {
+    uint32_t from = e->fail ? e->fail_held : 0;
+    for (uint32_t i = e->n_held; i > from; i--) {
+        line(e, "lv_release(S, t%u);", e->held[i - 1]);
+    }
+    if (e->fail) {
+        line(e, "u%u = t%u;", e->fail, t);
+        line(e, "goto e%u;", e->fail);
+    } else {
+        line(e, "r = t%u;", t);
+        line(e, "goto out;");
+    }
+}
+
+static void pass_error(struct EmitC* e, uint32_t t) {
+    line(e, "if (RT_IS_ERR(t%u)) {", t);
+    e->indent++;
+    fail(e, t);
+    e->indent--;
+    line(e, "}");
+}
+
+// whether addr, in abs with the slots pending, may name an empty slot
+static bool may_be_unbound(struct EmitC* e, uint32_t abs, const uint32_t* pending, uint32_t addr) {
+    switch (ADDR_KIND(addr)) {
+        case ADDR_LOCAL:
+            return pending[ADDR_INDEX(addr)] > 0;
+        case ADDR_CAPTURED:
+            return e->unbound[NODE(e, abs).c + 2 + ADDR_INDEX(addr)];
+        default:
+            return false;
+    }
+}
+
+// marks the captures of fns within expr, in abs, that may copy an empty slot
+static void mark_unbound(struct EmitC* e, uint32_t abs, uint32_t* pending, uint32_t expr) {
+    if (e->too_deep || e->depth == EMITC_MAX_DEPTH) {
+        e->too_deep = true;
+        return;
+    }
+    e->depth++;
+    for (;;) {
+        struct FlatNode n = NODE(e, expr);
+        if (n.tag == AST_LET_IN) {
+            mark_unbound(e, abs, pending, n.b);
+        } else if (n.tag == AST_LETREC) {
+            bool fn = NODE(e, n.b).tag == AST_ABS;
+            if (!fn) pending[n.slot]++;
+            mark_unbound(e, abs, pending, n.b);
+            if (!fn) pending[n.slot]--;
+        } else {
+            break;
+        }
+        expr = n.c;
+    }
+    struct FlatNode n = NODE(e, expr);
+    switch (n.tag) {
+        case AST_SUCC:
+        case AST_DEC:
+        case AST_POS:
+        case AST_NEG:
+            mark_unbound(e, abs, pending, n.a);
+            break;
+        case AST_IF_ELSE:
+            mark_unbound(e, abs, pending, n.a);
+            mark_unbound(e, abs, pending, n.b);
+            mark_unbound(e, abs, pending, n.c);
+            break;
+        case AST_APP:
+            mark_unbound(e, abs, pending, n.a);
+            for (uint32_t i = 0; i < n.c; i++) mark_unbound(e, abs, pending, ARG(e, n.b + i));
+            break;
+        case AST_ABS: {
+            const uint32_t* record = RECORD(e, expr);
+            bool walk = !e->seen[expr];
+            e->seen[expr] = 1;
+            for (uint32_t i = 0; i < record[1]; i++) {
+                if (!e->unbound[n.c + 2 + i] && may_be_unbound(e, abs, pending, record[2 + i])) {
+                    e->unbound[n.c + 2 + i] = 1;
+                    walk = true; // again, if shared
+                }
+            }
+            if (walk) {
+                uint32_t* inner = emit_realloc(NULL, sizeof(uint32_t) * (record[0] + 1));
+                memset(inner, 0, sizeof(uint32_t) * (record[0] + 1));
+                mark_unbound(e, expr, inner, n.b);
+                free(inner);
+            }
+            break;
+        }
+        default:
+            break; // AST_NUM, AST_IDENTIFIER, AST_ERR
+    }
+    e->depth--;
+}
+
+// a new reference to what addr names, into a new temporary
+static uint32_t take(struct EmitC* e, uint32_t addr) {
+    uint32_t t = e->n_temps++;
+    assert(addr != RESOLVE_UNBOUND);
+    switch (ADDR_KIND(addr)) {
+        case ADDR_LOCAL:
+            line(e, "struct LambValue t%u = s%u;", t, ADDR_INDEX(addr));
+            if (addr & ADDR_MOVE) {
+                line(e, "s%u = LV_NONE;", ADDR_INDEX(addr));
+                return t;
+            }
+            break;
+        case ADDR_CAPTURED:
+            line(e, "struct LambValue t%u = LOBJ_CLOSURE(self)->captured[%u];", t, ADDR_INDEX(addr));
+            break;
+        default:
+            line(e, "struct LambValue t%u = LV_FROM_OBJ(self);", t);
+            break;
+    }
+    line(e, "lv_use(S, t%u);", t);
+    return t;
+}
+
+// what addr names, borrowed, as a C expression
+static void borrow(char* buf, size_t size, uint32_t addr) {
+    switch (ADDR_KIND(addr)) {
+        case ADDR_LOCAL:
+            snprintf(buf, size, "s%u", ADDR_INDEX(addr));
+            break;
+        case ADDR_CAPTURED:
+            snprintf(buf, size, "LOBJ_CLOSURE(self)->captured[%u]", ADDR_INDEX(addr));
+            break;
+        default:
+            snprintf(buf, size, "LV_FROM_OBJ(self)");
+            break;
+    }
+}
+
+static uint32_t emit_expr(struct EmitC* e, uint32_t expr);
+
+static uint32_t emit_unary(struct EmitC* e, uint32_t expr) {
+    struct FlatNode n = NODE(e, expr);
+    uint32_t u = ++e->n_unary;
+    line(e, "struct LambValue u%u;", u);
+    uint32_t fail = e->fail, fail_held = e->fail_held;
+    e->fail = u;
+    e->fail_held = e->n_held;
+    uint32_t a = emit_expr(e, n.a);
+    e->fail = fail;
+    e->fail_held = fail_held;
+    line(e, "u%u = t%u;", u, a);
+    line(e, "e%u: __attribute__((unused));", u);
+    uint32_t t = e->n_temps++;
+    const char* op = n.tag == AST_SUCC ? "NUM_SUCC(LV_NUM(u%u))" : n.tag == AST_DEC ? "NUM_DEC(LV_NUM(u%u))"
+                   : n.tag == AST_POS ? "LV_NUM(u%u) > 0" : "LV_NUM(u%u) < 0";
+    char num[64];
+    snprintf(num, sizeof(num), op, u);
+    line(e, "struct LambValue t%u = LV_IS_NUM(u%u) ? RT_NUM(%s) : rt_unary(S, u%u, %s);",
+         t, u, num, u, n.tag == AST_DEC ? "true" : "false");
+    return t;
+}
+
+static uint32_t emit_if_else(struct EmitC* e, uint32_t expr) {
+    struct FlatNode n = NODE(e, expr);
+    uint32_t c = emit_expr(e, n.a);
+    line(e, "if (!LV_IS_NUM(t%u)) {", c);
+    e->indent++;
+    line(e, "if (!RT_IS_ERR(t%u)) t%u = rt_cond(S, t%u);", c, c, c);
+    fail(e, c);
+    e->indent--;
+    line(e, "}");
+    uint32_t t = e->n_temps++;
+    line(e, "struct LambValue t%u;", t);
+    line(e, "if (LV_NUM(t%u)) {", c);
+    e->indent++;
+    uint32_t a = emit_expr(e, n.b);
+    line(e, "t%u = t%u;", t, a);
+    e->indent--;
+    line(e, "} else {");
+    e->indent++;
+    uint32_t b = emit_expr(e, n.c);
+    line(e, "t%u = t%u;", t, b);
+    e->indent--;
+    line(e, "}");
+    return t;
+}
+
+static void bind(struct EmitC* e, uint32_t slot, uint32_t t) {
+    line(e, "lv_release(S, s%u);", slot);
+    line(e, "s%u = t%u;", slot, t);
+}
+
+static void emit_letrec(struct EmitC* e, uint32_t expr) {
+    struct FlatNode n = NODE(e, expr);
+    bool value = NODE(e, n.b).tag != AST_ABS;
+    if (value) e->pending[n.slot]++;
+    uint32_t fn = emit_expr(e, n.b);
+    if (value) e->pending[n.slot]--;
+    pass_error(e, fn);
+    line(e, "if (LV_TYPE(t%u) != LOBJ_CLOSURE) {", fn);
+    e->indent++;
+    line(e, "t%u = rt_letrec(S, t%u);", fn, fn);
+    fail(e, fn);
+    e->indent--;
+    line(e, "}");
+    bind(e, n.slot, fn);
+}
+
+static uint32_t emit_abs(struct EmitC* e, uint32_t abs) {
+    const uint32_t* record = RECORD(e, abs);
+    uint32_t t = e->n_temps++;
+    line(e, "struct LambValue t%u = LV_FROM_OBJ(make_lamb_closure(S, %u, %u));", t, e->fn_id[abs], record[1]);
+    for (uint32_t i = 0; i < record[1]; i++) {
+        uint32_t v = take(e, record[2 + i]);
+        line(e, "LOBJ_CLOSURE(LV_OBJ(t%u))->captured[%u] = t%u;", t, i, v);
+    }
+    return t;
+}
+
+static uint32_t emit_app(struct EmitC* e, uint32_t expr) {
+    struct FlatNode n = NODE(e, expr);
+    if (!n.c) return emit_expr(e, n.a);
+    // a fn that is a name is only borrowed for the first call (see resolver.h)
+    // one that may be unbound is read as any name, to make its error
+    bool borrowed = (n.slot & APP_BORROW) && !may_be_unbound(e, e->abs, e->pending, NODE(e, n.a).b);
+    char name[64], fn[64];
+    if (borrowed) borrow(name, sizeof(name), NODE(e, n.a).b);
+    uint32_t t;
+    if (n.c == 1) {
+        uint32_t arg = emit_expr(e, ARG(e, n.b));
+        pass_error(e, arg);
+        t = e->n_temps++;
+        if (borrowed) {
+            line(e, "struct LambValue t%u = rt_call(S, %s, t%u);", t, name, arg);
+            return t;
+        }
+        hold(e, arg);
+        uint32_t f = emit_expr(e, n.a);
+        pass_error(e, f);
+        e->n_held--;
+        line(e, "struct LambValue t%u = rt_call(S, t%u, t%u);", t, f, arg);
+        line(e, "lv_release(S, t%u);", f);
+        return t;
+    }
+    uint32_t f = 0;
+    if (!borrowed) {
+        f = emit_expr(e, n.a);
+        pass_error(e, f);
+    }
+    for (uint32_t i = 0; i < n.c; i++) {
+        bool b = borrowed && !i;
+        if (b) {
+            snprintf(fn, sizeof(fn), "%s", name);
+        } else {
+            snprintf(fn, sizeof(fn), "t%u", f);
+        }
+        line(e, "if (LV_TYPE(%s) != LOBJ_CLOSURE) {", fn);
+        e->indent++;
+        uint32_t x = e->n_temps++;
+        line(e, "struct LambValue t%u = rt_not_fn(S, %s, %s);", x, fn, b ? "true" : "false");
+        fail(e, x);
+        e->indent--;
+        line(e, "}");
+        if (!b) hold(e, f);
+        uint32_t arg = emit_expr(e, ARG(e, n.b + i));
+        pass_error(e, arg);
+        if (!b) e->n_held--;
+        t = e->n_temps++;
+        line(e, "struct LambValue t%u = rt_call(S, %s, t%u);", t, fn, arg);
+        if (!b) line(e, "lv_release(S, t%u);", f);
+        if (i + 1 < n.c) pass_error(e, t);
+        f = t;
+    }
+    return t;
+}
+
+static uint32_t emit_node(struct EmitC* e, uint32_t expr) {
+    struct FlatNode n = NODE(e, expr);
+    uint32_t t;
+    switch (n.tag) {
+        case AST_NUM:
+            t = e->n_temps++;
+            line(e, "struct LambValue t%u = RT_NUM(%d);", t, (int)n.a);
+            return t;
+        case AST_IDENTIFIER:
+            t = take(e, n.b);
+            if (may_be_unbound(e, e->abs, e->pending, n.b)) {
+                struct String name = symbol_name(n.a);
+                fprintf(e->out, "%*sif (LV_IS_NONE(t%u)) t%u = rt_error(S, \"[run-time error] attempted to use an undefined name: \" ",
+                        4 * e->indent, "", t, t);
+                put_string(e->out, name.b, name.length);
+                fprintf(e->out, ");\n");
+            }
+            return t;
+        case AST_SUCC:
+        case AST_DEC:
+        case AST_POS:
+        case AST_NEG:
+            return emit_unary(e, expr);
+        case AST_IF_ELSE:
+            return emit_if_else(e, expr);
+        case AST_APP:
+            return emit_app(e, expr);
+        case AST_ABS:
+            return emit_abs(e, expr);
+        case AST_ERR: {
+            struct String message = flat_string(e->prog, n.a);
+            t = e->n_temps++;
+            fprintf(e->out, "%*sputs(", 4 * e->indent, "");
+            put_string(e->out, message.b, message.length);
+            fprintf(e->out, ");\n");
+            line(e, "struct LambValue t%u = LV_NONE;", t);
+            return t;
+        }
+        default:
+            assert(0);
+            return 0;
+    }
+}
+
+static uint32_t emit_expr(struct EmitC* e, uint32_t expr) {
+    if (e->too_deep || e->depth == EMITC_MAX_DEPTH) {
+        e->too_deep = true;
+        return 0;
+    }
+    e->depth++;
+    // a let's body follows it in the same block, so a chain of lets (say, a
+    // library) is a loop
+    for (;;) {
+        struct FlatNode n = NODE(e, expr);
+        if (n.tag == AST_LET_IN) {
+            uint32_t t = emit_expr(e, n.b);
+            pass_error(e, t);
+            bind(e, n.slot, t);
+        } else if (n.tag == AST_LETREC) {
+            emit_letrec(e, expr);
+        } else {
+            break;
+        }
+        expr = n.c;
+    }
+    uint32_t t = emit_node(e, expr);
+    e->depth--;
+    return t;
+}
+
+// the root, when abs is 0, takes no closure or argument
+static void emit_fn(struct EmitC* e, uint32_t abs) {
+    uint32_t n_slots = abs ? RECORD(e, abs)[0] : e->prog->root_slots;
+    e->n_temps = e->n_unary = e->n_held = e->fail = 0;
+    e->abs = abs;
+    e->pending = emit_realloc(NULL, sizeof(uint32_t) * (n_slots + 1));
+    memset(e->pending, 0, sizeof(uint32_t) * (n_slots + 1));
+    if (abs) {
+        fprintf(e->out, "static struct LambValue f%u(struct Interpreter* S, struct LambObject* self, struct LambValue arg) {\n",
+                e->fn_id[abs]);
+    } else {
+        fprintf(e->out, "static struct LambValue lamb_root(struct Interpreter* S) {\n");
+    }
+    e->indent = 1;
+    line(e, "struct LambValue r;");
+    for (uint32_t i = 0; i < n_slots; i++) {
+        line(e, "struct LambValue s%u = %s;", i, abs && !i ? "arg" : "LV_NONE");
+    }
+    uint32_t t = emit_expr(e, abs ? NODE(e, abs).b : e->prog->root);
+    line(e, "r = t%u;", t);
+    fprintf(e->out, "out: __attribute__((unused));\n");
+    for (uint32_t i = 0; i < n_slots; i++) {
+        line(e, "lv_release(S, s%u);", i);
+    }
+    line(e, "return r;");
+    fprintf(e->out, "}\n\n");
+    free(e->pending);
+}
+
+int emit_c(struct FlatProgram* prog, const char* out_path, const char* source_path) {
+    struct EmitC e = {.prog = prog};
+    e.fn_id = emit_realloc(NULL, sizeof(uint32_t) * (prog->n_nodes ? prog->n_nodes : 1));
+    e.fns = emit_realloc(NULL, sizeof(uint32_t) * (prog->n_nodes ? prog->n_nodes : 1));
+    for (uint32_t i = 1; i < prog->n_nodes; i++) {
+        if (prog->nodes[i].tag == AST_LAZY) {
+            fprintf(stderr, "lamb: err: cannot compile a program with unparsed fn bodies.\n");
+            free(e.fn_id);
+            free(e.fns);
+            return 0;
+        }
+        if (prog->nodes[i].tag != AST_ABS) continue;
+        e.fn_id[i] = e.n_fns;
+        e.fns[e.n_fns++] = i;
+    }
+    e.out = strcmp(out_path, "-") ? fopen(out_path, "w") : stdout;
+    if (!e.out) {
+        fprintf(stderr, "lamb: err: cannot write \"%s\"; %s.\n", out_path, strerror(errno));
+        free(e.fn_id);
+        free(e.fns);
+        return 0;
+    }
+    e.unbound = emit_realloc(NULL, prog->n_closures + 1);
+    memset(e.unbound, 0, prog->n_closures + 1);
+    e.seen = emit_realloc(NULL, prog->n_nodes + 1);
+    memset(e.seen, 0, prog->n_nodes + 1);
+    uint32_t* root_pending = emit_realloc(NULL, sizeof(uint32_t) * (prog->root_slots + 1));
+    memset(root_pending, 0, sizeof(uint32_t) * (prog->root_slots + 1));
+    mark_unbound(&e, 0, root_pending, prog->root);
+    free(root_pending);
+    fprintf(e.out, "// %s, compiled by lamb emit-c\n#include \"lambrt.h\"\n\n", source_path);
+    for (uint32_t i = 0; i < e.n_fns; i++) {
+        fprintf(e.out, "static struct LambValue f%u(struct Interpreter* S, struct LambObject* self, struct LambValue arg);\n", i);
+    }
+    fprintf(e.out, "\n");
+    for (uint32_t i = 0; i < e.n_fns; i++) {
+        emit_fn(&e, e.fns[i]);
+    }
+    emit_fn(&e, 0);
+    fprintf(e.out, "struct LambValue (* const lamb_fns[])(struct Interpreter* S, struct LambObject* self, struct LambValue arg) = {\n");
+    for (uint32_t i = 0; i < e.n_fns; i++) {
+        fprintf(e.out, "    f%u,\n", i);
+    }
+    fprintf(e.out, "    NULL\n};\n\n");
+    // nested fns' texts are within each other's, so all are spans of one
+    char* text;
+    size_t len;
+    long* spans = emit_realloc(NULL, sizeof(long) * 2 * (prog->n_nodes ? prog->n_nodes : 1));
+    FILE* mem = open_memstream(&text, &len);
+    if (!mem) {
+        fprintf(stderr, "lamb: err: out of memory (emit-c).\n");
+        exit(1);
+    }
+    flat_fprint_spans(mem, prog, prog->root, spans);
+    fclose(mem);
+    fprintf(e.out, "const char lamb_text[] = ");
+    put_string(e.out, text, len);
+    fprintf(e.out, ";\n\nconst struct LambSpan lamb_fn_text[] = {\n");
+    for (uint32_t i = 0; i < e.n_fns; i++) {
+        long at = spans[2 * e.fns[i]];
+        fprintf(e.out, "    {%ld, %ld},\n", at < 0 ? 0 : at, at < 0 ? 0 : spans[2 * e.fns[i] + 1]);
+    }
+    free(spans);
+    free(text);
+    fprintf(e.out, "    {0, 0}\n};\n\nint main(void) {\n    return rt_main(lamb_root);\n}\n");
+    int ok = !ferror(e.out);
+    if (e.out != stdout && fclose(e.out)) ok = 0;
+    if (!ok) fprintf(stderr, "lamb: err: cannot write \"%s\"; %s.\n", out_path, strerror(errno));
+    if (ok && e.too_deep) {
+        fprintf(stderr, "lamb: err: program nested more than %d deep, too deep to compile to C.\n", EMITC_MAX_DEPTH);
+        ok = 0;
+    }
+    free(e.fn_id);
+    free(e.fns);
+    free(e.held);
+    free(e.unbound);
+    free(e.seen);
+    return ok;
+}
@@ -0,0 +1,27 @@
+#ifndef LAMB_EMITC_H
+#define LAMB_EMITC_H
+#include "flat.h"
+
+// `lamb emit-c`: a resolved program as one C translation unit that, built
+// against the runtime (see lambrt.h and liblamb.a), is a native executable
+// printing the same `> result` line as the interpreter.
+//
+// The resolver has already closure-converted the program (see resolver.h),
+// so lifting each fn to the top is direct: every AST_ABS becomes a C
+// function of its closure and argument, its frame's slots become C locals,
+// and its closure record says what a closure of it copies. Values,
+// reference counting, the moves and borrows the resolver inferred, and
+// every error are the tree walker's.
+//
+//   make runtime
+//   ./build/lamb emit-c prog.code -o prog.c
+//   gcc -O2 -Isrc prog.c build/liblamb.a -pthread -o prog
+//
+// The C is as nested as the program, which gcc and the emitter's own stack
+// bound: deeper programs are refused.
+#define EMITC_MAX_DEPTH 10000
+
+// out_path "-" is stdout; returns 0 and reports on failure
+int emit_c(struct FlatProgram* prog, const char* out_path, const char* source_path);
+
+#endif
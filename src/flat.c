@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "flat.h"
+#include "parser.h"
+#include "symbol.h"
+#include "resolver.h"
+
+#define GROW(arr, n, cap) do { \
+    if ((n) == (cap)) { \
+        (cap) = (cap) ? (cap) * 2 : 64; \
+        (arr) = realloc((arr), sizeof(*(arr)) * (cap)); \
+        if (!(arr)) { \
+            fprintf(stderr, "lamb: err: out of memory (flatten).\n"); \
+            exit(1); \
+        } \
+    } \
+} while (0)
+
+static uint32_t new_node(struct FlatProgram* p, enum ASTType tag) {
+    GROW(p->nodes, p->n_nodes, p->cap_nodes);
+    p->nodes[p->n_nodes] = (struct FlatNode) {.tag = tag};
+    return p->n_nodes++;
+}
+
+static uint32_t new_string(struct FlatProgram* p, struct String s) {
+    GROW(p->strings, p->n_strings, p->cap_strings);
+    while (p->n_chars + s.length + 1 > p->cap_chars) {
+        p->cap_chars = p->cap_chars ? p->cap_chars * 2 : 256;
+        p->chars = realloc(p->chars, p->cap_chars);
+        if (!p->chars) {
+            fprintf(stderr, "lamb: err: out of memory (flatten).\n");
+            exit(1);
+        }
+    }
+    memcpy(p->chars + p->n_chars, s.b, s.length);
+    p->chars[p->n_chars + s.length] = '\0';
+    p->strings[p->n_strings] = (struct FlatString) {p->n_chars, s.length};
+    p->n_chars += s.length + 1;
+    return p->n_strings++;
+}
+
+struct String flat_string(struct FlatProgram* p, uint32_t string) {
+    struct FlatString s = p->strings[string];
+    return (struct String) {.length = s.length, .b = p->chars + s.offset};
+}
+
+static uint32_t* shared_slot(struct FlatProgram* p, struct AST* ast) {
+    uint32_t mask = p->cap_shared - 1;
+    uint32_t i = (uint32_t)(((uintptr_t)ast >> 4) * 2654435761u) & mask;
+    while (p->shared[i] && p->shared[i] != ast) i = (i + 1) & mask;
+    p->shared[i] = ast;
+    return &p->shared_node[i];
+}
+
+// the node already made for ast, or 0; in which case it is n from now on
+static uint32_t find_shared(struct FlatProgram* p, struct AST* ast, uint32_t n) {
+    if (2 * (p->n_shared + 1) > p->cap_shared) {
+        struct AST** old = p->shared;
+        uint32_t* old_node = p->shared_node;
+        uint32_t old_cap = p->cap_shared;
+        p->cap_shared = old_cap ? old_cap * 2 : 256;
+        p->shared = calloc(p->cap_shared, sizeof(struct AST*));
+        p->shared_node = calloc(p->cap_shared, sizeof(uint32_t));
+        for (uint32_t i = 0; i < old_cap; i++) {
+            if (old[i]) *shared_slot(p, old[i]) = old_node[i];
+        }
+        free(old);
+        free(old_node);
+    }
+    uint32_t* slot = shared_slot(p, ast);
+    if (*slot) return *slot;
+    *slot = n;
+    p->n_shared++;
+    return 0;
+}
+
+// A child still to be flattened and the operand it goes into: field 0-2 is
+// a/b/c of node `parent`, field 3 is args[parent].
+struct FlattenItem {
+    struct AST* ast;
+    uint32_t parent;
+    uint32_t field;
+};
+
+struct FlattenStack {
+    struct FlattenItem* items;
+    uint32_t len, cap;
+};
+
+static void push_item(struct FlattenStack* st, struct AST* ast, uint32_t parent, uint32_t field) {
+    GROW(st->items, st->len, st->cap);
+    st->items[st->len++] = (struct FlattenItem) {ast, parent, field};
+}
+
+// Pre-order, with an explicit stack like the parser, so that a parent is
+// followed by its children in memory and nesting depth is not limited.
+static uint32_t flatten_into(struct FlatProgram* p, struct AST* ast) {
+    struct FlattenStack st = {NULL, 0, 0};
+    uint32_t root = 0;
+    push_item(&st, ast, 0, 0);
+    while (st.len) {
+        struct FlattenItem it = st.items[--st.len];
+        struct AST* a = it.ast;
+        uint32_t n = p->n_nodes;
+        uint32_t seen = a->refs > 1 ? find_shared(p, a, n) : 0;
+        if (seen) {
+            n = seen;
+        } else {
+            new_node(p, a->tag);
+        }
+        if (!root) {
+            root = n; // always the first item popped
+        } else if (it.field == 3) {
+            p->args[it.parent] = n;
+        } else {
+            uint32_t* ops = &p->nodes[it.parent].a;
+            ops[it.field] = n;
+        }
+        if (seen) continue;
+        // children are pushed last-first so that they pop in source order
+        switch (a->tag) {
+            case AST_ABS:
+                p->nodes[n].a = a->u.abs.id->u.identifier.sym;
+                if (a->u.abs.body->tag == AST_LAZY) {
+                    // the stub names the AST_ABS, which force_abs_body wants
+                    uint32_t stub = new_node(p, AST_LAZY);
+                    GROW(p->lazy, p->n_lazy, p->cap_lazy);
+                    p->lazy[p->n_lazy] = a;
+                    p->nodes[stub].a = p->n_lazy++;
+                    p->nodes[n].b = stub;
+                } else {
+                    push_item(&st, a->u.abs.body, n, 1);
+                }
+                break;
+            case AST_APP: {
+                uint32_t first = p->n_args, count = 0, base = st.len;
+                for (struct AST* l = a->u.app.alist; l; l = l->u.app_list.next) {
+                    GROW(p->args, p->n_args, p->cap_args);
+                    p->args[p->n_args++] = 0;
+                    push_item(&st, l->u.app_list.arg, first + count++, 3);
+                }
+                p->nodes[n].b = first;
+                p->nodes[n].c = count;
+                // pushed front to back in one walk of the list, then turned
+                // around so that they pop front first
+                for (uint32_t i = base, j = st.len - 1; count && i < j; i++, j--) {
+                    struct FlattenItem t = st.items[i];
+                    st.items[i] = st.items[j];
+                    st.items[j] = t;
+                }
+                push_item(&st, a->u.app.fn, n, 0);
+                break;
+            }
+            case AST_IDENTIFIER:
+                p->nodes[n].a = a->u.identifier.sym;
+                break;
+            case AST_NUM:
+                p->nodes[n].a = (uint32_t)a->u.num.value;
+                break;
+            case AST_SUCC:
+            case AST_DEC:
+            case AST_POS:
+            case AST_NEG:
+                push_item(&st, a->u.succ.arg, n, 0);
+                break;
+            case AST_LET_IN:
+                p->nodes[n].a = a->u.binding.id;
+                push_item(&st, a->u.binding.expr, n, 2);
+                push_item(&st, a->u.binding.value, n, 1);
+                break;
+            case AST_LETREC:
+                p->nodes[n].a = a->u.letrec.id;
+                push_item(&st, a->u.letrec.expr, n, 2);
+                push_item(&st, a->u.letrec.fn, n, 1);
+                break;
+            case AST_IF_ELSE:
+                push_item(&st, a->u.if_else.else_branch, n, 2);
+                push_item(&st, a->u.if_else.then_branch, n, 1);
+                push_item(&st, a->u.if_else.cond, n, 0);
+                break;
+            case AST_ERR:
+                p->nodes[n].a = new_string(p, a->u.err.error_message);
+                break;
+            case AST_LAZY:
+                break; // only reached through its AST_ABS, see above
+            default:
+                fprintf(stderr, "lamb: err: [flatten] Unknown AST type.\n");
+        }
+    }
+    free(st.items);
+    return root;
+}
+
+struct FlatProgram* flatten(struct AST* ast) {
+    struct FlatProgram* p = calloc(1, sizeof(struct FlatProgram));
+    new_node(p, AST_ERR); // index 0 is "none"
+    p->root = flatten_into(p, ast);
+    return p;
+}
+
+void flat_force_body(struct FlatProgram* prog, uint32_t abs) {
+    uint32_t body = prog->nodes[abs].b;
+    if (prog->nodes[body].tag != AST_LAZY) return;
+    uint32_t lazy = prog->nodes[body].a;
+    struct AST* ast = prog->lazy[lazy];
+    force_abs_body(ast);
+    uint32_t flat_body = flatten_into(prog, ast->u.abs.body);
+    prog->nodes[abs].b = flat_body; // nodes may have moved, index again
+    resolve_body(prog, abs, lazy);
+}
+
+void flat_force_all(struct FlatProgram* prog, uint32_t node) {
+    for (;;) {
+        struct FlatNode n = prog->nodes[node];
+        switch (n.tag) {
+            case AST_ABS:
+                flat_force_body(prog, node);
+                node = prog->nodes[node].b;
+                break;
+            case AST_APP:
+                for (uint32_t j = 0; j < n.c; j++) flat_force_all(prog, prog->args[n.b + j]);
+                node = n.a;
+                break;
+            case AST_SUCC:
+            case AST_DEC:
+            case AST_POS:
+            case AST_NEG:
+                node = n.a;
+                break;
+            case AST_LET_IN:
+            case AST_LETREC:
+                flat_force_all(prog, n.b);
+                node = n.c;
+                break;
+            case AST_IF_ELSE:
+                flat_force_all(prog, n.a);
+                flat_force_all(prog, n.b);
+                node = n.c;
+                break;
+            default:
+                return;
+        }
+    }
+}
+
+// a thunk of expr, unless it is a value already: a number, a fn, or a name,
+// whose value (maybe a thunk itself) is passed on as it is
+static uint32_t delay(struct FlatProgram* p, uint32_t expr, uint32_t param) {
+    enum ASTType tag = p->nodes[expr].tag;
+    if (tag == AST_NUM || tag == AST_ABS || tag == AST_IDENTIFIER || tag == AST_ERR) return expr;
+    uint32_t thunk = new_node(p, AST_ABS);
+    p->nodes[thunk].slot = ABS_THUNK;
+    p->nodes[thunk].a = param;
+    p->nodes[thunk].b = expr;
+    return thunk;
+}
+
+void flat_delay(struct FlatProgram* p) {
+    // a name no program can use
+    uint32_t none = symbol_intern("#", 1);
+    for (uint32_t i = 1, n = p->n_nodes; i < n; i++) {
+        struct FlatNode node = p->nodes[i];
+        switch (node.tag) {
+            case AST_APP:
+                for (uint32_t j = 0; j < node.c; j++) {
+                    uint32_t arg = delay(p, p->args[node.b + j], none);
+                    p->args[node.b + j] = arg;
+                }
+                break;
+            case AST_LET_IN:
+            case AST_LETREC: {
+                // delay may move the nodes
+                uint32_t value = delay(p, node.b, none);
+                p->nodes[i].b = value;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+static void fprint_node(FILE* out, struct FlatProgram* p, uint32_t node, long* spans);
+
+// a1[a2[... an NIL]], in a loop so that a long list needs no C stack
+static void fprint_args(FILE* out, struct FlatProgram* p, uint32_t first, uint32_t count, long* spans) {
+    for (uint32_t i = 0; i < count; i++) {
+        fprint_node(out, p, p->args[first + i], spans);
+        fprintf(out, i + 1 < count ? "[" : " NIL");
+    }
+    for (uint32_t i = 1; i < count; i++) fprintf(out, "]");
+}
+
+static void fprint_node(FILE* out, struct FlatProgram* p, uint32_t node, long* spans) {
+    struct FlatNode n = p->nodes[node];
+    switch (n.tag) {
+        case AST_ABS: {
+            if (n.slot & ABS_THUNK) { // not in the source
+                fprint_node(out, p, n.b, spans);
+                break;
+            }
+            long start = spans ? ftell(out) : 0;
+            fprintf(out, "(\\%s ", symbol_name(n.a).b);
+            fprint_node(out, p, n.b, spans);
+            fprintf(out, ")");
+            if (spans && spans[2 * node] < 0) {
+                spans[2 * node] = start;
+                spans[2 * node + 1] = ftell(out) - start;
+            }
+            break;
+        }
+        case AST_APP:
+            fprint_node(out, p, n.a, spans);
+            if (n.c) {
+                fprintf(out, "[");
+                fprint_args(out, p, n.b, n.c, spans);
+                fprintf(out, "]");
+            }
+            break;
+        case AST_NUM:
+            fprintf(out, "%d", (int)n.a);
+            break;
+        case AST_SUCC:
+        case AST_DEC:
+        case AST_POS:
+        case AST_NEG:
+            fprintf(out, n.tag == AST_SUCC ? "(+" : n.tag == AST_DEC ? "(-" : n.tag == AST_POS ? "(<" : "(>");
+            fprint_node(out, p, n.a, spans);
+            fprintf(out, ")");
+            break;
+        case AST_IDENTIFIER:
+            fprintf(out, "%s", symbol_name(n.a).b);
+            break;
+        case AST_ERR:
+            fprintf(out, "%s", flat_string(p, n.a).b);
+            break;
+        case AST_LET_IN:
+            fprintf(out, "%s=", symbol_name(n.a).b);
+            fprint_node(out, p, n.b, spans);
+            fprintf(out, " in (");
+            fprint_node(out, p, n.c, spans);
+            fprintf(out, ")");
+            break;
+        case AST_IF_ELSE:
+            fprintf(out, "if ");
+            fprint_node(out, p, n.a, spans);
+            fprintf(out, " then ");
+            fprint_node(out, p, n.b, spans);
+            fprintf(out, " else ");
+            fprint_node(out, p, n.c, spans);
+            break;
+        case AST_LETREC:
+            fprintf(out, "def %s=", symbol_name(n.a).b);
+            fprint_node(out, p, n.b, spans);
+            fprintf(out, " in (");
+            fprint_node(out, p, n.c, spans);
+            fprintf(out, ")");
+            break;
+        case AST_LAZY:
+            fprintf(out, "...");
+            break;
+        default:
+            fprintf(stderr, "lamb: err: [flat_pprint_helper] Unknown AST type.\n");
+    }
+}
+
+// same output as pprint_ast_helper on the tree this came from
+void flat_fprint(FILE* out, struct FlatProgram* p, uint32_t node) {
+    fprint_node(out, p, node, NULL);
+}
+
+void flat_fprint_spans(FILE* out, struct FlatProgram* p, uint32_t node, long* spans) {
+    for (uint32_t i = 0; i < 2 * p->n_nodes; i++) {
+        spans[i] = -1;
+    }
+    fprint_node(out, p, node, spans);
+}
+
+void flat_pprint_helper(struct FlatProgram* p, uint32_t node) {
+    flat_fprint(stdout, p, node);
+}
+
+void flat_pprint(struct FlatProgram* p, uint32_t node) {
+    flat_pprint_helper(p, node);
+    printf("\n");
+}
+
+size_t flat_bytes(struct FlatProgram* p) {
+    return p->n_nodes * sizeof(struct FlatNode) + p->n_args * sizeof(uint32_t)
+        + p->n_strings * sizeof(struct FlatString) + p->n_chars
+        + p->n_closures * sizeof(uint32_t)
+        + p->n_lazy * sizeof(struct AST*);
+}
+
+void flat_free(struct FlatProgram* p) {
+    if (!p) return;
+    resolver_free(p->resolver);
+    if (p->mapping) {
+        munmap(p->mapping, p->mapping_len);
+    } else {
+        free(p->nodes);
+        free(p->args);
+        free(p->closures);
+        free(p->strings);
+        free(p->chars);
+        free(p->lazy);
+        free(p->shared);
+        free(p->shared_node);
+    }
+    free(p->strict);
+    free(p);
+}
@@ -0,0 +1,100 @@
+#ifndef LAMB_FLAT_H
+#define LAMB_FLAT_H
+#include <stdio.h>
+#include <stdint.h>
+#include "ast.h"
+
+struct Resolver;
+
+// Flattened AST that the interpreter walks. Nodes live in one array and refer
+// to each other by 32-bit index (0 is "none"); the 16-byte node holds only
+// the tag and three operands, and anything bulky or rarely touched (error
+// messages, argument lists, unparsed bodies) sits in side arrays. Names are
+// symbols (see symbol.h); once resolved (see resolver.h), names also have
+// addresses, fns a closure record and let/letrec nodes the slot they bind.
+//
+//   tag              a               b                c
+//   AST_ABS          param symbol    body node        closure record
+//   AST_APP          fn node         first arg slot   number of args
+//   AST_IDENTIFIER   symbol          address          -
+//   AST_NUM          value           -                -
+//   AST_SUCC/DEC/    operand node    -                -
+//     POS/NEG
+//   AST_LET_IN       symbol          value node       body node
+//   AST_LETREC       symbol          fn node          body node
+//   AST_IF_ELSE      cond node       then node        else node
+//   AST_ERR          message string  -                -
+//   AST_LAZY         lazy slot       -                -
+// offset into FlatProgram.chars; the characters are also NUL-terminated
+struct FlatString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct FlatNode {
+    uint32_t tag : 8; // enum ASTType
+    uint32_t slot : 24; // AST_LET_IN, AST_LETREC: the slot bound; AST_APP: APP_BORROW; AST_ABS: ABS_THUNK
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+struct FlatProgram {
+    struct FlatNode* nodes;
+    uint32_t n_nodes, cap_nodes;
+    uint32_t* args;          // argument node spans of AST_APP
+    uint32_t n_args, cap_args;
+    struct FlatString* strings; // error messages
+    uint32_t n_strings, cap_strings;
+    char* chars;
+    uint32_t n_chars, cap_chars;
+    uint32_t* closures;      // closure records of AST_ABS
+    uint32_t n_closures, cap_closures;
+    struct AST** lazy;       // the AST_ABS whose body an AST_LAZY stands for
+    uint32_t n_lazy, cap_lazy;
+    // node of each AST node shared by hash-consing (refs > 1) already
+    // flattened, so the program stays a DAG; an open-addressing table
+    struct AST** shared;
+    uint32_t* shared_node;
+    uint32_t n_shared, cap_shared;
+    uint32_t root;
+    uint32_t root_slots; // size of the top-level frame
+    uint8_t* strict;     // by AST_ABS node, under --lazy (see strict.h)
+    struct Resolver* resolver; // kept for bodies still to be parsed
+    // a program loaded from a .lambc points into this read-only mapping
+    // (see lambc.h) instead of owning its arrays
+    void* mapping;
+    size_t mapping_len;
+};
+
+// node i, argument slot i and the closure record of fn abs, of the program
+// x->prog of whatever walks it
+#define NODE(x, i) ((x)->prog->nodes[(i)])
+#define ARG(x, i) ((x)->prog->args[(i)])
+#define RECORD(x, abs) (&(x)->prog->closures[NODE(x, abs).c])
+
+struct FlatProgram* flatten(struct AST* ast);
+// For call by need (see interpreter.h): wraps every argument and let value
+// that is not a value already in a fn marked ABS_THUNK, whose closure the
+// resolver works out as for any fn, and which the evaluator makes into a
+// thunk rather than a closure. So does the value of a letrec that is not a
+// fn, which the letrec forces at once. Runs before resolve, on a program
+// with no unparsed bodies.
+void flat_delay(struct FlatProgram* prog);
+#define ABS_THUNK 1 // in the slot field of an AST_ABS
+struct String flat_string(struct FlatProgram* prog, uint32_t string);
+// parses, flattens and resolves the body of abs if it is still AST_LAZY
+void flat_force_body(struct FlatProgram* prog, uint32_t abs);
+// forces the body of every fn within node, as for printing it whole
+void flat_force_all(struct FlatProgram* prog, uint32_t node);
+void flat_pprint(struct FlatProgram* prog, uint32_t node);
+void flat_pprint_helper(struct FlatProgram* prog, uint32_t node);
+void flat_fprint(FILE* out, struct FlatProgram* prog, uint32_t node);
+// as flat_fprint, noting where the text of each fn printed is: spans has two
+// entries per node, for an AST_ABS its offset in out and its length (-1 if
+// not printed)
+void flat_fprint_spans(FILE* out, struct FlatProgram* prog, uint32_t node, long* spans);
+size_t flat_bytes(struct FlatProgram* prog);
+void flat_free(struct FlatProgram* prog);
+
+#endif
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gc.h"
+#include "interpreter.h"
+
+// an object moved by the running collection: the first word after its
+// header points to its copy
+#define FORWARDED -1
+#define ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+static void* gc_malloc(size_t size) {
+    void* p = malloc(size);
+    if (!p) {
+        fprintf(stderr, "lamb: err: out of memory (gc).\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void space_init(struct GcSpace* s, size_t size) {
+    s->start = s->top = gc_malloc(size);
+    s->end = s->start + size;
+}
+
+struct Gc* gc_create(struct GcConfig config) {
+    struct Gc* gc = calloc(1, sizeof(struct Gc));
+    if (!gc) {
+        fprintf(stderr, "lamb: err: out of memory (gc).\n");
+        exit(1);
+    }
+    if (!config.nursery) config.nursery = GC_DEFAULT_NURSERY;
+    if (!config.heap) config.heap = GC_DEFAULT_HEAP;
+    if (!config.growth) config.growth = GC_DEFAULT_GROWTH;
+    gc->config = config;
+    space_init(&gc->nursery, config.nursery);
+    space_init(&gc->old, config.heap);
+    gc->old_limit = config.heap;
+    gc->peak_heap = config.heap;
+    return gc;
+}
+
+void gc_free(struct Gc* gc) {
+    if (!gc) return;
+    free(gc->nursery.start);
+    free(gc->old.start);
+    free(gc->frames);
+    free(gc->shadow);
+    free(gc);
+}
+
+/*
+ROOTS
+*/
+
+void gc_push_frame(struct Gc* gc, struct Environment* env) {
+    if (gc->n_frames == gc->cap_frames) {
+        gc->cap_frames = gc->cap_frames ? 2 * gc->cap_frames : 256;
+        gc->frames = realloc(gc->frames, sizeof(struct Environment*) * gc->cap_frames);
+        if (!gc->frames) {
+            fprintf(stderr, "lamb: err: out of memory (gc).\n");
+            exit(1);
+        }
+    }
+    gc->frames[gc->n_frames++] = env;
+}
+
+void gc_pop_frame(struct Gc* gc) {
+    gc->n_frames--;
+}
+
+void gc_push_root(struct Gc* gc, struct LambValue* v) {
+    if (gc->n_shadow == gc->cap_shadow) {
+        gc->cap_shadow = gc->cap_shadow ? 2 * gc->cap_shadow : 256;
+        gc->shadow = realloc(gc->shadow, sizeof(struct LambValue*) * gc->cap_shadow);
+        if (!gc->shadow) {
+            fprintf(stderr, "lamb: err: out of memory (gc).\n");
+            exit(1);
+        }
+    }
+    gc->shadow[gc->n_shadow++] = v;
+}
+
+/*
+COPYING
+
+An object is one block: the LambObject header, then its closure or its
+error string, followed by the string's chars.
+*/
+
+static size_t object_size(struct LambObject* o) {
+    size_t payload = o->type == LOBJ_CLOSURE
+        ? sizeof(struct LambClosure) + sizeof(struct LambValue) * LOBJ_CLOSURE(o)->n_captured
+        : sizeof(struct String) + LOBJ_STRING(o)->length + 1;
+    return ALIGN(sizeof(struct LambObject) + payload);
+}
+
+static bool in_space(struct GcSpace* s, struct LambObject* o) {
+    return (char*)o >= s->start && (char*)o < s->top;
+}
+
+// Copies v's object into to, unless it is already there or, in a minor
+// collection, old (young_only).
+static struct LambValue evacuate(struct Gc* gc, struct GcSpace* to, bool young_only, struct LambValue v) {
+    if (LV_IS_NUM(v) || LV_IS_NONE(v)) return v;
+    struct LambObject* o = LV_OBJ(v);
+    if (o->rc.count == FORWARDED) return LV_FROM_OBJ(*(struct LambObject**)LOBJ_DATA(o));
+    if (young_only && !in_space(&gc->nursery, o)) return v;
+    size_t size = object_size(o);
+    struct LambObject* copy = (struct LambObject*)to->top;
+    to->top += size;
+    memcpy(copy, o, size);
+    if (copy->type == LOBJ_ERR) {
+        struct String* str = LOBJ_STRING(copy);
+        str->b = (char*)(str + 1);
+    }
+    o->rc.count = FORWARDED;
+    *(struct LambObject**)LOBJ_DATA(o) = copy;
+    return LV_FROM_OBJ(copy);
+}
+
+// Copies what the roots reach into to, from its top. Cheney's scan: the
+// copies between scan and top are the queue of objects whose fields are
+// still to be evacuated.
+static void copy_reachable(struct Gc* gc, struct GcSpace* to, bool young_only) {
+    char* scan = to->top;
+    for (uint32_t f = 0; f < gc->n_frames; f++) {
+        struct Environment* env = gc->frames[f];
+        for (uint32_t i = 0; i < env->n_slots; i++) {
+            env->slots[i] = evacuate(gc, to, young_only, env->slots[i]);
+        }
+        if (env->closure) {
+            env->closure = LV_OBJ(evacuate(gc, to, young_only, LV_FROM_OBJ(env->closure)));
+        }
+    }
+    for (uint32_t i = 0; i < gc->n_shadow; i++) {
+        *gc->shadow[i] = evacuate(gc, to, young_only, *gc->shadow[i]);
+    }
+    while (scan < to->top) {
+        struct LambObject* o = (struct LambObject*)scan;
+        if (o->type == LOBJ_CLOSURE) {
+            struct LambClosure* cl = LOBJ_CLOSURE(o);
+            for (uint32_t i = 0; i < cl->n_captured; i++) {
+                cl->captured[i] = evacuate(gc, to, young_only, cl->captured[i]);
+            }
+        }
+        scan += object_size(o);
+    }
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Promotes the nursery's survivors into the old generation, which has room
+// for all of them (see gc_collect).
+static void minor(struct Gc* gc) {
+    char* top = gc->old.top;
+    copy_reachable(gc, &gc->old, true);
+    gc->bytes_promoted += gc->old.top - top;
+    gc->nursery.top = gc->nursery.start;
+    gc->n_minor++;
+}
+
+// Copies both generations into a new old space, big enough to take
+// everything plus reserve bytes after it.
+static void major(struct Gc* gc, size_t reserve) {
+    size_t used = (gc->old.top - gc->old.start) + (gc->nursery.top - gc->nursery.start);
+    size_t size = gc->config.growth * used;
+    if (size < gc->config.heap) size = gc->config.heap;
+    struct GcSpace to;
+    space_init(&to, size + reserve);
+    copy_reachable(gc, &to, false);
+    free(gc->old.start);
+    gc->old = to;
+    gc->nursery.top = gc->nursery.start;
+    size_t live = to.top - to.start;
+    gc->old_limit = gc->config.growth * live;
+    if (gc->old_limit < gc->config.heap) gc->old_limit = gc->config.heap;
+    if ((size_t)(to.end - to.start) > gc->peak_heap) gc->peak_heap = to.end - to.start;
+    gc->n_major++;
+}
+
+// A minor collection when the old generation can take the whole nursery
+// without passing its limit, else a major one. Either way the nursery is
+// empty after, and old objects point only to old ones.
+static void gc_collect(struct Gc* gc, size_t reserve) {
+    double t0 = now_ms();
+    size_t old_used = gc->old.top - gc->old.start;
+    size_t young = gc->nursery.top - gc->nursery.start;
+    if (reserve || old_used + young > gc->old_limit) {
+        major(gc, reserve);
+    } else {
+        minor(gc);
+    }
+    double pause = now_ms() - t0;
+    gc->pause_ms += pause;
+    if (pause > gc->max_pause_ms) gc->max_pause_ms = pause;
+}
+
+void* gc_alloc(struct Gc* gc, size_t size) {
+    size = ALIGN(size);
+    gc->bytes_allocated += size;
+    if (gc->nursery.end - gc->nursery.top < (ptrdiff_t)size) {
+        if (size > (size_t)(gc->nursery.end - gc->nursery.start)) {
+            // too big for the nursery: made old, right after a major
+            // collection, so that whatever it is filled with is old too
+            gc_collect(gc, size);
+            void* block = gc->old.top;
+            gc->old.top += size;
+            return block;
+        }
+        gc_collect(gc, 0);
+    }
+    void* block = gc->nursery.top;
+    gc->nursery.top += size;
+    return block;
+}
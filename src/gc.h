@@ -0,0 +1,71 @@
+#ifndef LAMB_GC_H
+#define LAMB_GC_H
+#include <stddef.h>
+#include <stdint.h>
+
+// A precise generational copying collector for the interpreter's heap
+// objects (closures and errors), used under --gc instead of reference
+// counting.
+//
+// New objects are bumped into a fixed nursery. When it is full, a minor
+// collection copies what is reachable in it into the old generation and
+// empties it. No object ever points to a younger one, as a closure is
+// never changed once its captures are filled in, so minor collections need
+// no remembered set or write barrier. When the old generation would pass
+// its limit, a major collection copies everything live, young and old,
+// into a fresh space (Cheney's algorithm), and the limit becomes growth
+// times what survived, so the heap stays proportional to the live data.
+// A letrec never makes a cycle (see resolver.h), but cycles would be
+// collected all the same.
+//
+// The roots are the frames on the frame stack (their slots and running
+// closure) and the shadow stack: the addresses of values the evaluator
+// holds in C locals across a call that may allocate. A collection updates
+// them in place.
+struct Environment;
+struct LambValue;
+
+struct GcConfig {
+    size_t nursery; // bytes
+    size_t heap;    // bytes the old generation may hold before the first major collection
+    unsigned growth;
+};
+
+#define GC_DEFAULT_NURSERY (256 * 1024)
+#define GC_DEFAULT_HEAP (1024 * 1024)
+#define GC_DEFAULT_GROWTH 2
+
+struct GcSpace {
+    char* start;
+    char* top;
+    char* end;
+};
+
+struct Gc {
+    struct GcConfig config;
+    struct GcSpace nursery;
+    struct GcSpace old;
+    size_t old_limit;
+    struct Environment** frames; // innermost last
+    uint32_t n_frames, cap_frames;
+    struct LambValue** shadow;
+    uint32_t n_shadow, cap_shadow;
+    // statistics
+    size_t n_minor, n_major;
+    double pause_ms, max_pause_ms; // total and longest
+    size_t bytes_allocated;
+    size_t bytes_promoted; // by minor collections
+    size_t peak_heap;      // largest old generation space
+};
+
+// zero fields of config take the defaults
+struct Gc* gc_create(struct GcConfig config);
+void gc_free(struct Gc* gc);
+// may collect first: anything not reachable from the roots may move or go
+void* gc_alloc(struct Gc* gc, size_t size);
+
+void gc_push_frame(struct Gc* gc, struct Environment* env);
+void gc_pop_frame(struct Gc* gc);
+void gc_push_root(struct Gc* gc, struct LambValue* v);
+
+#endif
@@ -1,96 +1,17 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include "interpreter.h"
-
-const int INITIAL_BUCKET_COUNT = 16;
-
-static unsigned int hash(struct HashMap* hm, struct String key) {
-    unsigned int val = 59810393 + key.length;
-    for (unsigned int i = 0; i < key.length; i++) {
-        val = val * 7;
-        val ^= key.b[i];
-    }
-    return val % hm->len_buckets;
-}
-
-struct HashMap* hashmap_create() {
-    struct HashMap* hm = malloc(sizeof(struct HashMap));
-    hm->buckets = malloc(sizeof(struct HashMapBucket*) * INITIAL_BUCKET_COUNT);
-    hm->len_buckets = INITIAL_BUCKET_COUNT;
-    hm->n_items = 0;
-    for (int i = 0; i < INITIAL_BUCKET_COUNT; i++){
-        hm->buckets[i] = NULL;
-    }
-    return hm;
-}
-
-void hashmap_put(struct HashMap* hm, struct String key, void* item) {
-    unsigned int index = hash(hm, key);
-    if (hm->buckets[index] == NULL) {
-        struct HashMapBucket* bucket = malloc(sizeof(struct HashMapBucket));
-        bucket->item = item;
-        bucket->key = key;
-        bucket->next = NULL;
-        hm->buckets[index] = bucket;
-        hm->n_items++;
-        return;
-    }
-    struct HashMapBucket* curr = hm->buckets[index];
-    while (curr) {
-        if (string_compare(curr->key, key)) {
-            curr->item = item;
-            return;
-        }
-        curr = curr->next;
-    }
-    struct HashMapBucket* bucket = malloc(sizeof(struct HashMapBucket));
-    bucket->item = item;
-    bucket->key = key;
-    bucket->next = hm->buckets[index];
-    hm->buckets[index] = bucket;
-    hm->n_items++;
-}
-
-int hashmap_contains(struct HashMap* hm, struct String key) {
-    unsigned int index = hash(hm, key);
-    struct HashMapBucket* curr = hm->buckets[index];
-    while (curr) {
-        if (string_compare(curr->key, key)) {
-            return 1;
-        }
-        curr = curr->next;
-    }
-    return 0;
-}
-
-void* hashmap_get(struct HashMap* hm, struct String key) {
-    unsigned int index = hash(hm, key);
-    struct HashMapBucket* curr = hm->buckets[index];
-    while (curr) {
-        if (string_compare(curr->key, key)) {
-            return curr->item;
-        }
-        curr = curr->next;
-    }
-    return NULL;
-}
-
-void hashmap_free(struct HashMap* hm, void (*value_free)(void*)) {
-    if (!hm) return;
-    for (int i = 0; i < hm->len_buckets; i++) {
-        struct HashMapBucket* curr = hm->buckets[i];
-        while (curr) {
-            struct HashMapBucket* to_free = curr;
-            curr = curr->next;
-            // TODO: this leaks strings, please fix
-            value_free(to_free);
-            free(to_free);
-        }
-    }
-    free(hm->buckets);
-    free(hm);
-}
+#include "flat.h"
+#include "symbol.h"
+#include "resolver.h"
+#include "slab.h"
+#include "stack.h"
+#include "gc.h"
+#include "vm.h"
+#include "cek.h"
+#include "jit.h"
 
 /*
 
@@ -98,96 +19,148 @@ ENV FUNCTIONS
 
 */
 
-void rc_init(struct Rc* rc, void (*ref_free)(void*)) {
-    rc->count = 0;
-    rc->ref_free = ref_free;
+// the creator holds the first reference
+void rc_init(struct Rc* rc) {
+    rc->count = 1;
 }
 
 void rc_use(struct Rc* rc) {
     rc->count++;
 }
 
-void rc_release(struct Rc* rc, void** obj) {
-    rc->count--;
-    if (rc->count == 0) {
-        rc->ref_free(*obj);
-        *obj = NULL;
-    }
+// true if that was the last reference
+bool rc_release(struct Rc* rc) {
+    return --rc->count == 0;
 }
 
 static void pprint_lo(struct LambObject* obj) {
     switch(obj->type) {
-        case LOBJ_NUM:
-            printf("%d", *(int*)obj->obj);
+        case LOBJ_NUM: // only ever boxed in a capture
             break;
         case LOBJ_ERR:
-            printf("error: %s\n", ((struct String*)obj->obj)->b);
+            printf("error: %s\n", LOBJ_STRING(obj)->b);
             break;
         case LOBJ_CLOSURE:
             printf("Closure");
             break;
+        case LOBJ_THUNK:
+            printf("Thunk");
+            break;
     }
 }
 
-struct Environment* env_create(struct Environment* enclosing) {
-    struct Environment* env = malloc(sizeof(struct Environment));
-    env->enclosing = enclosing;
-    env->values = hashmap_create();
-    rc_init(&env->rc, env_free);
-    if (env->enclosing) rc_use(&env->enclosing->rc);
-    return env;
+static void pprint_lv(struct LambValue v) {
+    if (LV_IS_NUM(v)) {
+        printf("%d", LV_NUM(v));
+    } else {
+        pprint_lo(LV_OBJ(v));
+    }
 }
 
-void env_put(struct Environment* env, struct String key, struct LambObject* val) {
-    rc_use(&val->rc);
-    hashmap_put(env->values, key, val);
+// reference counting only touches heap objects, and not under --gc
+void lv_use(struct Interpreter* state, struct LambValue v) {
+    if (LV_IS_NUM(v) || LV_IS_NONE(v) || state->gc) return;
+    state->n_dups++;
+    rc_use(&LV_OBJ(v)->rc);
 }
 
-static void release_lo(void *lo) {
-    struct LambObject* lobj = lo;
-    if (!lobj) return;
-    rc_release(&lobj->rc, (void**) &lobj);
+void lv_release(struct Interpreter* state, struct LambValue v) {
+    if (LV_IS_NUM(v) || LV_IS_NONE(v) || state->gc) return;
+    state->n_drops++;
+    if (rc_release(&LV_OBJ(v)->rc)) lamb_obj_free(state, LV_OBJ(v));
+}
+
+#define ENV_SIZE(n_slots) (sizeof(struct Environment) + sizeof(struct LambValue) * (n_slots))
+#define CLOSURE_SIZE(n_captured, compressed) \
+    (sizeof(struct LambClosure) + ((compressed) ? sizeof(uint32_t) : sizeof(struct LambValue)) * (n_captured))
+#define CELL_OBJ(obj, cell) ((struct LambObject*)((char*)(obj) + (intptr_t)(int32_t)(cell) * 4))
+
+// Under --gc, keeps a value held in a C local up to date across calls that
+// may collect, until unrooted; roots go in LIFO order.
+#define ROOT(state, v) do { if ((state)->gc) gc_push_root((state)->gc, &(v)); } while (0)
+#define UNROOT(state) do { if ((state)->gc) (state)->gc->n_shadow--; } while (0)
+
+struct Environment* env_create(struct Interpreter* state, struct LambObject* closure, uint32_t n_slots) {
+    struct Environment* env = stack_push(state->frames, ENV_SIZE(n_slots));
+    env->closure = closure;
+    env->n_slots = n_slots;
+    for (uint32_t i = 0; i < n_slots; i++) {
+        env->slots[i] = LV_NONE;
+    }
+    if (state->gc) gc_push_frame(state->gc, env);
+    return env;
+}
+
+// the frame takes over the caller's reference to val
+void env_put(struct Interpreter* state, struct Environment* env, uint32_t slot, struct LambValue val) {
+    lv_release(state, env->slots[slot]);
+    env->slots[slot] = val;
 }
 
 void pprint_env(struct Environment* env) {
     if (!env) return;
     if (!getenv("DEBUG")) return;
-    pprint_env(env->enclosing);
     printf("\t");
-    for (int i = 0; i < env->values->len_buckets; i++) {
-        struct HashMapBucket* curr = env->values->buckets[i];
-        while (curr) {
-            printf("(%s -> ", curr->key.b);
-            struct LambObject* lo = curr->item;
-            if (lo) {
-                lo->print(lo);
-                printf(")");
-            } else {
-                printf("NULL\n");
-            }
-            curr = curr->next;
+    for (uint32_t i = 0; i < env->n_slots; i++) {
+        struct LambValue lv = env->slots[i];
+        printf("([%u] -> ", i);
+        if (!LV_IS_NONE(lv)) {
+            pprint_lv(lv);
+            printf(")");
+        } else {
+            printf("NULL)");
         }
     }
     printf("\n");
 }
 
-void env_free(void* env) {
-    struct Environment* env_obj = env;
-    if (!env_obj) return;
-    if (env_obj->enclosing) rc_release(&env_obj->enclosing->rc, (void**) &env_obj->enclosing);
-    hashmap_free(env_obj->values, release_lo);
-    free(env_obj);
+// frames are freed in the reverse order of their creation
+void env_free(struct Interpreter* state, struct Environment* env) {
+    if (!env) return;
+    if (state->gc) gc_pop_frame(state->gc);
+    for (uint32_t i = 0; i < env->n_slots; i++) {
+        lv_release(state, env->slots[i]);
+    }
+    stack_pop(state->frames, env);
+}
+
+// capture i of a closure, borrowed; decoded from its cell under --compressed
+// (see LambClosure), a boxed number coming out as a fixnum
+static struct LambValue closure_get(struct LambObject* obj, uint32_t i) {
+    struct LambClosure* cl = LOBJ_CLOSURE(obj);
+    if (!cl->compressed) return cl->captured[i];
+    uint32_t cell = CLOSURE_CELLS(cl)[i];
+    if (!cell || (cell & 1)) return (struct LambValue) {(uintptr_t)(intptr_t)(int32_t)cell};
+    struct LambObject* target = CELL_OBJ(obj, cell);
+    if (target->type == LOBJ_NUM) return make_lamb_num(*(int*)LOBJ_DATA(target));
+    return LV_FROM_OBJ(target);
+}
+
+// borrowed; LV_NONE if the name is not bound (yet). ADDR_MOVE is ignored.
+struct LambValue env_get(struct Environment* env, uint32_t addr) {
+    switch (ADDR_KIND(addr)) {
+        case ADDR_LOCAL:
+            return env->slots[ADDR_INDEX(addr)];
+        case ADDR_CAPTURED:
+            return closure_get(env->closure, ADDR_INDEX(addr));
+        case ADDR_SELF:
+            return LV_FROM_OBJ(env->closure);
+        default:
+            return LV_NONE; // RESOLVE_UNBOUND
+    }
 }
 
-struct LambObject* env_get(struct Environment* env, struct String key) {
-    struct Environment* curr = env;
-    while (curr) {
-        if (hashmap_contains(curr->values, key)) {
-            return hashmap_get(curr->values, key);
-        }
-        curr = curr->enclosing;
+// owned: moved out of the slot on its last read (see resolver.h), else a
+// new reference
+struct LambValue env_take(struct Interpreter* state, struct Environment* env, uint32_t addr) {
+    if (ADDR_KIND(addr) == ADDR_LOCAL && (addr & ADDR_MOVE)) {
+        struct LambValue v = env->slots[ADDR_INDEX(addr)];
+        env->slots[ADDR_INDEX(addr)] = LV_NONE;
+        return v;
     }
-    return NULL;
+    struct LambValue v = env_get(env, addr);
+    lv_use(state, v);
+    return v;
 }
 
 /*
@@ -200,61 +173,91 @@ ENV FUNCTIONS
 LAMB OBJECTS START
 */
 
-struct LambObject* make_lamb_num(int num) {
-    struct LambObject* obj = malloc(sizeof(struct LambObject));
-    int* num_ptr = malloc(sizeof(int));
-    *num_ptr = num;
-    obj->type = LOBJ_NUM;
-    obj->obj = num_ptr;
-    obj->print = pprint_lo;
-    rc_init(&obj->rc, lamb_obj_free);
+struct LambValue make_lamb_num(int num) {
+    return (struct LambValue) {((uintptr_t)(intptr_t)num << 1) | 1};
+}
+
+// An object is one block, so a dying closure is reused whole by the next
+// closure of its size.
+static struct LambObject* make_object(struct Interpreter* state, enum LambObjectType type, size_t data) {
+    size_t size = sizeof(struct LambObject) + data;
+    struct LambObject* obj = state->gc ? gc_alloc(state->gc, size) : slab_alloc(state->objects, size);
+    obj->type = type;
+    rc_init(&obj->rc);
     return obj;
 }
 
-struct LambObject* make_lamb_err(struct String err) {
-    struct LambObject* obj = malloc(sizeof(struct LambObject));
-    struct String* err_ptr = malloc(sizeof(struct String));
-    *err_ptr = err;
-    obj->type = LOBJ_ERR;
-    obj->obj = err_ptr;
-    obj->print = pprint_lo;
-    rc_init(&obj->rc, lamb_obj_free);
+struct LambObject* make_lamb_err(struct Interpreter* state, struct String err) {
+    struct LambObject* obj = make_object(state, LOBJ_ERR, sizeof(struct String) + err.length + 1);
+    struct String* str = LOBJ_STRING(obj);
+    str->length = err.length;
+    str->b = (char*)(str + 1);
+    memcpy(str->b, err.b, err.length + 1);
+    string_free(&err);
     return obj;
 }
 
-struct LambObject* make_lamb_closure(struct AST* abs, struct String param, struct Environment* env) { // ast live after interpretation
-    struct LambObject* obj = malloc(sizeof(struct LambObject));
-    struct LambClosure* LC = malloc(sizeof(struct LambClosure));
-    LC->env = env;
+// the captures start out LV_NONE for the caller to fill in (closure_put)
+struct LambObject* make_lamb_closure(struct Interpreter* state, uint32_t abs, uint32_t n_captured) { // ast live after interpretation
+    struct LambObject* obj = make_object(state, LOBJ_CLOSURE, CLOSURE_SIZE(n_captured, state->compressed));
+    struct LambClosure* LC = LOBJ_CLOSURE(obj);
     LC->code = abs;
-    LC->param = param;
-    obj->type = LOBJ_CLOSURE;
-    obj->obj = LC;
-    obj->print = pprint_lo;
-    rc_use(&env->rc);
-    rc_init(&obj->rc, lamb_obj_free);
+    LC->n_captured = n_captured;
+    LC->compressed = state->compressed;
+    for (uint32_t i = 0; i < n_captured; i++) {
+        if (LC->compressed) CLOSURE_CELLS(LC)[i] = 0;
+        else LC->captured[i] = LV_NONE;
+    }
     return obj;
 }
 
-void lamb_obj_free(void* lobj_ptr) {
-    struct LambObject* lobj = lobj_ptr;
+// capture i of a closure takes over v; a fixnum over 31 bits is boxed
+// under --compressed
+static void closure_put(struct Interpreter* state, struct LambObject* obj, uint32_t i, struct LambValue v) {
+    struct LambClosure* cl = LOBJ_CLOSURE(obj);
+    if (!cl->compressed) {
+        cl->captured[i] = v;
+        return;
+    }
+    if (LV_IS_NUM(v) && (intptr_t)v.bits != (int32_t)v.bits) {
+        struct LambObject* box = make_object(state, LOBJ_NUM, sizeof(int));
+        *(int*)LOBJ_DATA(box) = LV_NUM(v);
+        v = LV_FROM_OBJ(box);
+    }
+    CLOSURE_CELLS(cl)[i] = LV_IS_NUM(v) || LV_IS_NONE(v)
+        ? (uint32_t)v.bits
+        : (uint32_t)(((char*)LV_OBJ(v) - (char*)obj) >> 2);
+}
+
+void lamb_obj_free(struct Interpreter* state, struct LambObject* lobj) {
     if (!lobj) return;
     struct LambClosure* cl;
+    size_t size = sizeof(struct LambObject);
     switch (lobj->type) {
         case LOBJ_NUM:
-            free(lobj->obj);
+            size += sizeof(int);
             break;
         case LOBJ_ERR:
-            string_free(lobj->obj);
-            free(lobj->obj);
+            size += sizeof(struct String) + LOBJ_STRING(lobj)->length + 1;
             break;
         case LOBJ_CLOSURE:
-            cl = lobj->obj;
-            rc_release(&cl->env->rc, (void**) &cl->env);
-            free(lobj->obj);
+            cl = LOBJ_CLOSURE(lobj);
+            for (uint32_t i = 0; i < cl->n_captured; i++) {
+                if (!cl->compressed) {
+                    lv_release(state, cl->captured[i]);
+                } else if (CLOSURE_CELLS(cl)[i] && !(CLOSURE_CELLS(cl)[i] & 1)) {
+                    lv_release(state, LV_FROM_OBJ(CELL_OBJ(lobj, CLOSURE_CELLS(cl)[i])));
+                }
+            }
+            size += CLOSURE_SIZE(cl->n_captured, cl->compressed);
+            break;
+        case LOBJ_THUNK:
+            if (LOBJ_THUNK(lobj)->closure) lv_release(state, LV_FROM_OBJ(LOBJ_THUNK(lobj)->closure));
+            lv_release(state, LOBJ_THUNK(lobj)->value);
+            size += sizeof(struct LambThunk);
             break;
     }
-    free(lobj_ptr);
+    slab_dealloc(state->objects, lobj, size);
 }
 
 /*
@@ -266,253 +269,310 @@ EVALUATION FUNCTIONS START
 */
 
 
-static struct LambObject* eval_abs(struct Interpreter* state, struct AST* abs, struct Environment* env);
-struct LambObject* eval_expr(struct Interpreter* state, struct AST* expr, struct Environment* env);
+// Nodes are read through these on every access rather than cached, since
+// forcing a lazy fn body appends to (and may move) the node arrays.
+
+// Every eval_* hands its result to the caller with a reference the caller
+// owns: release it, or pass it on. Under --gc, any eval_* may collect, so a
+// value held across one is rooted.
+
+static struct LambValue eval_abs(struct Interpreter* state, uint32_t abs, struct Environment* env);
+struct LambValue eval_expr(struct Interpreter* state, uint32_t expr, struct Environment* env);
+
+// The new frame takes over arg. The closure is only borrowed: the frame
+// reads its captures through it, so the caller holds on to it until this
+// returns. A fn the JIT has compiled runs its code instead, in a frame
+// with room for the code's temporaries (see jit.h).
+struct LambValue closure_call(struct Interpreter* state, struct LambValue closure, struct LambValue arg) {
+    if (LV_TYPE(closure) != LOBJ_CLOSURE) {
+        lv_release(state, arg);
+        return LV_FROM_OBJ(make_lamb_err(state, string_create("[run-time error]: tried to apply something that's not a function")));
+    }
+    struct LambClosure* cl = LOBJ_CLOSURE(LV_OBJ(closure));
+    flat_force_body(state->prog, cl->code);
+    struct JitFn* jit = state->jit ? jit_lookup(state, cl->code) : NULL;
+    uint32_t n_slots = RECORD(state, cl->code)[0] + (jit ? jit->n_temps : 0);
+    struct Environment* new_env = env_create(state, LV_OBJ(closure), n_slots);
+    env_put(state, new_env, 0, arg);
+    struct LambValue result = jit
+        ? jit->entry(state, new_env)
+        : eval_expr(state, NODE(state, cl->code).b, new_env);
+    env_free(state, new_env);
+    return result;
+}
 
-static struct LambObject* closure_call(struct Interpreter* state, struct LambObject* closure, struct LambObject* arg) {
-    if (closure->type != LOBJ_CLOSURE) {
-        return make_lamb_err(string_create("[run-time error]: tried to apply something that's not a function"));
+// v, taken over, as a value that is not a thunk, evaluating the thunk if
+// this is the first time it is needed (see LambThunk)
+static struct LambValue force(struct Interpreter* state, struct LambValue v) {
+    while (!LV_IS_NONE(v) && LV_TYPE(v) == LOBJ_THUNK) {
+        struct LambThunk* thunk = LOBJ_THUNK(LV_OBJ(v));
+        struct LambValue val;
+        if (!LV_IS_NONE(thunk->value)) {
+            val = thunk->value;
+            lv_use(state, val);
+        } else if (!thunk->closure) {
+            val = LV_FROM_OBJ(make_lamb_err(state, string_create("[run-time error] a value depends on itself")));
+        } else {
+            struct LambObject* closure = thunk->closure;
+            thunk->closure = NULL;
+            state->n_forced++;
+            val = force(state, closure_call(state, LV_FROM_OBJ(closure), LV_NONE));
+            lv_release(state, LV_FROM_OBJ(closure));
+            thunk->value = val;
+            lv_use(state, val);
+        }
+        lv_release(state, v);
+        v = val;
     }
-    struct LambClosure* cl = closure->obj;
-    rc_use(&arg->rc);
-    struct Environment* new_env = env_create(cl->env);
-    rc_use(&new_env->rc);
-    env_put(new_env, string_clone(cl->param), arg);
-    struct LambObject* result = eval_expr(state, cl->code->u.abs.body, new_env);
-    rc_release(&new_env->rc, (void**) &new_env);
-    rc_release(&arg->rc, (void**) &arg);
-    return result;
+    return v;
+}
+
+// a value needed now: a number, an if condition or an applied fn
+static struct LambValue eval_forced(struct Interpreter* state, uint32_t expr, struct Environment* env) {
+    struct LambValue v = eval_expr(state, expr, env);
+    return state->lazy ? force(state, v) : v;
+}
+
+// arg, passed to fn with more arguments after it in the same chain, forced
+// now if fn certainly forces it (see strict.h)
+static struct LambValue pass_arg(struct Interpreter* state, struct LambValue fn, struct LambValue arg, uint32_t more) {
+    if (!state->prog->strict || LV_TYPE(fn) != LOBJ_CLOSURE) return arg;
+    uint8_t need = state->prog->strict[LOBJ_CLOSURE(LV_OBJ(fn))->code];
+    return need && more + 1 >= need ? force(state, arg) : arg;
 }
 
-static struct LambObject* eval_letrec(struct Interpreter* state, struct AST* expr, struct Environment* env)  {
+static struct LambValue eval_letrec(struct Interpreter* state, uint32_t expr, struct Environment* env)  {
     if (getenv("DEBUG")) {
         printf("[eval_letrec] "); 
-        pprint_ast(expr);
+        flat_pprint(state->prog, expr);
     }
-    rc_use(&env->rc);
-    struct LambObject* fn = eval_expr(state, expr->u.letrec.fn, env);
-    struct LambClosure* fn_cl = fn->obj;
-    if (fn->type == LOBJ_ERR) {
+    // a fn refers to itself through its frame, not through a capture; any
+    // other value is forced, to be checked
+    struct LambValue fn = eval_forced(state, NODE(state, expr).b, env);
+    if (LV_TYPE(fn) == LOBJ_ERR) {
         return fn;
     } 
-    rc_use(&fn->rc);
-    if (fn->type != LOBJ_CLOSURE) {
-        rc_release(&fn->rc, (void**) &fn);
-        return make_lamb_err(string_create("[type error] Expected a function to be recursively defined in letrec expression"));
-    }
-    env_put(fn_cl->env, string_clone(expr->u.letrec.id), fn);
-    env_put(env, string_clone(expr->u.letrec.id), fn);
-    struct LambObject* result = eval_expr(state, expr->u.letrec.expr, env);
-    rc_release(&fn->rc, (void**) &fn);
-    rc_release(&env->rc, (void**) &env);
-    return result;
+    if (LV_TYPE(fn) != LOBJ_CLOSURE) {
+        lv_release(state, fn);
+        return LV_FROM_OBJ(make_lamb_err(state, string_create("[type error] Expected a function to be recursively defined in letrec expression")));
+    }
+    env_put(state, env, NODE(state, expr).slot, fn);
+    return eval_expr(state, NODE(state, expr).c, env);
+}
+
+// the fn of an application: read without a reference if *borrowed, which
+// is cleared if the name turns out not to be bound
+static struct LambValue eval_fn(struct Interpreter* state, uint32_t expr, struct Environment* env, bool* borrowed) {
+    if (*borrowed) {
+        state->n_steps++; // as if evaluated
+        struct LambValue fn = env_get(env, NODE(state, NODE(state, expr).a).b);
+        if (!LV_IS_NONE(fn) && !(state->lazy && LV_TYPE(fn) == LOBJ_THUNK)) return fn;
+        *borrowed = false;
+    }
+    return eval_forced(state, NODE(state, expr).a, env);
 }
 
-static struct LambObject* eval_app(struct Interpreter* state, struct AST* expr, struct Environment* env) {
-    // TODO: Fix quite severe memory leak (reference counting problem).
-    // Otherwise,LGTM
+static struct LambValue eval_app(struct Interpreter* state, uint32_t expr, struct Environment* env) {
     if (getenv("DEBUG")) {
         printf("[eval_app] "); 
-        pprint_ast(expr);
+        flat_pprint(state->prog, expr);
     } 
-    rc_use(&env->rc);
-    if (!expr->u.app.alist) {
-        rc_release(&env->rc, (void**) &env);
-        return eval_expr(state, expr->u.app.fn, env);
-    } else if (!expr->u.app.alist->u.app_list.next) { //single argument
-        struct Environment* new_env = env_create(env);
-        rc_release(&env->rc, (void**) &env);
-        rc_use(&new_env->rc);
-        struct LambObject* arg = eval_expr(state, expr->u.app.alist->u.app_list.arg, new_env);
-        if (arg->type == LOBJ_ERR) {
-            rc_release(&new_env->rc, (void**) &new_env);
+    uint32_t n_args = NODE(state, expr).c;
+    // a fn that is a name is only borrowed for the first call (see resolver.h)
+    bool borrowed = NODE(state, expr).slot & APP_BORROW;
+    if (!n_args) {
+        return eval_expr(state, NODE(state, expr).a, env);
+    } else if (n_args == 1) { //single argument
+        struct LambValue arg = eval_expr(state, ARG(state, NODE(state, expr).b), env);
+        if (LV_TYPE(arg) == LOBJ_ERR) {
             return arg;
         }
-        rc_use(&arg->rc);
-        struct LambObject* cl_obj = eval_expr(state, expr->u.app.fn, new_env);
-        if (cl_obj->type == LOBJ_ERR) {
-            rc_release(&arg->rc, (void**) &arg);
-            rc_release(&new_env->rc, (void**) &new_env);
+        ROOT(state, arg);
+        struct LambValue cl_obj = eval_fn(state, expr, env, &borrowed);
+        UNROOT(state);
+        if (LV_TYPE(cl_obj) == LOBJ_ERR) {
+            lv_release(state, arg);
             return cl_obj;
         }
-        rc_use(&cl_obj->rc);
-        struct LambObject* result = closure_call(state, cl_obj, arg);
-        rc_release(&cl_obj->rc, (void**) &cl_obj);
-        rc_release(&arg->rc, (void**) &arg);
-        rc_release(&new_env->rc, (void**) &new_env);
+        if (state->lazy) arg = pass_arg(state, cl_obj, arg, 0);
+        struct LambValue result = closure_call(state, cl_obj, arg);
+        if (!borrowed) lv_release(state, cl_obj);
         return result;
     }
-    struct AST* alist = expr->u.app.alist;
-    struct Environment* new_env = env_create(env);
-    rc_release(&env->rc, (void**) &env);
-    struct LambObject* cl_obj = eval_expr(state, expr->u.app.fn, env);
-    if (cl_obj->type == LOBJ_ERR) {
-        rc_use(&new_env->rc);
-        rc_release(&new_env->rc, (void**) &new_env);
+    uint32_t alist = NODE(state, expr).b, alist_end = alist + n_args;
+    struct LambValue cl_obj = eval_fn(state, expr, env, &borrowed);
+    if (LV_TYPE(cl_obj) == LOBJ_ERR) {
         return cl_obj;
     } 
     for (;;) {
-        rc_use(&new_env->rc);
-        if (cl_obj->type != LOBJ_CLOSURE) {
-            rc_release(&new_env->rc, (void**) &new_env);
-            return make_lamb_err(string_create("[type error] Expected a function to be applied"));
+        if (LV_TYPE(cl_obj) != LOBJ_CLOSURE) {
+            if (!borrowed) lv_release(state, cl_obj);
+            return LV_FROM_OBJ(make_lamb_err(state, string_create("[type error] Expected a function to be applied")));
         }
-        struct LambObject* arg_obj = eval_expr(state, alist->u.app_list.arg, new_env);
-        if (arg_obj->type == LOBJ_ERR) {
-            rc_release(&new_env->rc, (void**) &new_env);
+        ROOT(state, cl_obj);
+        struct LambValue arg_obj = eval_expr(state, ARG(state, alist), env);
+        UNROOT(state);
+        if (LV_TYPE(arg_obj) == LOBJ_ERR) {
+            if (!borrowed) lv_release(state, cl_obj);
             return arg_obj;
         }
-        rc_use(&arg_obj->rc);
-        rc_use(&cl_obj->rc);
-        struct LambObject* result = closure_call(state, cl_obj, arg_obj);
-        rc_release(&arg_obj->rc, (void**) &arg_obj);
-        rc_release(&cl_obj->rc, (void**) &cl_obj);
-        if (result->type == LOBJ_ERR) {
-            rc_release(&new_env->rc, (void**) &new_env);
+        if (state->lazy) arg_obj = pass_arg(state, cl_obj, arg_obj, alist_end - alist - 1);
+        struct LambValue result = closure_call(state, cl_obj, arg_obj);
+        if (!borrowed) lv_release(state, cl_obj);
+        borrowed = false;
+        alist++;
+        if (alist == alist_end) return result;
+        if (state->lazy) result = force(state, result);
+        if (LV_TYPE(result) == LOBJ_ERR) {
             return result;
         }
         cl_obj = result;
-        alist = alist->u.app_list.next;
-        struct Environment* old_env = new_env;
-        new_env = env_create(old_env);
-        rc_release(&old_env->rc, (void**) &old_env);
-        if (!alist) break;
     }
-    rc_release(&new_env->rc, (void**)&new_env);
-    return cl_obj;
 }
 
-static struct LambObject* eval_abs(struct Interpreter* state, struct AST* abs, struct Environment* env) {
+// a closure of abs, copying the values of its free names out of env
+struct LambObject* close_over(struct Interpreter* state, uint32_t abs, struct Environment* env) {
+    const uint32_t* record = RECORD(state, abs);
+    struct LambObject* closure = make_lamb_closure(state, abs, record[1]);
+    for (uint32_t i = 0; i < record[1]; i++) {
+        closure_put(state, closure, i, env_take(state, env, record[2 + i]));
+    }
+    return closure;
+}
+
+// +x, -x, pos x or neg x of a name that holds a number already costs less
+// than its thunk, and keeps a loop such as add(+x)(-y) from building a
+// chain of them
+static struct LambValue eval_delay(struct Interpreter* state, uint32_t abs, struct Environment* env) {
+    struct FlatNode body = NODE(state, NODE(state, abs).b);
+    if ((body.tag == AST_SUCC || body.tag == AST_DEC || body.tag == AST_POS || body.tag == AST_NEG)
+            && NODE(state, body.a).tag == AST_IDENTIFIER && ADDR_KIND(NODE(state, body.a).b) == ADDR_CAPTURED) {
+        struct LambValue x = env_get(env, RECORD(state, abs)[2 + ADDR_INDEX(NODE(state, body.a).b)]);
+        if (LV_IS_NUM(x)) {
+            int n = LV_NUM(x);
+            return make_lamb_num(body.tag == AST_SUCC ? NUM_SUCC(n) : body.tag == AST_DEC ? NUM_DEC(n)
+                               : body.tag == AST_POS ? n > 0 : n < 0);
+        }
+    }
+    struct LambObject* closure = close_over(state, abs, env);
+    struct LambObject* thunk = make_object(state, LOBJ_THUNK, sizeof(struct LambThunk));
+    LOBJ_THUNK(thunk)->closure = closure;
+    LOBJ_THUNK(thunk)->value = LV_NONE;
+    state->n_thunks++;
+    return LV_FROM_OBJ(thunk);
+}
+
+static struct LambValue eval_abs(struct Interpreter* state, uint32_t abs, struct Environment* env) {
     if (getenv("DEBUG")) {
         printf("[eval_abs] "); 
-        pprint_ast(abs);
+        flat_pprint(state->prog, abs);
     }
-    if (abs->tag != AST_ABS) {
-        return make_lamb_err(string_create("[run-time error] expected a function expression."));
+    if (NODE(state, abs).tag != AST_ABS) {
+        return LV_FROM_OBJ(make_lamb_err(state, string_create("[run-time error] expected a function expression.")));
     }
-    rc_use(&env->rc);
-    struct Environment* new_env = env_create(env);
-    struct LambObject* closure = make_lamb_closure(abs, abs->u.abs.id->u.identifier.name, new_env);
-    rc_release(&env->rc, (void**) &env);
-    return closure;
+    if (NODE(state, abs).slot & ABS_THUNK) return eval_delay(state, abs, env);
+    return LV_FROM_OBJ(close_over(state, abs, env));
 }
 
-static struct LambObject* eval_num(struct Interpreter* state, struct AST* num, struct Environment* env) {
+static struct LambValue eval_num(struct Interpreter* state, uint32_t num, struct Environment* env) {
     if (getenv("DEBUG")) {
         printf("[eval_num] "); 
-        pprint_ast(num);
+        flat_pprint(state->prog, num);
     }
-    return make_lamb_num(num->u.num.value);
+    return make_lamb_num((int)NODE(state, num).a);
 }
 
-static struct LambObject* eval_succ(struct Interpreter* state, struct AST* succ, struct Environment* env) {
+static struct LambValue eval_succ(struct Interpreter* state, uint32_t succ, struct Environment* env) {
     if (getenv("DEBUG")) {
         printf("[eval_succ] "); 
-        pprint_ast(succ);
+        flat_pprint(state->prog, succ);
     }
-    struct LambObject* succ_num = eval_expr(state, succ->u.succ.arg, env);
-    rc_use(&succ_num->rc);
-    if (succ_num->type == LOBJ_NUM) {
-        int n = *(int*)succ_num->obj;
-        rc_release(&succ_num->rc, (void**) &succ_num);
-        return make_lamb_num(n+1);
+    struct LambValue succ_num = eval_forced(state, NODE(state, succ).a, env);
+    if (LV_IS_NUM(succ_num)) {
+        return make_lamb_num(NUM_SUCC(LV_NUM(succ_num)));
     }
-    rc_release(&succ_num->rc, (void**) &succ_num);
-    return make_lamb_err(string_create("[type error] + applied to a non-Num argument."));
+    lv_release(state, succ_num);
+    return LV_FROM_OBJ(make_lamb_err(state, string_create("[type error] + applied to a non-Num argument.")));
 }
 
-static struct LambObject* eval_is_pos(struct Interpreter* state, struct AST* succ, struct Environment* env) {
+static struct LambValue eval_is_pos(struct Interpreter* state, uint32_t succ, struct Environment* env) {
     if (getenv("DEBUG")) {
         printf("[eval_is_pos] "); 
-        pprint_ast(succ);
+        flat_pprint(state->prog, succ);
     }
-    struct LambObject* succ_num = eval_expr(state, succ->u.succ.arg, env);
-    rc_use(&succ_num->rc);
-    if (succ_num->type == LOBJ_NUM) {
-        int n = *(int*)succ_num->obj;
-        rc_release(&succ_num->rc, (void**) &succ_num);
-        return make_lamb_num(n>0);
+    struct LambValue succ_num = eval_forced(state, NODE(state, succ).a, env);
+    if (LV_IS_NUM(succ_num)) {
+        return make_lamb_num(LV_NUM(succ_num) > 0);
     }
-    rc_release(&succ_num->rc, (void**) &succ_num);
-    return make_lamb_err(string_create("[type error] + applied to a non-Num argument."));
+    lv_release(state, succ_num);
+    return LV_FROM_OBJ(make_lamb_err(state, string_create("[type error] + applied to a non-Num argument.")));
 }
 
-static struct LambObject* eval_is_neg(struct Interpreter* state, struct AST* succ, struct Environment* env) {
+static struct LambValue eval_is_neg(struct Interpreter* state, uint32_t succ, struct Environment* env) {
     if (getenv("DEBUG")) {
         printf("[eval_is_neg] "); 
-        pprint_ast(succ);
+        flat_pprint(state->prog, succ);
     }
-    struct LambObject* succ_num = eval_expr(state, succ->u.succ.arg, env);
-    rc_use(&succ_num->rc);
-    if (succ_num->type == LOBJ_NUM) {
-        int n = *(int*)succ_num->obj;
-        rc_release(&succ_num->rc, (void**) &succ_num);
-        return make_lamb_num(n<0);
+    struct LambValue succ_num = eval_forced(state, NODE(state, succ).a, env);
+    if (LV_IS_NUM(succ_num)) {
+        return make_lamb_num(LV_NUM(succ_num) < 0);
     }
-    rc_release(&succ_num->rc, (void**) &succ_num);
-    return make_lamb_err(string_create("[type error] + applied to a non-Num argument."));
+    lv_release(state, succ_num);
+    return LV_FROM_OBJ(make_lamb_err(state, string_create("[type error] + applied to a non-Num argument.")));
 }
 
-static struct LambObject* eval_dec(struct Interpreter* state, struct AST* succ, struct Environment* env) {
+static struct LambValue eval_dec(struct Interpreter* state, uint32_t succ, struct Environment* env) {
     if (getenv("DEBUG")) {
         printf("[eval_dec] "); 
-        pprint_ast(succ);
+        flat_pprint(state->prog, succ);
     }
-    struct LambObject* dec_num = eval_expr(state, succ->u.succ.arg, env);
-    rc_use(&dec_num->rc);
-    if (dec_num->type == LOBJ_NUM) {
-        int n = *(int*)dec_num->obj;
-        rc_release(&dec_num->rc, (void**) &dec_num);
-        return make_lamb_num(n-1);
+    struct LambValue dec_num = eval_forced(state, NODE(state, succ).a, env);
+    if (LV_IS_NUM(dec_num)) {
+        return make_lamb_num(NUM_DEC(LV_NUM(dec_num)));
     }
-    rc_release(&dec_num->rc, (void**) &dec_num);
-    return make_lamb_err(string_create("[type error] - applied to a non-Num argument."));
+    lv_release(state, dec_num);
+    return LV_FROM_OBJ(make_lamb_err(state, string_create("[type error] - applied to a non-Num argument.")));
 }
 
-static struct LambObject* eval_let(struct Interpreter* state, struct AST* expr, struct Environment* env) {
-    // let x = y in z === (fn x z)(y)
+static struct LambValue eval_let(struct Interpreter* state, uint32_t expr, struct Environment* env) {
+    // let x = y in z === (fn x z)(y), but x gets a slot in the current frame
     if (getenv("DEBUG")) {
         printf("[eval_let] "); 
-        pprint_ast(expr);
+        flat_pprint(state->prog, expr);
     }
-    rc_use(&env->rc);
-    struct LambObject* val = eval_expr(state, expr->u.binding.value, env);
-    if (val->type == LOBJ_ERR) {
-        rc_release(&env->rc, (void**) &env);
+    struct LambValue val = eval_expr(state, NODE(state, expr).b, env);
+    if (LV_TYPE(val) == LOBJ_ERR) {
         return val;
     }
-    rc_use(&val->rc);
-    struct Environment* new_env = env_create(env);
-    env_put(new_env, string_clone(expr->u.binding.id), val);
-    rc_release(&val->rc, (void**) &val);
-    rc_release(&env->rc, (void**) &env);
-    return eval_expr(state, expr->u.binding.expr, new_env);
+    env_put(state, env, NODE(state, expr).slot, val);
+    return eval_expr(state, NODE(state, expr).c, env);
 }
 
-static struct LambObject* eval_if_else(struct Interpreter* state, struct AST* expr, struct Environment* env) {
+static struct LambValue eval_if_else(struct Interpreter* state, uint32_t expr, struct Environment* env) {
     if (getenv("DEBUG")) {
         printf("[eval_if_else] "); 
-        pprint_ast(expr);
+        flat_pprint(state->prog, expr);
     }    
-    struct LambObject* cond = eval_expr(state, expr->u.if_else.cond, env);
-    rc_use(&cond->rc);
-    if (cond->type == LOBJ_ERR) { 
+    struct LambValue cond = eval_forced(state, NODE(state, expr).a, env);
+    if (LV_TYPE(cond) == LOBJ_ERR) { 
         return cond;
-    } else if (cond->type != LOBJ_NUM) {
-        return make_lamb_err(string_create("[type error] - tried to use a non-Num condition in if-else expression."));
+    } else if (LV_TYPE(cond) != LOBJ_NUM) {
+        lv_release(state, cond);
+        return LV_FROM_OBJ(make_lamb_err(state, string_create("[type error] - tried to use a non-Num condition in if-else expression.")));
     }
-    if (*(int*)cond->obj) {
-        rc_release(&cond->rc, (void**)&cond);
-        return eval_expr(state, expr->u.if_else.then_branch, env);
+    if (LV_NUM(cond)) {
+        lv_release(state, cond);
+        return eval_expr(state, NODE(state, expr).b, env);
     }
-    rc_release(&cond->rc, (void**)&cond);
-    return eval_expr(state, expr->u.if_else.else_branch, env);
+    lv_release(state, cond);
+    return eval_expr(state, NODE(state, expr).c, env);
 }
 
-struct LambObject* eval_expr(struct Interpreter* state, struct AST* expr, struct Environment* env) {
+struct LambValue eval_expr(struct Interpreter* state, uint32_t expr, struct Environment* env) {
+    state->n_steps++;
     pprint_env(env);
-    switch (expr->tag) { //function table?
-        struct LambObject* lo;
+    switch (NODE(state, expr).tag) { //function table?
+        struct LambValue lv;
         case AST_APP:
             return eval_app(state, expr, env);
         case AST_NUM:
@@ -528,9 +588,12 @@ struct LambObject* eval_expr(struct Interpreter* state, struct AST* expr, struct
         case AST_ABS:
             return eval_abs(state, expr, env);
         case AST_IDENTIFIER:
-            lo = env_get(env, expr->u.identifier.name);
-            if (lo) return lo;
-            return make_lamb_err(string_concat(string_create("[run-time error] attempted to use an undefined name: "), string_clone(expr->u.identifier.name)));
+            // empty only where a letrec value reads its name (see resolver.h)
+            lv = env_take(state, env, NODE(state, expr).b);
+            if (!LV_IS_NONE(lv)) {
+                return lv;
+            }
+            return LV_FROM_OBJ(make_lamb_err(state, string_concat(string_create("[run-time error] attempted to use an undefined name: "), string_clone(symbol_name(NODE(state, expr).a)))));
         case AST_LET_IN:
             return eval_let(state, expr, env);
         case AST_IF_ELSE:
@@ -538,8 +601,8 @@ struct LambObject* eval_expr(struct Interpreter* state, struct AST* expr, struct
         case AST_LETREC:
             return eval_letrec(state, expr, env);
         case AST_ERR:
-            printf("%s\n", expr->u.err.error_message.b);
-            return NULL;
+            printf("%s\n", flat_string(state->prog, NODE(state, expr).a).b);
+            return LV_NONE;
         default:
             assert(0);
     }
@@ -549,13 +612,14 @@ struct LambObject* eval_expr(struct Interpreter* state, struct AST* expr, struct
 EVALUATION FUNCTIONS END
 */
 
-void interpret(struct Interpreter* state, struct AST* program) {
-    if (program->tag != AST_ERR) { 
+void interpret(struct Interpreter* state) {
+    uint32_t program = state->prog->root;
+    if (NODE(state, program).tag != AST_ERR) { 
         printf("program repr:\n"); 
-        pprint_ast(program);
+        flat_pprint(state->prog, program);
     }
     else {
-        printf("%s\n", program->u.err.error_message.b);
+        printf("%s\n", flat_string(state->prog, NODE(state, program).a).b);
         exit(1);
     }
     if (!getenv("DEBUG")) {
@@ -563,27 +627,62 @@ void interpret(struct Interpreter* state, struct AST* program) {
     } else {
         printf("DEBUG env set; skipping debug and stack frame logging.\n");
     }    
-    struct Environment *global = env_create(NULL);
-    rc_use(&global->rc);
-    struct LambObject* val = eval_expr(state, program, global);
-    if (!val) {
-        rc_release(&global->rc, (void**) &global);
+    if (!state->objects) {
+        // compressed handles are offsets within one reserved region
+        state->objects = state->compressed
+            ? slab_create_reserved("objs", LAMB_COMPRESSED_HEAP)
+            : slab_create("objs");
+        state->frames = stack_create("frames");
+    }
+    if (state->use_gc && !state->gc) {
+        state->gc = gc_create(state->gc_config);
+    }
+    // compiled code prints no trace, forces no thunk, and the VM and CEK
+    // machine make no calls through closure_call
+    if (state->use_jit && !state->jit && !getenv("DEBUG") && !state->use_vm && !state->use_cek && !state->lazy) {
+        state->jit = jit_create(state->jit_threshold);
+    }
+    struct Environment *global = NULL;
+    struct LambValue val;
+    if (state->use_vm) {
+        val = vm_run(state);
+    } else {
+        global = env_create(state, NULL, state->prog->root_slots);
+        val = state->use_cek ? cek_eval(state, program, global) : eval_forced(state, program, global);
+    }
+    if (LV_IS_NONE(val)) {
+        env_free(state, global);
         return;
     }
-    rc_use(&val->rc);
     printf("> ");
-    switch (val->type) {
+    switch (LV_TYPE(val)) {
         case LOBJ_NUM:
-            printf("%d\n", *(int*)val->obj);
+            printf("%d\n", LV_NUM(val));
             break;
         case LOBJ_ERR:
-            printf("%s\n", (*(struct String*)val->obj).b);
+            printf("%s\n", LOBJ_STRING(LV_OBJ(val))->b);
             break;
         case LOBJ_CLOSURE:
             printf("Closure (pretty printed): ");
-            pprint_ast(((struct LambClosure*)val->obj)->code);
+            flat_force_all(state->prog, LOBJ_CLOSURE(LV_OBJ(val))->code);
+            flat_pprint(state->prog, LOBJ_CLOSURE(LV_OBJ(val))->code);
             break;
     }
-    rc_release(&val->rc, (void**) &val);
-    rc_release(&global->rc, (void**) &global);
-}
\ No newline at end of file
+    lv_release(state, val);
+    env_free(state, global);
+}
+
+void interpreter_free(struct Interpreter* state) {
+    slab_free(state->objects);
+    stack_free(state->frames);
+    gc_free(state->gc);
+    vm_free(state->vm);
+    stack_free(state->conts);
+    jit_free(state->jit);
+    state->objects = NULL;
+    state->jit = NULL;
+    state->conts = NULL;
+    state->vm = NULL;
+    state->frames = NULL;
+    state->gc = NULL;
+}
@@ -1,75 +1,164 @@
 #ifndef LAMB_INTERPRETER_H
 #define LAMB_INTERPRETER_H
+#include <stdbool.h>
+#include <stdint.h>
 #include "ast.h"
 #include "stringt.h"
+#include "gc.h"
 
+// unused under --gc, but for marking moved objects (see gc.c)
 struct Rc {
     int count;
-    void (*ref_free)(void*);
-};
-
-struct HashMapBucket {
-    void *item;
-    struct String key;
-    void *next;
-};
-
-struct HashMap {
-    struct HashMapBucket** buckets;
-    int len_buckets;
-    int n_items;
 };
 
 enum LambObjectType {
     LOBJ_ERR,
     LOBJ_NUM,
-    LOBJ_CLOSURE
+    LOBJ_CLOSURE,
+    LOBJ_THUNK
 };
 
+// A heap object: a closure, an error, a number boxed for a compressed
+// capture (see LambClosure), or a thunk. What it is follows this header in
+// the same block: a LambClosure, a struct String and its chars, an int, or
+// a LambThunk.
 struct LambObject {
-    enum LambObjectType type;
-    void *obj;
+    uint32_t type; // enum LambObjectType
     struct Rc rc;
-    void (*print)(struct LambObject* lo);
 };
 
+#define LOBJ_DATA(o) ((void*)((o) + 1))
+#define LOBJ_CLOSURE(o) ((struct LambClosure*)LOBJ_DATA(o))
+#define LOBJ_STRING(o) ((struct String*)LOBJ_DATA(o))
+#define LOBJ_THUNK(o) ((struct LambThunk*)LOBJ_DATA(o))
+
+// A value is one word: a fixnum held in the word itself, with the low bit
+// set, or a pointer to a LambObject. Fixnums are never allocated or counted.
+// The zero word is no value, as in a slot that is not bound yet.
+struct LambValue {
+    uintptr_t bits;
+};
+
+#define LV_NONE ((struct LambValue) {0})
+#define LV_IS_NONE(v) (!(v).bits)
+#define LV_IS_NUM(v) ((v).bits & 1)
+#define LV_NUM(v) ((int)((intptr_t)(v).bits >> 1))
+// n + 1 and n - 1, wrapping around at the ends of int as the JIT's add and
+// sub do, rather than overflowing
+#define NUM_SUCC(n) ((int)((uint32_t)(n) + 1))
+#define NUM_DEC(n) ((int)((uint32_t)(n) - 1))
+#define LV_OBJ(v) ((struct LambObject*)(v).bits)
+#define LV_FROM_OBJ(o) ((struct LambValue) {(uintptr_t)(o)})
+#define LV_TYPE(v) (LV_IS_NUM(v) ? LOBJ_NUM : LV_OBJ(v)->type)
+
+// A flat closure: the values of the fn's free names, in the order of its
+// closure record (see resolver.h).
+//
+// Under --compressed each capture is a 32-bit cell rather than a value. A
+// cell with the low bit set is a fixnum of 31 bits; any other fixnum is
+// boxed in a LOBJ_NUM the closure owns. Otherwise a nonzero cell is the
+// offset of the object from the closure's LambObject, in 4-byte units,
+// which reaches any object within 8 GB: all of them, as they then share
+// one reserved region (see slab.h).
 struct LambClosure {
-    struct Environment* env;
-    struct String param;
-    struct AST* code;
+    uint32_t code; // AST_ABS node in the interpreter's FlatProgram
+    uint32_t n_captured : 31;
+    uint32_t compressed : 1;
+    struct LambValue captured[];
 };
 
-void rc_init(struct Rc* rc, void (*ref_free)(void*));
+#define CLOSURE_CELLS(cl) ((uint32_t*)(cl)->captured)
+// the reserved region of the objects under --compressed: reserved, not
+// committed, and well within the reach of a cell
+#define LAMB_COMPRESSED_HEAP ((size_t)4 << 30)
+
+// Under call by need (lazy), an argument or let value not evaluated yet:
+// the closure of its ABS_THUNK fn (see flat_delay), called the first time
+// the value is needed, after which the thunk keeps the value instead. While
+// that call runs the thunk has neither, and needing it then is a value
+// that depends on itself (a black hole), an error. A thunk is never the
+// value of a number, if condition or applied fn, which force it, nor an
+// argument its fn is known to force (see strict.h); any other value may be
+// one.
+struct LambThunk {
+    struct LambObject* closure;
+    struct LambValue value;
+};
+
+void rc_init(struct Rc* rc);
 void rc_use(struct Rc* rc);
-void rc_release(struct Rc* rc, void** obj);
+bool rc_release(struct Rc* rc);
 
+// one frame per fn call, plus one for the top level; sized and addressed by
+// the resolver (see resolver.h). A frame is never captured, closures
+// copying the values they need, so it dies when its call returns: frames
+// live on a stack (see stack.h).
 struct Environment {
-    struct Rc rc;
-    struct Environment* enclosing;
-    struct HashMap* values;
+    struct LambObject* closure; // being called; NULL at the top level
+    uint32_t n_slots;
+    struct LambValue slots[];
 };
 
+struct FlatProgram;
+
+struct Slab;
+struct Stack;
+
+// The heap objects of a run come from the interpreter's slab (see slab.h)
+// and its frames from its stack, made by interpret() and kept, with their
+// statistics, until interpreter_free. With use_gc set, heap objects come
+// from a collector made with gc_config instead (see gc.h), and are not
+// counted. With use_vm set, the program runs as bytecode (see vm.h); with
+// use_cek, on a machine with its own stack of continuations (see cek.h).
+// With use_jit set, the tree walker compiles the fns it calls most to
+// machine code where it can (see jit.h). With lazy set, it passes arguments
+// and binds let values as thunks (see LambThunk), in a program run through
+// flat_delay and strict_analyse; not with use_gc, whose heap never points to a younger object.
+struct Vm;
+struct Jit;
+
 struct Interpreter {
-    void *empty;
+    struct FlatProgram* prog;
+    struct Slab* objects;  // LambObject and what follows it
+    struct Stack* frames;  // Environment
+    bool compressed; // closures hold 32-bit cells; not with use_gc
+    bool use_gc;
+    struct GcConfig gc_config;
+    struct Gc* gc;
+    bool use_vm;
+    struct Vm* vm;
+    bool use_cek;
+    struct Stack* conts; // continuation records of use_cek
+    bool use_jit;
+    uint32_t jit_threshold; // calls of a fn before it is compiled
+    struct Jit* jit;
+    bool lazy;
+    // statistics: eval steps, and references taken and dropped
+    size_t n_steps, n_dups, n_drops;
+    size_t n_thunks, n_forced; // made, and evaluated when needed
 };
 
-void hashmap_put(struct HashMap* hm, struct String key, void* item);
-int hashmap_contains(struct HashMap* hm, struct String key);
-void* hashmap_get(struct HashMap* hm, struct String key);
-struct HashMap* hashmap_create();
-void hashmap_free(struct HashMap* hm, void (*value_free)(void*));
+struct LambValue make_lamb_num(int num);
+struct LambObject* make_lamb_err(struct Interpreter* state, struct String err);
+struct LambObject* make_lamb_closure(struct Interpreter* state, uint32_t abs, uint32_t n_captured);
+void lamb_obj_free(struct Interpreter* state, struct LambObject* lobj);
+struct LambObject* close_over(struct Interpreter* state, uint32_t abs, struct Environment* env);
+void lv_use(struct Interpreter* state, struct LambValue v);
+void lv_release(struct Interpreter* state, struct LambValue v);
 
-struct LambObject* make_lamb_num(int num);
-struct LambObject* make_lamb_err(struct String err);
-struct LambObject* make_lamb_closure(struct AST* abs, struct String param, struct Environment* env);
-void lamb_obj_free(void* lobj_ptr);
+struct Environment* env_create(struct Interpreter* state, struct LambObject* closure, uint32_t n_slots);
+struct LambValue env_get(struct Environment* env, uint32_t addr);
+struct LambValue env_take(struct Interpreter* state, struct Environment* env, uint32_t addr);
+void env_put(struct Interpreter* state, struct Environment* env, uint32_t slot, struct LambValue val);
+void env_free(struct Interpreter* state, struct Environment* env);
+void pprint_env(struct Environment* env);
 
-struct Environment* env_create(struct Environment* enclosing);
-struct LambObject* env_get(struct Environment* env, struct String key);
-void env_put(struct Environment* env, struct String key, struct LambObject* val);
-void env_free(void* env);
-void env_pprint(struct Environment *env);
+// the caller owns the result
+struct LambValue eval_expr(struct Interpreter* state, uint32_t expr, struct Environment* env);
+// applies closure, borrowed, to arg, taken over; the caller owns the result
+struct LambValue closure_call(struct Interpreter* state, struct LambValue closure, struct LambValue arg);
 
-void interpret(struct Interpreter* state, struct AST* program);
+void interpret(struct Interpreter* state);
+void interpreter_free(struct Interpreter* state);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,638 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#include "interpreter.h"
+#include "flat.h"
+#include "resolver.h"
+#include "symbol.h"
+
+static void* jit_realloc(void* p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        fprintf(stderr, "lamb: err: out of memory (jit).\n");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+RUNTIME
+*/
+
+// What the templates call when a guard fails, or for what they do not
+// inline. Each does what the tree walker does in the same place.
+
+static struct LambValue jit_error(struct Interpreter* state, struct String message) {
+    return LV_FROM_OBJ(make_lamb_err(state, message));
+}
+
+// a name that is not a local, or not bound
+static struct LambValue jit_name(struct Interpreter* state, struct Environment* env, uint32_t expr) {
+    struct LambValue v = env_take(state, env, NODE(state, expr).b);
+    if (!LV_IS_NONE(v)) return v;
+    return jit_error(state, string_concat(string_create("[run-time error] attempted to use an undefined name: "),
+                                          string_clone(symbol_name(NODE(state, expr).a))));
+}
+
+// +, -, pos or neg of something other than a number
+static struct LambValue jit_unary(struct Interpreter* state, struct LambValue v, uint32_t tag) {
+    lv_release(state, v);
+    return jit_error(state, string_create(tag == AST_DEC
+        ? "[type error] - applied to a non-Num argument."
+        : "[type error] + applied to a non-Num argument."));
+}
+
+static struct LambValue jit_cond(struct Interpreter* state, struct LambValue cond) {
+    lv_release(state, cond);
+    return jit_error(state, string_create("[type error] - tried to use a non-Num condition in if-else expression."));
+}
+
+static struct LambValue jit_letrec(struct Interpreter* state, struct LambValue fn) {
+    lv_release(state, fn);
+    return jit_error(state, string_create("[type error] Expected a function to be recursively defined in letrec expression"));
+}
+
+static struct LambValue jit_not_fn(struct Interpreter* state, struct LambValue fn) {
+    lv_release(state, fn);
+    return jit_error(state, string_create("[type error] Expected a function to be applied"));
+}
+
+// releases and empties n slots of env from first, passing v through
+static struct LambValue jit_clear(struct Interpreter* state, struct Environment* env, uint32_t first, uint32_t n, struct LambValue v) {
+    for (uint32_t i = first; i < first + n; i++) {
+        lv_release(state, env->slots[i]);
+        env->slots[i] = LV_NONE;
+    }
+    return v;
+}
+
+static struct LambValue jit_call(struct Interpreter* state, struct LambValue fn, struct LambValue arg) {
+    struct LambValue result = closure_call(state, fn, arg);
+    lv_release(state, fn);
+    return result;
+}
+
+// the fn of app is a name, borrowed (see resolver.h), and its slot kept
+// live over the arguments, so it is read again here rather than held
+static struct LambValue jit_call_name(struct Interpreter* state, struct Environment* env, uint32_t app, struct LambValue arg) {
+    uint32_t fn = NODE(state, app).a;
+    struct LambValue closure = env_get(env, NODE(state, fn).b);
+    if (LV_IS_NONE(closure)) {
+        lv_release(state, arg);
+        return jit_name(state, env, fn);
+    }
+    return closure_call(state, closure, arg);
+}
+
+// LV_NONE if the borrowed fn of a chain is one
+static struct LambValue jit_check_name(struct Interpreter* state, struct Environment* env, uint32_t app) {
+    uint32_t fn = NODE(state, app).a;
+    struct LambValue closure = env_get(env, NODE(state, fn).b);
+    if (LV_IS_NONE(closure)) return jit_name(state, env, fn);
+    if (LV_TYPE(closure) != LOBJ_CLOSURE) {
+        return jit_error(state, string_create("[type error] Expected a function to be applied"));
+    }
+    return LV_NONE;
+}
+
+/*
+COMPILER
+*/
+
+// While compiled code runs, rbx holds the interpreter and r12 the frame;
+// each template leaves its value, owned, in rax. An error skips what is
+// left up to the +, -, pos or neg whose operand it is in, which makes an
+// error of its own, or else is returned from the fn. Temporaries taken
+// since that +, -, pos or neg are released on the way; a frame's are
+// released with the frame.
+
+struct JitFixup {
+    uint32_t at; // of a rel32
+    uint32_t label;
+};
+
+struct JitCompiler {
+    struct Interpreter* state;
+    uint8_t* code;
+    uint32_t n_code, cap_code;
+    uint32_t* labels; // code offsets
+    uint32_t n_labels, cap_labels;
+    struct JitFixup* fixups;
+    uint32_t n_fixups, cap_fixups;
+    uint32_t base; // first temporary slot
+    uint32_t depth, max_depth; // temporaries in use
+    uint32_t ret; // label of the epilogue
+    uint32_t fail; // label an error goes to: ret, or the +, -, pos or neg
+    uint32_t fail_depth; // temporaries in use there
+};
+
+static void emit_bytes(struct JitCompiler* c, const uint8_t* bytes, uint32_t n) {
+    while (c->n_code + n > c->cap_code) {
+        c->cap_code = c->cap_code ? 2 * c->cap_code : 256;
+        c->code = jit_realloc(c->code, c->cap_code);
+    }
+    memcpy(c->code + c->n_code, bytes, n);
+    c->n_code += n;
+}
+
+#define EMIT(c, ...) emit_bytes((c), (const uint8_t[]) {__VA_ARGS__}, sizeof((const uint8_t[]) {__VA_ARGS__}))
+
+static void emit32(struct JitCompiler* c, uint32_t v) {
+    emit_bytes(c, (const uint8_t*)&v, 4);
+}
+
+static void emit64(struct JitCompiler* c, uint64_t v) {
+    emit_bytes(c, (const uint8_t*)&v, 8);
+}
+
+static uint32_t label_new(struct JitCompiler* c) {
+    if (c->n_labels == c->cap_labels) {
+        c->cap_labels = c->cap_labels ? 2 * c->cap_labels : 16;
+        c->labels = jit_realloc(c->labels, sizeof(uint32_t) * c->cap_labels);
+    }
+    c->labels[c->n_labels] = UINT32_MAX;
+    return c->n_labels++;
+}
+
+static void label_bind(struct JitCompiler* c, uint32_t label) {
+    c->labels[label] = c->n_code;
+}
+
+static void rel32(struct JitCompiler* c, uint32_t label) {
+    if (c->n_fixups == c->cap_fixups) {
+        c->cap_fixups = c->cap_fixups ? 2 * c->cap_fixups : 16;
+        c->fixups = jit_realloc(c->fixups, sizeof(struct JitFixup) * c->cap_fixups);
+    }
+    c->fixups[c->n_fixups++] = (struct JitFixup) {c->n_code, label};
+    emit32(c, 0);
+}
+
+enum { JE = 0x84, JNE = 0x85 };
+
+static void jcc(struct JitCompiler* c, uint8_t cc, uint32_t label) {
+    EMIT(c, 0x0F, cc);
+    rel32(c, label);
+}
+
+static void jmp(struct JitCompiler* c, uint32_t label) {
+    EMIT(c, 0xE9);
+    rel32(c, label);
+}
+
+// mov r11, fn; call r11
+static void call(struct JitCompiler* c, uintptr_t fn) {
+    EMIT(c, 0x49, 0xBB);
+    emit64(c, fn);
+    EMIT(c, 0x41, 0xFF, 0xD3);
+}
+
+enum { RAX = 0x84, RCX = 0x8C, RDX = 0x94, RSI = 0xB4 }; // ModRM of [r12 + disp32]
+
+static uint32_t slot_disp(uint32_t slot) {
+    return offsetof(struct Environment, slots) + sizeof(struct LambValue) * slot;
+}
+
+// mov reg, [r12 + slot]
+static void load_slot(struct JitCompiler* c, uint8_t reg, uint32_t slot) {
+    EMIT(c, 0x49, 0x8B, reg, 0x24);
+    emit32(c, slot_disp(slot));
+}
+
+// mov [r12 + slot], rax
+static void store_slot(struct JitCompiler* c, uint32_t slot) {
+    EMIT(c, 0x49, 0x89, 0x84, 0x24);
+    emit32(c, slot_disp(slot));
+}
+
+// mov qword [r12 + slot], 0
+static void clear_slot(struct JitCompiler* c, uint32_t slot) {
+    EMIT(c, 0x49, 0xC7, 0x84, 0x24);
+    emit32(c, slot_disp(slot));
+    emit32(c, 0);
+}
+
+#define MOV_RDI_RBX(c) EMIT(c, 0x48, 0x89, 0xDF)
+#define MOV_RSI_R12(c) EMIT(c, 0x4C, 0x89, 0xE6)
+#define MOV_RSI_RAX(c) EMIT(c, 0x48, 0x89, 0xC6)
+#define MOV_RDX_RAX(c) EMIT(c, 0x48, 0x89, 0xC2)
+#define MOV_RCX_RAX(c) EMIT(c, 0x48, 0x89, 0xC1)
+#define MOV_RDX_R12(c) EMIT(c, 0x4C, 0x89, 0xE2)
+
+static void mov_esi(struct JitCompiler* c, uint32_t imm) {
+    EMIT(c, 0xBE);
+    emit32(c, imm);
+}
+
+static void mov_edx(struct JitCompiler* c, uint32_t imm) {
+    EMIT(c, 0xBA);
+    emit32(c, imm);
+}
+
+// jumps to label unless rax is a fixnum
+static void guard_num(struct JitCompiler* c, uint32_t label) {
+    EMIT(c, 0xA8, 0x01); // test al, 1
+    jcc(c, JE, label);
+}
+
+// jumps to label if rax is an object of type, which is not a fixnum
+static void if_type(struct JitCompiler* c, enum LambObjectType type, uint32_t label) {
+    uint32_t skip = label_new(c);
+    EMIT(c, 0xA8, 0x01);          // test al, 1
+    jcc(c, JNE, skip);
+    EMIT(c, 0x83, 0x38, type);    // cmp dword [rax], type
+    jcc(c, JE, label);
+    label_bind(c, skip);
+}
+
+static void mov_ecx(struct JitCompiler* c, uint32_t imm) {
+    EMIT(c, 0xB9);
+    emit32(c, imm);
+}
+
+// the error in rax goes to c->fail
+static void fail(struct JitCompiler* c) {
+    if (c->fail != c->ret && c->depth > c->fail_depth) {
+        EMIT(c, 0x49, 0x89, 0xC0); // mov r8, rax
+        MOV_RDI_RBX(c);
+        MOV_RSI_R12(c);
+        mov_edx(c, c->base + c->fail_depth);
+        mov_ecx(c, c->depth - c->fail_depth);
+        call(c, (uintptr_t)jit_clear);
+    }
+    jmp(c, c->fail);
+}
+
+// fails if rax is an error
+static void pass_error(struct JitCompiler* c) {
+    uint32_t skip = label_new(c);
+    EMIT(c, 0xA8, 0x01);          // test al, 1
+    jcc(c, JNE, skip);
+    EMIT(c, 0x83, 0x38, LOBJ_ERR); // cmp dword [rax], LOBJ_ERR
+    jcc(c, JNE, skip);
+    fail(c);
+    label_bind(c, skip);
+}
+
+static uint32_t temp_push(struct JitCompiler* c) {
+    if (++c->depth > c->max_depth) c->max_depth = c->depth;
+    return c->base + c->depth - 1;
+}
+
+// the interpreter walks expr
+static void compile_walk(struct JitCompiler* c, uint32_t expr) {
+    MOV_RDI_RBX(c);
+    mov_esi(c, expr);
+    MOV_RDX_R12(c);
+    call(c, (uintptr_t)eval_expr);
+}
+
+static void compile_expr(struct JitCompiler* c, uint32_t expr);
+
+static void compile_name(struct JitCompiler* c, uint32_t expr) {
+    uint32_t addr = NODE(c->state, expr).b;
+    uint32_t done = label_new(c), slow = label_new(c);
+    if (addr != RESOLVE_UNBOUND && ADDR_KIND(addr) == ADDR_LOCAL) {
+        uint32_t slot = ADDR_INDEX(addr);
+        load_slot(c, RAX, slot);
+        if (addr & ADDR_MOVE) {
+            clear_slot(c, slot);
+            EMIT(c, 0x48, 0x85, 0xC0); // test rax, rax
+            jcc(c, JNE, done);
+        } else {
+            EMIT(c, 0xA8, 0x01);       // test al, 1
+            jcc(c, JNE, done);
+            EMIT(c, 0x48, 0x85, 0xC0); // test rax, rax
+            jcc(c, JE, slow);
+            MOV_RDI_RBX(c);
+            MOV_RSI_RAX(c);
+            call(c, (uintptr_t)lv_use);
+            load_slot(c, RAX, slot);
+            jmp(c, done);
+        }
+    }
+    label_bind(c, slow);
+    MOV_RDI_RBX(c);
+    MOV_RSI_R12(c);
+    mov_edx(c, expr);
+    call(c, (uintptr_t)jit_name);
+    label_bind(c, done);
+}
+
+static void compile_unary(struct JitCompiler* c, uint32_t expr) {
+    struct FlatNode n = NODE(c->state, expr);
+    uint32_t done = label_new(c), slow = label_new(c);
+    uint32_t fail = c->fail, fail_depth = c->fail_depth;
+    c->fail = slow;
+    c->fail_depth = c->depth;
+    compile_expr(c, n.a);
+    c->fail = fail;
+    c->fail_depth = fail_depth;
+    guard_num(c, slow);
+    EMIT(c, 0x48, 0xD1, 0xF8);                // sar rax, 1
+    switch (n.tag) {
+        case AST_SUCC:
+            EMIT(c, 0x83, 0xC0, 0x01);        // add eax, 1
+            EMIT(c, 0x48, 0x63, 0xC0);        // movsxd rax, eax
+            break;
+        case AST_DEC:
+            EMIT(c, 0x83, 0xE8, 0x01);        // sub eax, 1
+            EMIT(c, 0x48, 0x63, 0xC0);        // movsxd rax, eax
+            break;
+        default:
+            EMIT(c, 0x85, 0xC0);              // test eax, eax
+            EMIT(c, 0x0F, n.tag == AST_POS ? 0x9F : 0x9C, 0xC0); // setg/setl al
+            EMIT(c, 0x0F, 0xB6, 0xC0);        // movzx eax, al
+            break;
+    }
+    EMIT(c, 0x48, 0x8D, 0x44, 0x00, 0x01);    // lea rax, [rax + rax + 1]
+    jmp(c, done);
+    label_bind(c, slow);
+    MOV_RDI_RBX(c);
+    MOV_RSI_RAX(c);
+    mov_edx(c, n.tag);
+    call(c, (uintptr_t)jit_unary);
+    label_bind(c, done);
+}
+
+static void compile_if_else(struct JitCompiler* c, uint32_t expr) {
+    struct FlatNode n = NODE(c->state, expr);
+    uint32_t not_num = label_new(c), orelse = label_new(c), done = label_new(c);
+    compile_expr(c, n.a);
+    guard_num(c, not_num);
+    EMIT(c, 0x48, 0x83, 0xF8, 0x01); // cmp rax, 1 (the fixnum 0)
+    jcc(c, JE, orelse);
+    compile_expr(c, n.b);
+    jmp(c, done);
+    label_bind(c, not_num);
+    pass_error(c);
+    MOV_RDI_RBX(c);
+    MOV_RSI_RAX(c);
+    call(c, (uintptr_t)jit_cond);
+    fail(c);
+    label_bind(c, orelse);
+    compile_expr(c, n.c);
+    label_bind(c, done);
+}
+
+// the frame takes rax into slot, through env_put
+static void compile_bind(struct JitCompiler* c, uint32_t slot) {
+    MOV_RCX_RAX(c);
+    MOV_RDI_RBX(c);
+    MOV_RSI_R12(c);
+    mov_edx(c, slot);
+    call(c, (uintptr_t)env_put);
+}
+
+static void compile_letrec(struct JitCompiler* c, uint32_t expr) {
+    struct FlatNode n = NODE(c->state, expr);
+    uint32_t ok = label_new(c);
+    compile_expr(c, n.b);
+    pass_error(c);
+    if_type(c, LOBJ_CLOSURE, ok);
+    MOV_RDI_RBX(c);
+    MOV_RSI_RAX(c);
+    call(c, (uintptr_t)jit_letrec);
+    fail(c);
+    label_bind(c, ok);
+    compile_bind(c, n.slot);
+    compile_expr(c, n.c);
+}
+
+// call of the borrowed fn of app on rax
+static void call_name(struct JitCompiler* c, uint32_t app) {
+    MOV_RCX_RAX(c);
+    MOV_RDI_RBX(c);
+    MOV_RSI_R12(c);
+    mov_edx(c, app);
+    call(c, (uintptr_t)jit_call_name);
+}
+
+// call of the fn in slot on rax
+static void call_slot(struct JitCompiler* c, uint32_t slot) {
+    MOV_RDX_RAX(c);
+    load_slot(c, RSI, slot);
+    clear_slot(c, slot);
+    MOV_RDI_RBX(c);
+    call(c, (uintptr_t)jit_call);
+}
+
+static void compile_app(struct JitCompiler* c, uint32_t expr) {
+    struct FlatNode n = NODE(c->state, expr);
+    // a fn that is a name is only borrowed for the first call (see resolver.h)
+    bool borrowed = n.slot & APP_BORROW;
+    if (!n.c) {
+        compile_expr(c, n.a);
+        return;
+    }
+    if (n.c == 1) {
+        compile_expr(c, ARG(c->state, n.b));
+        pass_error(c);
+        if (borrowed) {
+            call_name(c, expr);
+            return;
+        }
+        uint32_t temp = temp_push(c);
+        store_slot(c, temp); // the argument, while the fn is evaluated
+        compile_expr(c, n.a);
+        pass_error(c);
+        MOV_RSI_RAX(c);
+        load_slot(c, RDX, temp);
+        clear_slot(c, temp);
+        MOV_RDI_RBX(c);
+        call(c, (uintptr_t)jit_call);
+        c->depth--;
+        return;
+    }
+    uint32_t temp = temp_push(c);
+    if (borrowed) {
+        MOV_RDI_RBX(c);
+        MOV_RSI_R12(c);
+        mov_edx(c, expr);
+        call(c, (uintptr_t)jit_check_name);
+        uint32_t ok = label_new(c);
+        EMIT(c, 0x48, 0x85, 0xC0); // test rax, rax
+        jcc(c, JE, ok);
+        fail(c);
+        label_bind(c, ok);
+    } else {
+        compile_expr(c, n.a);
+        pass_error(c);
+    }
+    for (uint32_t i = 0; i < n.c; i++) {
+        bool borrow = borrowed && !i;
+        if (!borrow) {
+            uint32_t ok = label_new(c);
+            if_type(c, LOBJ_CLOSURE, ok);
+            MOV_RDI_RBX(c);
+            MOV_RSI_RAX(c);
+            call(c, (uintptr_t)jit_not_fn);
+            fail(c);
+            label_bind(c, ok);
+            store_slot(c, temp); // the fn, while its argument is evaluated
+        }
+        compile_expr(c, ARG(c->state, n.b + i));
+        pass_error(c);
+        if (borrow) {
+            call_name(c, expr);
+        } else {
+            call_slot(c, temp);
+        }
+        if (i + 1 < n.c) pass_error(c);
+    }
+    c->depth--;
+}
+
+static void compile_expr(struct JitCompiler* c, uint32_t expr) {
+    struct FlatNode n = NODE(c->state, expr);
+    switch (n.tag) {
+        case AST_NUM:
+            EMIT(c, 0x48, 0xB8); // mov rax, imm64
+            emit64(c, make_lamb_num((int)n.a).bits);
+            break;
+        case AST_IDENTIFIER:
+            compile_name(c, expr);
+            break;
+        case AST_SUCC:
+        case AST_DEC:
+        case AST_POS:
+        case AST_NEG:
+            compile_unary(c, expr);
+            break;
+        case AST_IF_ELSE:
+            compile_if_else(c, expr);
+            break;
+        case AST_LET_IN:
+            compile_expr(c, n.b);
+            pass_error(c);
+            compile_bind(c, n.slot);
+            compile_expr(c, n.c);
+            break;
+        case AST_LETREC:
+            compile_letrec(c, expr);
+            break;
+        case AST_APP:
+            compile_app(c, expr);
+            break;
+        case AST_ABS:
+            MOV_RDI_RBX(c);
+            mov_esi(c, expr);
+            MOV_RDX_R12(c);
+            call(c, (uintptr_t)close_over);
+            break;
+        default:
+            compile_walk(c, expr);
+            break;
+    }
+}
+
+// copies code into the cache, which is writable only meanwhile
+static void* cache_put(struct Jit* jit, const uint8_t* code, size_t n) {
+    size_t start = (jit->cache_used + 15) & ~(size_t)15;
+    if (start + n > JIT_CACHE_SIZE) return NULL;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t* first = jit->cache + (start & ~(page - 1));
+    size_t len = jit->cache + start + n - first;
+    if (mprotect(first, len, PROT_READ | PROT_WRITE)) return NULL;
+    memcpy(jit->cache + start, code, n);
+    mprotect(first, len, PROT_READ | PROT_EXEC);
+    __builtin___clear_cache((char*)jit->cache + start, (char*)jit->cache + start + n);
+    jit->cache_used = start + n;
+    return jit->cache + start;
+}
+
+static struct JitFn* compile_fn(struct Interpreter* state, uint32_t abs) {
+    struct Jit* jit = state->jit;
+    struct JitCompiler c = {.state = state, .base = state->prog->closures[NODE(state, abs).c]};
+    c.ret = label_new(&c);
+    c.fail = c.ret;
+    EMIT(&c, 0x55);                   // push rbp
+    EMIT(&c, 0x48, 0x89, 0xE5);       // mov rbp, rsp
+    EMIT(&c, 0x53);                   // push rbx
+    EMIT(&c, 0x41, 0x54);             // push r12
+    EMIT(&c, 0x48, 0x89, 0xFB);       // mov rbx, rdi
+    EMIT(&c, 0x49, 0x89, 0xF4);       // mov r12, rsi
+    compile_expr(&c, NODE(state, abs).b);
+    label_bind(&c, c.ret);
+    EMIT(&c, 0x41, 0x5C, 0x5B, 0x5D, 0xC3); // pop r12; pop rbx; pop rbp; ret
+    for (uint32_t i = 0; i < c.n_fixups; i++) {
+        int32_t rel = (int32_t)(c.labels[c.fixups[i].label] - (c.fixups[i].at + 4));
+        memcpy(c.code + c.fixups[i].at, &rel, 4);
+    }
+    void* code = cache_put(jit, c.code, c.n_code);
+    free(c.code);
+    free(c.labels);
+    free(c.fixups);
+    if (!code) {
+        jit->n_full++;
+        return NULL;
+    }
+    struct JitFn* fn = jit_realloc(NULL, sizeof(struct JitFn));
+    memcpy(&fn->entry, &code, sizeof(code));
+    fn->n_temps = c.max_depth;
+    jit->n_compiled++;
+    return fn;
+}
+
+struct Jit* jit_create(uint32_t threshold) {
+    struct Jit* jit = calloc(1, sizeof(struct Jit));
+    if (!jit) {
+        fprintf(stderr, "lamb: err: out of memory (jit).\n");
+        exit(1);
+    }
+    jit->threshold = threshold;
+    jit->cache = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->cache == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+struct JitFn* jit_lookup(struct Interpreter* state, uint32_t abs) {
+    struct Jit* jit = state->jit;
+    if (abs >= jit->cap_fns) {
+        uint32_t cap = state->prog->n_nodes;
+        jit->fns = jit_realloc(jit->fns, sizeof(struct JitFn*) * cap);
+        jit->calls = jit_realloc(jit->calls, sizeof(uint32_t) * cap);
+        memset(jit->fns + jit->cap_fns, 0, sizeof(struct JitFn*) * (cap - jit->cap_fns));
+        memset(jit->calls + jit->cap_fns, 0, sizeof(uint32_t) * (cap - jit->cap_fns));
+        jit->cap_fns = cap;
+    }
+    if (jit->fns[abs]) return jit->fns[abs];
+    // past the threshold only if it did not fit
+    if (jit->calls[abs] > jit->threshold || jit->calls[abs]++ < jit->threshold) return NULL;
+    jit->fns[abs] = compile_fn(state, abs);
+    return jit->fns[abs];
+}
+
+void jit_free(struct Jit* jit) {
+    if (!jit) return;
+    for (uint32_t i = 0; i < jit->cap_fns; i++) {
+        free(jit->fns[i]);
+    }
+    free(jit->fns);
+    free(jit->calls);
+    munmap(jit->cache, JIT_CACHE_SIZE);
+    free(jit);
+}
+
+#else
+
+struct Jit* jit_create(uint32_t threshold) {
+    return NULL;
+}
+
+struct JitFn* jit_lookup(struct Interpreter* state, uint32_t abs) {
+    return NULL;
+}
+
+void jit_free(struct Jit* jit) {
+}
+
+#endif
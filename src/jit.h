@@ -0,0 +1,57 @@
+#ifndef LAMB_JIT_H
+#define LAMB_JIT_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Baseline JIT for the tree walker, on Linux x86-64 only. closure_call
+// counts the calls of each fn; after the threshold, the fn's body is
+// compiled to machine code by stitching a fixed template per node, and the
+// calls after run that instead of walking the body.
+//
+// The templates inline the fixnum paths of numbers, names, +, -, pos, neg
+// and if-else, and guard them: a value of another type leaves the template
+// for a call into the runtime that does what the tree walker would. Calls
+// go through closure_call, so compiled and walked fns call each other
+// freely; a node with no template (a fn, a letrec, an error) is walked by
+// eval_expr. Values the code holds while it evaluates something else sit
+// in slots of the frame after the resolver's, where reference counting and
+// the collector's roots find them, as the VM's operand stack does.
+//
+// Code goes into a cache of JIT_CACHE_SIZE bytes mapped once, never
+// writable and executable at the same time: it is made writable only to
+// copy a fn in, between calls of compiled code. A fn that does not fit
+// stays walked.
+//
+// Compiled code counts no steps and prints no DEBUG trace; interpret()
+// makes no JIT when DEBUG is set.
+#define JIT_THRESHOLD 100
+#define JIT_CACHE_SIZE ((size_t)1 << 20)
+
+struct Interpreter;
+struct Environment;
+struct LambValue;
+
+struct JitFn {
+    struct LambValue (*entry)(struct Interpreter* state, struct Environment* env);
+    uint32_t n_temps; // slots the frame needs after the resolver's
+};
+
+struct Jit {
+    uint32_t threshold;
+    uint32_t* calls;      // by AST_ABS node, up to the threshold
+    struct JitFn** fns;   // by AST_ABS node, once compiled
+    uint32_t cap_fns;
+    uint8_t* cache;
+    size_t cache_used;
+    // statistics
+    size_t n_compiled; // fns
+    size_t n_full;     // fns that did not fit in the cache
+};
+
+// NULL where there is no JIT
+struct Jit* jit_create(uint32_t threshold);
+// counts a call of abs, whose body has been forced; its code if compiled
+struct JitFn* jit_lookup(struct Interpreter* state, uint32_t abs);
+void jit_free(struct Jit* jit);
+
+#endif
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lambc.h"
+#include "symbol.h"
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+// FNV-1a over 8-byte words (then the tail bytes), as a plain bytewise
+// pass would dominate the load time of a large program
+uint64_t lambc_hash(const void* data, size_t len) {
+    const unsigned char* p = data;
+    uint64_t h = 14695981039346656037ULL;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h ^= w;
+        h *= 1099511628211ULL;
+    }
+    for (; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// a section of the file; an empty one may have no array behind it
+static void put_section(char* buf, uint32_t off, const void* data, size_t len) {
+    if (len) memcpy(buf + off, data, len);
+}
+
+static int64_t mtime_ns(struct stat* st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+int lambc_write(struct FlatProgram* prog, const char* out_path, const char* source_path, struct Source* src) {
+    struct LambcHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LAMBC_MAGIC, 4);
+    h.version = LAMBC_VERSION;
+    h.source_hash = lambc_hash(src->chars, src->len);
+    h.source_size = src->len;
+
+    char abs_path[PATH_MAX];
+    struct stat st;
+    if (strcmp(source_path, "-") && realpath(source_path, abs_path) && !stat(abs_path, &st)) {
+        h.source_mtime = mtime_ns(&st);
+        h.path_len = strlen(abs_path);
+    } else {
+        h.path_len = 0; // stdin: nothing to check against later
+    }
+
+    if (prog->n_lazy) {
+        fprintf(stderr, "lamb: err: cannot compile a program with unparsed fn bodies.\n");
+        return 0;
+    }
+    h.root = prog->root;
+    h.root_slots = prog->root_slots;
+    h.n_nodes = prog->n_nodes;
+    h.n_args = prog->n_args;
+    h.n_closures = prog->n_closures;
+    h.n_strings = prog->n_strings;
+    h.n_chars = prog->n_chars;
+    h.n_syms = symbol_count();
+    size_t sym_chars = 0;
+    for (uint32_t i = 0; i < h.n_syms; i++) sym_chars += symbol_name(i).length + 1;
+    if (sym_chars > UINT32_MAX) {
+        fprintf(stderr, "lamb: err: program too large to compile.\n");
+        return 0;
+    }
+    h.n_sym_chars = sym_chars;
+    size_t off = ALIGN8(sizeof(h));
+    h.nodes_off = off;
+    off = ALIGN8(off + (size_t)h.n_nodes * sizeof(struct FlatNode));
+    h.args_off = off;
+    off = ALIGN8(off + (size_t)h.n_args * sizeof(uint32_t));
+    h.closures_off = off;
+    off = ALIGN8(off + (size_t)h.n_closures * sizeof(uint32_t));
+    h.strings_off = off;
+    off = ALIGN8(off + (size_t)h.n_strings * sizeof(struct FlatString));
+    h.chars_off = off;
+    off = ALIGN8(off + h.n_chars);
+    h.syms_off = off;
+    off = ALIGN8(off + (size_t)h.n_syms * sizeof(struct FlatString));
+    h.sym_chars_off = off;
+    off = ALIGN8(off + h.n_sym_chars);
+    h.path_off = off;
+    off = ALIGN8(off + h.path_len + 1);
+    if (off > UINT32_MAX) {
+        fprintf(stderr, "lamb: err: program too large to compile.\n");
+        return 0;
+    }
+
+    char* buf = calloc(1, off);
+    if (!buf) {
+        fprintf(stderr, "lamb: err: out of memory (compile).\n");
+        return 0;
+    }
+    put_section(buf, h.nodes_off, prog->nodes, (size_t)h.n_nodes * sizeof(struct FlatNode));
+    put_section(buf, h.args_off, prog->args, (size_t)h.n_args * sizeof(uint32_t));
+    put_section(buf, h.closures_off, prog->closures, (size_t)h.n_closures * sizeof(uint32_t));
+    put_section(buf, h.strings_off, prog->strings, (size_t)h.n_strings * sizeof(struct FlatString));
+    put_section(buf, h.chars_off, prog->chars, h.n_chars);
+    struct FlatString* syms = (struct FlatString*)(buf + h.syms_off);
+    uint32_t sym_off = 0;
+    for (uint32_t i = 0; i < h.n_syms; i++) {
+        struct String name = symbol_name(i);
+        syms[i] = (struct FlatString) {sym_off, name.length};
+        memcpy(buf + h.sym_chars_off + sym_off, name.b, name.length + 1);
+        sym_off += name.length + 1;
+    }
+    memcpy(buf + h.path_off, abs_path, h.path_len);
+    h.hash = lambc_hash(buf + sizeof(h), off - sizeof(h));
+    memcpy(buf, &h, sizeof(h));
+
+    // written beside the target and renamed over it, so that a concurrent
+    // `lamb run` never maps a half-written file
+    size_t tmp_len = strlen(out_path) + 5;
+    char* tmp = malloc(tmp_len);
+    snprintf(tmp, tmp_len, "%s.tmp", out_path);
+    FILE* f = fopen(tmp, "wb");
+    int ok = f && fwrite(buf, 1, off, f) == off;
+    if (f && fclose(f)) ok = 0;
+    if (ok && rename(tmp, out_path)) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "lamb: err: cannot write \"%s\"; %s.\n", out_path, strerror(errno));
+        unlink(tmp);
+    }
+    free(tmp);
+    free(buf);
+    return ok;
+}
+
+static int section_ok(size_t file_len, uint32_t off, size_t n, size_t size) {
+    return off % 8 == 0 && off <= file_len && n * size <= file_len - off;
+}
+
+// 1 if the program text is unchanged (or gone), 0 if it has been edited
+static int source_fresh(struct LambcHeader* h, const char* path) {
+    struct stat st;
+    if (stat(path, &st)) return 1;
+    if (st.st_size == h->source_size && mtime_ns(&st) == h->source_mtime) return 1;
+    // touched, or rewritten with the same size: compare contents
+    struct Source* src = source_open(path);
+    if (!src) return 1;
+    int same = src->len == h->source_size && lambc_hash(src->chars, src->len) == h->source_hash;
+    source_close(src);
+    return same;
+}
+
+struct FlatProgram* lambc_load(const char* path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "lamb: err: cannot read \"%s\"; %s.\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    size_t len = st.st_size;
+    void* map = len >= sizeof(struct LambcHeader)
+        ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "lamb: err: \"%s\" is not a compiled lamb program.\n", path);
+        return NULL;
+    }
+    struct LambcHeader* h = map;
+    const char* why = NULL;
+    if (memcmp(h->magic, LAMBC_MAGIC, 4)) {
+        why = "is not a compiled lamb program";
+    } else if (h->version != LAMBC_VERSION) {
+        why = "was compiled by a different version of lamb; recompile it";
+    } else if (!section_ok(len, h->nodes_off, h->n_nodes, sizeof(struct FlatNode))
+            || !section_ok(len, h->args_off, h->n_args, sizeof(uint32_t))
+            || !section_ok(len, h->closures_off, h->n_closures, sizeof(uint32_t))
+            || !section_ok(len, h->strings_off, h->n_strings, sizeof(struct FlatString))
+            || !section_ok(len, h->chars_off, h->n_chars, 1)
+            || !section_ok(len, h->syms_off, h->n_syms, sizeof(struct FlatString))
+            || !section_ok(len, h->sym_chars_off, h->n_sym_chars, 1)
+            || !section_ok(len, h->path_off, h->path_len + 1, 1)
+            || h->root == 0 || h->root >= h->n_nodes
+            || lambc_hash((char*)map + sizeof(*h), len - sizeof(*h)) != h->hash) {
+        why = "is corrupt; recompile it";
+    } else if (h->path_len && !source_fresh(h, (char*)map + h->path_off)) {
+        why = "is stale; its source has changed since it was compiled";
+    }
+    if (!why && symbol_count()) {
+        why = "cannot be loaded once other names are interned";
+    }
+    if (why) {
+        fprintf(stderr, "lamb: err: \"%s\" %s.\n", path, why);
+        munmap(map, len);
+        return NULL;
+    }
+
+    struct FlatString* syms = (struct FlatString*)((char*)map + h->syms_off);
+    const char* sym_chars = (char*)map + h->sym_chars_off;
+    for (uint32_t i = 0; i < h->n_syms; i++)
+        symbol_intern(sym_chars + syms[i].offset, syms[i].length);
+
+    struct FlatProgram* prog = calloc(1, sizeof(struct FlatProgram));
+    prog->nodes = (struct FlatNode*)((char*)map + h->nodes_off);
+    prog->n_nodes = h->n_nodes;
+    prog->args = (uint32_t*)((char*)map + h->args_off);
+    prog->n_args = h->n_args;
+    prog->closures = (uint32_t*)((char*)map + h->closures_off);
+    prog->n_closures = h->n_closures;
+    prog->strings = (struct FlatString*)((char*)map + h->strings_off);
+    prog->n_strings = h->n_strings;
+    prog->chars = (char*)map + h->chars_off;
+    prog->n_chars = h->n_chars;
+    prog->root = h->root;
+    prog->root_slots = h->root_slots;
+    prog->mapping = map;
+    prog->mapping_len = len;
+    return prog;
+}
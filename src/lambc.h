@@ -0,0 +1,46 @@
+#ifndef LAMB_LAMBC_H
+#define LAMB_LAMBC_H
+#include <stdint.h>
+#include "flat.h"
+#include "source.h"
+
+// .lambc: a compiled program. The file is the FlatProgram's arrays laid out
+// as they are in memory, each at an 8-byte-aligned offset from the start of
+// the file, so `lamb run` maps it and evaluates it in place. Offsets rather
+// than pointers keep it position-independent.
+//
+//   header | nodes | args | closures | strings | chars | symbols | symbol chars
+//   | source path
+//
+// Nodes refer to names by symbol id, so the file carries the names of its
+// symbols in id order; loading interns them into the (still empty) symbol
+// table, which hands out the same ids again. Programs are stored resolved
+// (see resolver.h).
+#define LAMBC_MAGIC "LMBC"
+#define LAMBC_VERSION 5 // bump whenever the node layout or encoding changes
+
+struct LambcHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t hash;        // lambc_hash of everything after the header
+    uint64_t source_hash; // lambc_hash of the program text it was compiled from
+    int64_t source_size;
+    int64_t source_mtime;
+    uint32_t root, root_slots;
+    uint32_t n_nodes, n_args, n_closures, n_strings, n_chars, n_syms, n_sym_chars, path_len;
+    uint32_t nodes_off, args_off, closures_off, strings_off, chars_off, syms_off, sym_chars_off,
+        path_off;
+};
+
+// source_path is recorded (made absolute) so that lambc_load can notice the
+// program text changing; returns 0 and reports on failure
+int lambc_write(struct FlatProgram* prog, const char* out_path, const char* source_path, struct Source* src);
+
+// NULL (having reported why) if the file is missing, corrupt, from another
+// version, or older than its source. A source that no longer exists is not
+// an error. Must run before anything else is interned.
+struct FlatProgram* lambc_load(const char* path);
+
+uint64_t lambc_hash(const void* data, size_t len);
+
+#endif
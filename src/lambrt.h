@@ -0,0 +1,90 @@
+#ifndef LAMB_LAMBRT_H
+#define LAMB_LAMBRT_H
+#include <stdio.h>
+#include "interpreter.h"
+#include "slab.h"
+
+// The runtime of a program compiled to C by `lamb emit-c` (see emitc.h):
+// the interpreter's values, closures, reference counting and slab, linked
+// from liblamb.a, and what the generated code does with them. A closure's
+// code is the index of its lifted fn in lamb_fns.
+//
+// Errors are the tree walker's, word for word.
+
+// each lifted fn takes its closure, borrowed, and its argument, which it
+// takes over; the caller owns the result
+extern struct LambValue (* const lamb_fns[])(struct Interpreter* S, struct LambObject* self, struct LambValue arg);
+// the program pretty-printed, and where in it each fn is, for a closure
+// result
+struct LambSpan {
+    uint32_t at, length;
+};
+extern const char lamb_text[];
+extern const struct LambSpan lamb_fn_text[];
+
+#define RT_NUM(n) ((struct LambValue) {((uintptr_t)(intptr_t)(int)(n) << 1) | 1}) // make_lamb_num
+#define RT_IS_ERR(v) (LV_TYPE(v) == LOBJ_ERR)
+
+static inline struct LambValue rt_error(struct Interpreter* S, const char* message) {
+    return LV_FROM_OBJ(make_lamb_err(S, string_create(message)));
+}
+
+// +, -, pos or neg of something other than a number
+static inline struct LambValue rt_unary(struct Interpreter* S, struct LambValue v, bool dec) {
+    lv_release(S, v);
+    return rt_error(S, dec ? "[type error] - applied to a non-Num argument."
+                           : "[type error] + applied to a non-Num argument.");
+}
+
+// a condition that is neither a number nor an error
+static inline struct LambValue rt_cond(struct Interpreter* S, struct LambValue cond) {
+    lv_release(S, cond);
+    return rt_error(S, "[type error] - tried to use a non-Num condition in if-else expression.");
+}
+
+static inline struct LambValue rt_letrec(struct Interpreter* S, struct LambValue fn) {
+    lv_release(S, fn);
+    return rt_error(S, "[type error] Expected a function to be recursively defined in letrec expression");
+}
+
+static inline struct LambValue rt_not_fn(struct Interpreter* S, struct LambValue fn, bool borrowed) {
+    if (!borrowed) lv_release(S, fn);
+    return rt_error(S, "[type error] Expected a function to be applied");
+}
+
+// fn is borrowed and arg taken over
+static inline struct LambValue rt_call(struct Interpreter* S, struct LambValue fn, struct LambValue arg) {
+    if (LV_TYPE(fn) != LOBJ_CLOSURE) {
+        lv_release(S, arg);
+        return rt_error(S, "[run-time error]: tried to apply something that's not a function");
+    }
+    return lamb_fns[LOBJ_CLOSURE(LV_OBJ(fn))->code](S, LV_OBJ(fn), arg);
+}
+
+// runs the program's root and prints its value as interpret() does
+static inline int rt_main(struct LambValue (*root)(struct Interpreter* S)) {
+    struct Interpreter state = {0};
+    state.objects = slab_create("objs");
+    struct LambValue val = root(&state);
+    if (!LV_IS_NONE(val)) {
+        printf("> ");
+        switch (LV_TYPE(val)) {
+            case LOBJ_NUM:
+                printf("%d\n", LV_NUM(val));
+                break;
+            case LOBJ_ERR:
+                printf("%s\n", LOBJ_STRING(LV_OBJ(val))->b);
+                break;
+            case LOBJ_CLOSURE: {
+                struct LambSpan text = lamb_fn_text[LOBJ_CLOSURE(LV_OBJ(val))->code];
+                printf("Closure (pretty printed): %.*s\n", (int)text.length, lamb_text + text.at);
+                break;
+            }
+        }
+        lv_release(&state, val);
+    }
+    slab_free(state.objects);
+    return 0;
+}
+
+#endif
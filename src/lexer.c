@@ -2,30 +2,41 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "lexer.h"
 #include "error.h"
 
-static struct TokenList* tl_cons(struct Token t, struct TokenList* next) {
-    struct TokenList* l = malloc(sizeof(struct TokenList));
-    l->t = t;
-    l->next = next;
-    return l;
+static const char* token_strs[] = {
+    [TOK_PLUS] = "+", [TOK_MINUS] = "-", [TOK_LEQ] = "<", [TOK_GEQ] = ">",
+    [TOK_LEFT_PAREN] = "(", [TOK_RIGHT_PAREN] = ")",
+    [TOK_IDENTIFIER] = "identifier",
+    [TOK_FIX] = "FIX", [TOK_LETREC] = "LETREC", [TOK_LET] = "LET", [TOK_IN] = "IN",
+    [TOK_BE] = "BE", [TOK_FN] = "FN", [TOK_IF] = "IF", [TOK_ELSE] = "ELSE", [TOK_THEN] = "THEN",
+    [TOK_NUMBER] = "NUMBER",
+    [TOK_SOF] = "SOF", [TOK_EOF] = "EOF", [TOK_NONE] = "NONE"
+};
+
+const char* token_type_str(enum TokenType t) {
+    return token_strs[t];
 }
 
-static void tl_add_token(struct TokenList* l, struct Token t) {
-    if (!l)
-        return;
-    struct TokenList* curr = l;
-    while (curr->next) {
-        curr = curr->next;
+static void tb_push(struct TokenBuffer* tb, struct Token t) {
+    if (tb->len == tb->cap) {
+        tb->cap = tb->cap ? tb->cap * 2 : 256;
+        tb->tokens = realloc(tb->tokens, sizeof(struct Token) * tb->cap);
+        if (!tb->tokens) {
+            fprintf(stderr, "lamb: err: out of memory while lexing.\n");
+            exit(1);
+        }
     }
-    curr->next = tl_cons(t, NULL);
+    tb->tokens[tb->len++] = t;
 }
 
-static struct OptionalToken create_token(
-    struct Lexer* s, const char* str_t, enum TokenType t) {
+static struct OptionalToken create_token(struct Lexer* s, enum TokenType t) {
     struct Token tok = {
-        .str_type = str_t, .type = t,
+        .type = t, .value = 0,
         .line = s->line, .str_start = s->start, .str_end = s->curr
     };
     return (struct OptionalToken) {tok, OPTIONAL_TOKEN_YES};
@@ -34,7 +45,7 @@ static struct OptionalToken create_token(
 static struct OptionalToken create_none_token(
     struct Lexer* s) {
     struct Token tok = {
-        .str_type = "NONE", .type = TOK_NONE,
+        .type = TOK_NONE, .value = 0,
         .line = s->line, .str_start = s->start, .str_end = s->curr
     };
     return (struct OptionalToken) {tok, OPTIONAL_TOKEN_NO};
@@ -53,12 +64,6 @@ static char lexer_advance(struct Lexer* s) {
     return s->source[(s->curr)++];
 }
 
-static char lexer_peek(struct Lexer* s) {
-    if (s->curr >= s->len)
-        return '\0';
-    return s->source[s->curr];
-}
-
 static bool is_digit(char c) {
     return c >= '0' && c <= '9';
 }
@@ -73,50 +78,177 @@ static int is_alphanumeric(char c) {
     return is_digit(c) || is_alpha(c);
 }
 
-static struct OptionalToken number(struct Lexer* s) {
-    while (is_digit(lexer_peek(s))) lexer_advance(s);
-    struct Token tok = {"NUMBER", TOK_NUMBER, s->start, s->curr, s->line};
-    return (struct OptionalToken) {tok, OPTIONAL_TOKEN_YES};
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
 }
 
-static struct OptionalToken identifier(struct Lexer* s) {
-    while (is_alphanumeric(lexer_peek(s))) lexer_advance(s);
-    enum TokenType token_type;
-    const char* tok_str;
-    if (!strncmp(&s->source[s->start], "if", 2)) {
-        token_type = TOK_IF;
-        tok_str = "IF";
-    } else if (!strncmp(&s->source[s->start], "else", 4)) {
-        tok_str = "ELSE";
-        token_type = TOK_ELSE;
-    } else if (!strncmp(&s->source[s->start], "then", 4)) {
-        tok_str = "THEN";
-        token_type = TOK_THEN;
+/*
+CHARACTER CLASS RUNS
+
+Each scan_*_run returns the index of the first byte at or after i that is
+outside its class (or len). Whole 32/16 byte blocks are classified with
+AVX2/SSE2 compares and a movemask; the tail, non-x86 builds and builds with
+-DLAMB_NO_SIMD fall back to the scalar predicates above. Build with -mavx2
+(or -march=native) to get the wide path.
+*/
+
+#if defined(LAMB_NO_SIMD)
+// scalar only
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 32
+#define simd_vec __m256i
+#define simd_load(p) _mm256_loadu_si256((const __m256i*)(p))
+#define simd_set1(c) _mm256_set1_epi8((char)(c))
+#define simd_eq _mm256_cmpeq_epi8
+#define simd_gt _mm256_cmpgt_epi8
+#define simd_or _mm256_or_si256
+#define simd_xor _mm256_xor_si256
+#define simd_sub _mm256_sub_epi8
+#define simd_mask(v) ((unsigned int)_mm256_movemask_epi8(v))
+#define SIMD_ALL 0xFFFFFFFFu
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 16
+#define simd_vec __m128i
+#define simd_load(p) _mm_loadu_si128((const __m128i*)(p))
+#define simd_set1(c) _mm_set1_epi8((char)(c))
+#define simd_eq _mm_cmpeq_epi8
+#define simd_gt _mm_cmpgt_epi8
+#define simd_or _mm_or_si128
+#define simd_xor _mm_xor_si128
+#define simd_sub _mm_sub_epi8
+#define simd_mask(v) ((unsigned int)_mm_movemask_epi8(v))
+#define SIMD_ALL 0xFFFFu
+#endif
+
+#ifdef SIMD_WIDTH
+// unsigned (c - lo) < n, done as a signed compare after biasing by 0x80
+static simd_vec simd_in_range(simd_vec c, char lo, int n) {
+    simd_vec biased = simd_xor(simd_sub(c, simd_set1(lo)), simd_set1(0x80));
+    return simd_gt(simd_set1(0x80 + n), biased);
+}
+
+static simd_vec simd_is_alnum(simd_vec c) {
+    simd_vec lower = simd_or(c, simd_set1(0x20));
+    return simd_or(
+        simd_or(simd_in_range(lower, 'a', 26), simd_in_range(c, '0', 10)),
+        simd_eq(c, simd_set1('_')));
+}
+
+static simd_vec simd_is_space(simd_vec c) {
+    return simd_or(
+        simd_or(simd_eq(c, simd_set1(' ')), simd_eq(c, simd_set1('\t'))),
+        simd_or(simd_eq(c, simd_set1('\r')), simd_eq(c, simd_set1('\n'))));
+}
+#endif
+
+static int scan_ident_run(const char* src, int i, int len) {
+#ifdef SIMD_WIDTH
+    for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+        unsigned int m = simd_mask(simd_is_alnum(simd_load(src + i)));
+        if (m != SIMD_ALL) return i + __builtin_ctz(~m);
     }
-    else if (!strncmp(&s->source[s->start], "letrec", 6)) {
-        tok_str = "LETREC";
-        token_type = TOK_LETREC;
-    } else if (!strncmp(&s->source[s->start], "let", 3)) {
-        tok_str = "LET";
-        token_type = TOK_LET;
-    } else if (!strncmp(&s->source[s->start], "fix", 3)) {
-        tok_str = "FIX";
-        token_type = TOK_FIX;
+#endif
+    while (i < len && is_alphanumeric(src[i])) i++;
+    return i;
+}
+
+static int scan_digit_run(const char* src, int i, int len) {
+#ifdef SIMD_WIDTH
+    for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+        unsigned int m = simd_mask(simd_in_range(simd_load(src + i), '0', 10));
+        if (m != SIMD_ALL) return i + __builtin_ctz(~m);
+    }
+#endif
+    while (i < len && is_digit(src[i])) i++;
+    return i;
+}
+
+// stops on the '\n' ending a comment so that it is counted as whitespace
+static int scan_comment_run(const char* src, int i, int len) {
+#ifdef SIMD_WIDTH
+    for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+        unsigned int m = simd_mask(simd_eq(simd_load(src + i), simd_set1('\n')));
+        if (m) return i + __builtin_ctz(m);
+    }
+#endif
+    while (i < len && src[i] != '\n') i++;
+    return i;
+}
+
+// also counts the newlines it skips into *lines
+static int scan_space_run(const char* src, int i, int len, int* lines) {
+#ifdef SIMD_WIDTH
+    for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+        simd_vec c = simd_load(src + i);
+        unsigned int space = simd_mask(simd_is_space(c));
+        unsigned int nl = simd_mask(simd_eq(c, simd_set1('\n')));
+        if (space != SIMD_ALL) {
+            int run = __builtin_ctz(~space);
+            *lines += __builtin_popcount(nl & ((1u << run) - 1));
+            return i + run;
+        }
+        *lines += __builtin_popcount(nl);
     }
-    else if (!strncmp(&s->source[s->start], "in", 2)) {
-        tok_str = "IN";
-        token_type = TOK_IN;
-    } else if (!strncmp(&s->source[s->start], "be", 2)) {
-        tok_str = "BE";
-        token_type = TOK_BE;
-    } else if (!strncmp(&s->source[s->start], "fn", 2)) {
-        tok_str = "FN";
-        token_type = TOK_FN;
-    } else {
-        token_type = TOK_IDENTIFIER;
-        tok_str = "identifier";
+#endif
+    for (; i < len && is_space(src[i]); i++) {
+        if (src[i] == '\n') (*lines)++;
     }
-    return create_token(s, tok_str, token_type);
+    return i;
+}
+
+static struct OptionalToken number(struct Lexer* s) {
+    s->curr = scan_digit_run(s->source, s->curr, s->len);
+    long val = 0;
+    for (int i = s->start; i < s->curr; i++) {
+        val = val * 10 + (s->source[i] - '0');
+        if (val > INT_MAX) val = (long)INT_MAX + 1; // saturate, reported by the parser
+    }
+    struct OptionalToken tok = create_token(s, TOK_NUMBER);
+    tok.t.value = val > INT_MAX ? -1 : (int)val;
+    return tok;
+}
+
+/*
+KEYWORDS
+*/
+
+struct Keyword {
+    const char* str;
+    int len;
+    enum TokenType type;
+};
+
+// Perfect hash over the nine keywords: (4 * first + last + len) & 15 has no
+// collisions, so a lookup is one hash, one length check and one memcmp.
+// Regenerate the table if a keyword is ever added.
+#define KW_HASH(first, last, len) ((((unsigned)(first) << 2) + (unsigned)(last) + (unsigned)(len)) & 15)
+
+static const struct Keyword keywords[16] = {
+    [KW_HASH('i', 'f', 2)] = {"if", 2, TOK_IF},
+    [KW_HASH('e', 'e', 4)] = {"else", 4, TOK_ELSE},
+    [KW_HASH('t', 'n', 4)] = {"then", 4, TOK_THEN},
+    [KW_HASH('l', 'c', 6)] = {"letrec", 6, TOK_LETREC},
+    [KW_HASH('l', 't', 3)] = {"let", 3, TOK_LET},
+    [KW_HASH('f', 'x', 3)] = {"fix", 3, TOK_FIX},
+    [KW_HASH('i', 'n', 2)] = {"in", 2, TOK_IN},
+    [KW_HASH('b', 'e', 2)] = {"be", 2, TOK_BE},
+    [KW_HASH('f', 'n', 2)] = {"fn", 2, TOK_FN},
+};
+
+static enum TokenType keyword_type(const char* str, int len) {
+    if (len < 2 || len > 6)
+        return TOK_IDENTIFIER;
+    const struct Keyword* kw = &keywords[KW_HASH(str[0], str[len - 1], len)];
+    if (kw->len == len && !memcmp(kw->str, str, len))
+        return kw->type;
+    return TOK_IDENTIFIER;
+}
+
+static struct OptionalToken identifier(struct Lexer* s) {
+    s->curr = scan_ident_run(s->source, s->curr, s->len);
+    return create_token(s, keyword_type(&s->source[s->start], s->curr - s->start));
 }
 
 static struct OptionalToken scan_token(struct Lexer* s) {
@@ -124,41 +256,41 @@ static struct OptionalToken scan_token(struct Lexer* s) {
     (void)(lexer_match); // hack for warning
     switch (c) {
         case '+': {
-            return create_token(s, "+", TOK_PLUS);
+            return create_token(s, TOK_PLUS);
         }
         case '-': {
-            return create_token(s, "-", TOK_MINUS);
+            return create_token(s, TOK_MINUS);
         }
         case '<': {
-            return create_token(s, "<", TOK_LEQ);
+            return create_token(s, TOK_LEQ);
         }
         case '>': {
-            return create_token(s, "<", TOK_GEQ);
+            return create_token(s, TOK_GEQ);
         }
         case '(': {
-            return create_token(s, "(", TOK_LEFT_PAREN);
+            return create_token(s, TOK_LEFT_PAREN);
         }
         case ')': {
-            return create_token(s, ")", TOK_RIGHT_PAREN);
+            return create_token(s, TOK_RIGHT_PAREN);
         }
         case '#': {
-            while (lexer_peek(s) != '\n' && s->curr < s->len) lexer_advance(s);
+            s->curr = scan_comment_run(s->source, s->curr, s->len);
             return create_none_token(s);
         }
         case '\n':
-            s->line++;
         case ' ':
         case '\r':
         case '\t':
+            s->curr = scan_space_run(s->source, s->curr - 1, s->len, &s->line);
             return create_none_token(s);
         default: {
             if (is_digit(c))
                 return number(s);
             else if (is_alpha(c))
                 return identifier(s);
-            report(s->line, "(in lexer)", "Unexpected character. ");
-            printf("%c\n", c);
-            exit(1);
+            struct OptionalToken bad = create_none_token(s);
+            bad.e = OPTIONAL_TOKEN_ERR; // reported by the caller
+            return bad;
         }
     }
     return create_none_token(s);
@@ -178,25 +310,162 @@ void lexer_free(struct Lexer* ls) {
     free(ls);
 }
 
-struct TokenList* scan_source(struct Lexer* s) {
-    struct OptionalToken sof = create_token(s, "SOF", TOK_SOF);
-    struct TokenList* tokens = tl_cons(sof.t, NULL);
+static void tb_init(struct TokenBuffer* tb, int cap) {
+    tb->tokens = cap ? malloc(sizeof(struct Token) * cap) : NULL;
+    tb->len = 0;
+    tb->cap = cap;
+}
+
+// Lexes s->source[s->curr, s->len) into out, without SOF/EOF. Returns 0 on an
+// unexpected character, with s->curr just past it.
+static int lex_tokens(struct Lexer* s, struct TokenBuffer* out) {
     while (s->curr < s->len) {
         s->start = s->curr;
         struct OptionalToken token = scan_token(s);
         if (token.e == OPTIONAL_TOKEN_YES)
-            tl_add_token(tokens, token.t);
+            tb_push(out, token.t);
+        else if (token.e == OPTIONAL_TOKEN_ERR)
+            return 0;
     }
-    struct OptionalToken eof = create_token(s, "EOF", TOK_EOF);
-    tl_add_token(tokens, eof.t);
+    return 1;
+}
+
+static void report_bad_char(struct Lexer* s) {
+    report(s->line, "(in lexer)", "Unexpected character. ");
+    printf("%c\n", s->source[s->curr - 1]);
+    exit(1);
+}
+
+struct TokenBuffer* scan_source(struct Lexer* s) {
+    struct TokenBuffer* tokens = malloc(sizeof(struct TokenBuffer));
+    tb_init(tokens, 0);
+    tb_push(tokens, create_token(s, TOK_SOF).t);
+    if (!lex_tokens(s, tokens))
+        report_bad_char(s);
+    s->start = s->curr;
+    tb_push(tokens, create_token(s, TOK_EOF).t);
     return tokens;
 }
 
-void tl_free(struct TokenList* tl) {
-    struct TokenList* curr = tl;
-    while (curr) {
-        struct TokenList* old = curr;
-        curr = curr->next;
-        free(old);
+/*
+PARALLEL LEXING
+
+No token spans a newline, and a '#' comment always ends at one, so right
+after a '\n' the lexer carries no state except the line number. The source is
+cut into chunks at the first newline after each nominal split point, chunks
+are lexed independently by worker threads pulling from a shared counter
+(line numbers relative to the chunk), and the results are concatenated with
+each chunk's lines shifted by the newline count of everything before it.
+A source with too few newlines simply ends up in fewer, larger chunks.
+*/
+
+#define PAR_MIN_CHUNK (256 * 1024)
+#define PAR_CHUNKS_PER_THREAD 4
+
+struct LexChunk {
+    int begin;
+    int end;
+    int newlines;
+    int ok;
+    struct TokenBuffer tokens;
+};
+
+struct LexJob {
+    const char* source;
+    struct LexChunk* chunks;
+    int n_chunks;
+    atomic_int next;
+};
+
+static void* lex_worker(void* arg) {
+    struct LexJob* job = arg;
+    for (;;) {
+        int i = atomic_fetch_add(&job->next, 1);
+        if (i >= job->n_chunks) break;
+        struct LexChunk* c = &job->chunks[i];
+        struct Lexer s = {
+            .source = job->source, .len = c->end,
+            .line = 1, .start = c->begin, .curr = c->begin
+        };
+        // ~3.3 bytes per token on the sample programs
+        tb_init(&c->tokens, (c->end - c->begin) / 3 + 16);
+        c->ok = lex_tokens(&s, &c->tokens);
+        c->newlines = s.line - 1;
+    }
+    return NULL;
+}
+
+struct TokenBuffer* scan_source_parallel(struct Lexer* s, int n_threads) {
+    long len = s->len - s->curr;
+    if (n_threads <= 1 || len < 2 * PAR_MIN_CHUNK)
+        return scan_source(s);
+
+    long chunk_len = len / (n_threads * PAR_CHUNKS_PER_THREAD);
+    if (chunk_len < PAR_MIN_CHUNK) chunk_len = PAR_MIN_CHUNK;
+    int max_chunks = len / chunk_len + 1;
+    struct LexChunk* chunks = calloc(max_chunks, sizeof(struct LexChunk));
+    int n_chunks = 0;
+    int begin = s->curr;
+    while (begin < s->len) {
+        long split = begin + chunk_len;
+        if (split >= s->len) {
+            split = s->len;
+        } else {
+            const char* nl = memchr(s->source + split, '\n', s->len - split);
+            split = nl ? nl - s->source + 1 : s->len;
+        }
+        chunks[n_chunks].begin = begin;
+        chunks[n_chunks].end = split;
+        n_chunks++;
+        begin = split;
+    }
+
+    struct LexJob job = {.source = s->source, .chunks = chunks, .n_chunks = n_chunks};
+    atomic_init(&job.next, 0);
+    int n_workers = n_threads < n_chunks ? n_threads : n_chunks;
+    pthread_t* workers = malloc(sizeof(pthread_t) * n_workers);
+    int spawned = 1;
+    for (; spawned < n_workers; spawned++) {
+        if (pthread_create(&workers[spawned], NULL, lex_worker, &job))
+            break; // the remaining workers pick up the slack
     }
+    lex_worker(&job);
+    for (int i = 1; i < spawned; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+
+    int total = 2;
+    for (int i = 0; i < n_chunks; i++) {
+        if (!chunks[i].ok) {
+            // let the serial lexer report it with the right line number
+            for (int j = 0; j < n_chunks; j++) free(chunks[j].tokens.tokens);
+            free(chunks);
+            return scan_source(s);
+        }
+        total += chunks[i].tokens.len;
+    }
+
+    struct TokenBuffer* tokens = malloc(sizeof(struct TokenBuffer));
+    tb_init(tokens, total);
+    tb_push(tokens, create_token(s, TOK_SOF).t);
+    for (int i = 0; i < n_chunks; i++) {
+        struct TokenBuffer* c = &chunks[i].tokens;
+        for (int j = 0; j < c->len; j++) {
+            struct Token t = c->tokens[j];
+            t.line += s->line - 1;
+            tokens->tokens[tokens->len++] = t;
+        }
+        s->line += chunks[i].newlines;
+        free(c->tokens);
+    }
+    free(chunks);
+    s->start = s->curr = s->len;
+    tb_push(tokens, create_token(s, TOK_EOF).t);
+    return tokens;
+}
+
+void tb_free(struct TokenBuffer* tb) {
+    if (!tb) return;
+    free(tb->tokens);
+    free(tb);
 }
\ No newline at end of file
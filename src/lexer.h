@@ -28,17 +28,20 @@ enum TokenType {
     TOK_SOF, TOK_EOF, TOK_NONE
 };
 
+// 20 bytes, stored by value in a TokenBuffer. Number literals are decoded
+// while lexing so the parser never has to look at the digits again.
 struct Token {
-    const char *str_type;
-    enum TokenType type;
     int str_start;
     int str_end;
     unsigned int line;
+    int value; // TOK_NUMBER only; -1 if the literal does not fit in an int
+    unsigned char type; // enum TokenType
 };
 
 enum OptTokenTag { // Overengineered to perfection!
     OPTIONAL_TOKEN_YES,
-    OPTIONAL_TOKEN_NO
+    OPTIONAL_TOKEN_NO,
+    OPTIONAL_TOKEN_ERR
 };
 
 struct OptionalToken {
@@ -46,16 +49,20 @@ struct OptionalToken {
     enum OptTokenTag e;
 };
 
-// Singly-linked list FTW! Totally no regrets!
-struct TokenList {
-    struct Token t;
-    struct TokenList *next;
+// linked list >>>>>>>>>>>>>>> dynamic array, except when it isn't
+struct TokenBuffer {
+    struct Token* tokens;
+    int len;
+    int cap;
 };
 
 // why use lexer generators when you can reinvent the wheel
 struct Lexer* lexer_init(const char* source, int len);
 void lexer_free(struct Lexer* ls);
-struct TokenList* scan_source(struct Lexer* s);
-void tl_free(struct TokenList* tl);
+struct TokenBuffer* scan_source(struct Lexer* s);
+// same tokens as scan_source, lexed in newline-aligned chunks on n_threads
+struct TokenBuffer* scan_source_parallel(struct Lexer* s, int n_threads);
+void tb_free(struct TokenBuffer* tb);
+const char* token_type_str(enum TokenType t);
 
 #endif
\ No newline at end of file
@@ -1,68 +1,328 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "source.h"
 #include "lexer.h"
 #include "parser.h"
 #include "ast.h"
+#include "arena.h"
 #include "stringt.h"
 #include "interpreter.h"
+#include "slab.h"
+#include "stack.h"
+#include "vm.h"
+#include "jit.h"
+#include "emitc.h"
+#include "strict.h"
+#include "flat.h"
+#include "lambc.h"
+#include "resolver.h"
 
-char *read_file_chars(FILE *f, long* len) {
-    if (f == NULL) 
-        return NULL;
-    fseek(f, 0, SEEK_END);
-    *len = ftell(f);
-    if (*len < 0) {
-        return NULL;
+// LAMB_STATS=1 prints per-phase wall time and peak RSS to stderr
+static int stats_enabled = 0;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double stats_phase(const char* phase, double since) {
+    double t = now_ms();
+    if (stats_enabled)
+        fprintf(stderr, "[stats] %-6s %10.3f ms\n", phase, t - since);
+    return t;
+}
+
+static void stats_peak_rss(void) {
+    if (!stats_enabled) return;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    fprintf(stderr, "[stats] peak rss %7.1f MB\n", ru.ru_maxrss / 1024.0);
+}
+
+static void stats_slab(struct Slab* s) {
+    if (!stats_enabled || !s || !s->n_allocs) return;
+    fprintf(stderr, "[stats] %-6s %10zu peak, %zu live, %zu allocs (%zu reused), %zu KB\n",
+            s->name, s->n_peak, s->n_live, s->n_allocs, s->n_reused, s->n_chunks * SLAB_CHUNK / 1024);
+    fprintf(stderr, "[stats] bytes  %10zu peak (%.1f per object at peak), %zu live\n",
+            s->bytes_peak, (double)s->bytes_peak / s->n_peak, s->bytes_live);
+}
+
+static void stats_gc(struct Gc* gc) {
+    if (!stats_enabled || !gc) return;
+    size_t n = gc->n_minor + gc->n_major;
+    fprintf(stderr, "[stats] gc     %10zu minor, %zu major, %.3f ms paused (%.3f ms max, %.3f ms mean)\n",
+            gc->n_minor, gc->n_major, gc->pause_ms, gc->max_pause_ms, n ? gc->pause_ms / n : 0.0);
+    fprintf(stderr, "[stats] heap   %10zu KB allocated, %zu KB promoted, %zu KB largest old space\n",
+            gc->bytes_allocated / 1024, gc->bytes_promoted / 1024, gc->peak_heap / 1024);
+}
+
+static void stats_vm(struct Vm* vm) {
+    if (!stats_enabled || !vm) return;
+    fprintf(stderr, "[stats] vm     %10zu fns compiled, %.1f KB code, %u frames peak\n",
+            vm->n_compiled, vm->code_bytes / 1024.0, vm->peak_frames);
+}
+
+static void stats_jit(struct Jit* jit) {
+    if (!stats_enabled || !jit) return;
+    fprintf(stderr, "[stats] jit    %10zu fns compiled, %.1f KB code, %zu did not fit\n",
+            jit->n_compiled, jit->cache_used / 1024.0, jit->n_full);
+}
+
+static void stats_stack(struct Stack* s) {
+    if (!stats_enabled || !s) return;
+    fprintf(stderr, "[stats] %-6s %10zu peak, %zu live, %zu allocs, %zu chunks\n",
+            s->name, s->n_peak, s->n_live, s->n_allocs, s->n_chunks);
+}
+
+// after interpret(): reference counting per eval step, the interpreter's
+// slabs and collector, then the interpreter
+static void stats_interpreter(struct Interpreter* state) {
+    if (stats_enabled && state->n_steps) {
+        size_t allocs = state->objects->n_allocs + state->frames->n_allocs;
+        fprintf(stderr, "[stats] steps  %10zu, per step %.3f dups, %.3f drops, %.3f allocs\n",
+                state->n_steps, (double)state->n_dups / state->n_steps,
+                (double)state->n_drops / state->n_steps, (double)allocs / state->n_steps);
     }
-    fseek(f, 0, SEEK_SET);
-    char *buffer = (char *) malloc(*len + 1);
-    fread(buffer, *len, 1, f);
-    buffer[*len] = '\0'; 
-    return buffer;
+    if (stats_enabled && state->lazy)
+        fprintf(stderr, "[stats] thunks %10zu made, %zu forced\n", state->n_thunks, state->n_forced);
+    stats_slab(state->objects);
+    stats_stack(state->frames);
+    stats_stack(state->conts);
+    stats_gc(state->gc);
+    stats_vm(state->vm);
+    stats_jit(state->jit);
+    interpreter_free(state);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <filename | ->\n", prog);
+    fprintf(stderr, "       %s compile [options] [-o out.lambc] <filename | ->\n", prog);
+    fprintf(stderr, "       %s run <file.lambc>\n", prog);
+    fprintf(stderr, "       %s emit-c [options] [-o out.c] <filename | ->\n", prog);
+    fprintf(stderr, "  --lex-threads N   lex sources over 512 KB on N threads\n");
+    fprintf(stderr, "  --lazy-parse      parse fn bodies on their first call\n");
+    fprintf(stderr, "  --no-arena        malloc each AST node instead of using an arena\n");
+    fprintf(stderr, "  --huge-pages      back the AST arena with 2 MB pages\n");
+    fprintf(stderr, "  --hash-cons       build identical subtrees once and share them\n");
+    fprintf(stderr, "  --no-ownership    count every reference rather than moving and borrowing\n");
+    fprintf(stderr, "  --vm              run as bytecode rather than walking the tree\n");
+    fprintf(stderr, "  --no-jit          never compile fns to machine code\n");
+    fprintf(stderr, "  --jit-threshold N calls of a fn before it is compiled (default %d)\n", JIT_THRESHOLD);
+    fprintf(stderr, "  --cek             walk the tree without recursing, calls in tail position in constant space\n");
+    fprintf(stderr, "  --lazy            call by need: evaluate arguments and let values when first needed\n");
+    fprintf(stderr, "  --compressed      hold captures as 32-bit cells (not with --gc)\n");
+    fprintf(stderr, "  --gc              collect garbage by copying instead of counting references\n");
+    fprintf(stderr, "  --gc-nursery KB   size of the --gc nursery (default %d)\n", GC_DEFAULT_NURSERY / 1024);
+    fprintf(stderr, "  --gc-heap KB      old generation size before the first major collection (default %d)\n", GC_DEFAULT_HEAP / 1024);
+    fprintf(stderr, "  --gc-growth N     old generation limit as a multiple of the live data (default %d)\n", GC_DEFAULT_GROWTH);
+}
+
+// evaluates a program saved by `lamb compile`, straight from the mapping,
+// with the options set in lambterpreter
+static int run_compiled(const char* path, struct Interpreter lambterpreter) {
+    double t = now_ms();
+    struct FlatProgram* prog = lambc_load(path);
+    if (!prog) return 1;
+    t = stats_phase("load", t);
+    lambterpreter.prog = prog;
+    interpret(&lambterpreter);
+    t = stats_phase("eval", t);
+    stats_interpreter(&lambterpreter);
+    stats_peak_rss();
+    flat_free(prog);
+    return 0;
+}
+
+// foo.code -> foo.lambc (or foo.c), anything else gets ext appended
+static char* default_output(const char* path, const char* ext) {
+    size_t len = strlen(path);
+    if (len > 5 && !strcmp(path + len - 5, ".code")) len -= 5;
+    char* out = malloc(len + strlen(ext) + 1);
+    memcpy(out, path, len);
+    strcpy(out + len, ext);
+    return out;
 }
 
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
+    enum { CMD_EVAL, CMD_COMPILE, CMD_RUN, CMD_EMIT_C } command = CMD_EVAL;
+    int first_arg = 1;
+    if (argc > 1 && !strcmp(argv[1], "compile")) {
+        command = CMD_COMPILE;
+        first_arg = 2;
+    } else if (argc > 1 && !strcmp(argv[1], "run")) {
+        command = CMD_RUN;
+        first_arg = 2;
+    } else if (argc > 1 && !strcmp(argv[1], "emit-c")) {
+        command = CMD_EMIT_C;
+        first_arg = 2;
+    }
+    const char* path = NULL;
+    const char* out_path = NULL;
+    int lex_threads = 1;
+    bool lazy_parse = false;
+    bool use_arena = true;
+    bool huge_pages = false;
+    bool hash_cons = false;
+    bool ownership = true;
+    struct Interpreter options = {.use_jit = true, .jit_threshold = JIT_THRESHOLD}; // the run-time flags
+    for (int i = first_arg; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc && (command == CMD_COMPILE || command == CMD_EMIT_C)) {
+            out_path = argv[++i];
+        } else if (!strcmp(argv[i], "--lex-threads") && i + 1 < argc) {
+            lex_threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--lazy-parse")) {
+            lazy_parse = true;
+        } else if (!strcmp(argv[i], "--no-arena")) {
+            use_arena = false;
+        } else if (!strcmp(argv[i], "--huge-pages")) {
+            huge_pages = true;
+        } else if (!strcmp(argv[i], "--hash-cons")) {
+            hash_cons = true;
+        } else if (!strcmp(argv[i], "--no-ownership")) {
+            ownership = false;
+        } else if (!strcmp(argv[i], "--vm")) {
+            options.use_vm = true;
+        } else if (!strcmp(argv[i], "--no-jit")) {
+            options.use_jit = false;
+        } else if (!strcmp(argv[i], "--jit-threshold") && i + 1 < argc) {
+            options.jit_threshold = (uint32_t)atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--lazy")) {
+            options.lazy = true;
+        } else if (!strcmp(argv[i], "--cek")) {
+            options.use_cek = true;
+        } else if (!strcmp(argv[i], "--compressed")) {
+            options.compressed = true;
+        } else if (!strcmp(argv[i], "--gc")) {
+            options.use_gc = true;
+        } else if (!strcmp(argv[i], "--gc-nursery") && i + 1 < argc) {
+            options.gc_config.nursery = (size_t)atol(argv[++i]) * 1024;
+        } else if (!strcmp(argv[i], "--gc-heap") && i + 1 < argc) {
+            options.gc_config.heap = (size_t)atol(argv[++i]) * 1024;
+        } else if (!strcmp(argv[i], "--gc-growth") && i + 1 < argc) {
+            options.gc_config.growth = (unsigned)atoi(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
         return 1;
     }
-    FILE *file = fopen(argv[1], "r");
-    if (!file) {
-        fprintf(stderr, "lamb: error: cannot find \"%s\"; No such file.\n",  argv[1]);
-        exit(1);
+    if (options.compressed && options.use_gc) {
+        fprintf(stderr, "lamb: err: --compressed does not work with --gc.\n");
+        return 1;
     }
-    long len = 0;
-    char *source = read_file_chars(file, &len);
-    if (!source) {
-        fprintf(stderr, "lamb: err: cannot read \"%s\"; Error reading files.\n", argv[1]);
-        fclose(file);
+    if (options.use_cek && options.use_vm) {
+        fprintf(stderr, "lamb: err: --cek does not work with --vm.\n");
+        return 1;
+    }
+    if (options.lazy && (options.use_gc || options.use_vm || options.use_cek || command != CMD_EVAL)) {
+        fprintf(stderr, "lamb: err: --lazy only works on the tree walker, without --gc.\n");
+        return 1;
+    }
+    if (options.lazy) lazy_parse = false; // flat_delay rewrites every body up front
+    stats_enabled = getenv("LAMB_STATS") != NULL;
+    if (command == CMD_RUN)
+        return run_compiled(path, options);
+    if (command == CMD_COMPILE || command == CMD_EMIT_C) {
+        if (!out_path && !strcmp(path, "-")) {
+            fprintf(stderr, "lamb: err: compiling stdin needs -o <file>.\n");
+            return 1;
+        }
+        lazy_parse = false; // every body goes into the file
+    }
+    double t = now_ms();
+    struct Source* src = source_open(path);
+    if (!src && errno == ENOENT) {
+        fprintf(stderr, "lamb: error: cannot find \"%s\"; No such file.\n",  path);
+        exit(1);
+    } else if (!src) {
+        fprintf(stderr, "lamb: err: cannot read \"%s\"; Error reading files.\n", path);
         exit(1);
     }
-    fclose(file);
-    file = NULL;
+    const char* source = src->chars;
+    t = stats_phase("load", t);
 
-    struct Lexer* lexer_state = lexer_init(source, len);
-    struct TokenList* tl = scan_source(lexer_state);
-    assert(tl); // EOF is included
+    struct Lexer* lexer_state = lexer_init(source, src->len);
+    struct TokenBuffer* tokens = lex_threads > 1
+        ? scan_source_parallel(lexer_state, lex_threads)
+        : scan_source(lexer_state);
+    assert(tokens->len); // EOF is included
     lexer_free(lexer_state);
     lexer_state = NULL;
+    t = stats_phase("lex", t);
     
-    struct Parser* parser_state = parser_init(tl, source);
+    struct Arena* ast_arena = use_arena ? arena_create(ARENA_DEFAULT_CHUNK, huge_pages) : NULL;
+    struct Parser* parser_state = parser_init(tokens, source, ast_arena);
+    parser_state->lazy_bodies = lazy_parse;
+    struct ASTCons* ast_cons = hash_cons ? ast_cons_create(!ast_arena) : NULL;
+    parser_state->alloc.cons = ast_cons;
     struct AST* ast = parse(parser_state);
+    t = stats_phase("parse", t);
 
-    struct Interpreter lambterpreter = {
-        .empty = NULL
-    };
-    interpret(&lambterpreter, ast);
+    struct FlatProgram* prog = flatten(ast);
+    if (options.lazy) flat_delay(prog);
+    t = stats_phase("flat", t);
+    bool resolved = resolve(prog, ownership);
+    t = stats_phase("scope", t);
+    if (options.lazy && resolved) {
+        strict_analyse(prog);
+        t = stats_phase("strict", t);
+    }
+    if (stats_enabled)
+        fprintf(stderr, "[stats] nodes  %10u (%.1f KB flat)\n", prog->n_nodes, flat_bytes(prog) / 1024.0);
+    if (stats_enabled && ast_cons)
+        fprintf(stderr, "[stats] shared %10zu of %zu made\n", ast_cons->n_shared, ast_cons->n_made);
+
+    int status = 0;
+    if (command == CMD_COMPILE || command == CMD_EMIT_C) {
+        char* default_path = out_path ? NULL : default_output(path, command == CMD_COMPILE ? ".lambc" : ".c");
+        if (ast->tag == AST_ERR) {
+            printf("%s\n", ast->u.err.error_message.b);
+            status = 1;
+        } else if (!resolved) {
+            status = 1;
+        } else if (command == CMD_COMPILE && !lambc_write(prog, out_path ? out_path : default_path, path, src)) {
+            status = 1;
+        } else if (command == CMD_EMIT_C && !emit_c(prog, out_path ? out_path : default_path, path)) {
+            status = 1;
+        }
+        free(default_path);
+        t = stats_phase("write", t);
+    } else if (!resolved) {
+        status = 1;
+    } else {
+        struct Interpreter lambterpreter = options;
+        lambterpreter.prog = prog;
+        interpret(&lambterpreter);
+        t = stats_phase("eval", t);
+        stats_interpreter(&lambterpreter);
+    }
+    stats_peak_rss();
 
-    tl_free(tl);
-    tl = NULL;
-    free_ast(ast);
+    tb_free(tokens);
+    tokens = NULL;
+    flat_free(prog);
+    prog = NULL;
+    if (ast_arena)
+        arena_free(ast_arena);
+    else
+        free_ast(ast);
+    ast_cons_free(ast_cons);
     ast = NULL;
     parser_free(parser_state);
-    free(source);
+    source_close(src);
     parser_state = NULL;
     source = NULL;
-    return 0;
+    return status;
 }   
\ No newline at end of file
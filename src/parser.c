@@ -1,15 +1,16 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
-#include <limits.h>
 #include "lexer.h"
 #include "parser.h"
+#include "symbol.h"
 
 static void debug_tokens(struct Parser* ps) {
     printf("tokens: ");
-    for (struct TokenList* curr = ps->tokens; curr; curr = curr->next) {
-        printf("%s ", curr->t.str_type);
+    for (int i = 0; i < ps->n_tokens; i++) {
+        printf("%s ", token_type_str(ps->tokens[i].type));
     }
     printf("\n");
 }
@@ -28,11 +29,11 @@ static struct String err_line_pref(unsigned int line, struct String msg) {
 }
 
 static struct Token ps_peek(struct Parser* ps) {
-    if (!ps->tokens) {
+    if (ps->curr >= ps->n_tokens) {
         fprintf(stderr, "Critical error: no tokens where EOF");
         exit(1);
     }
-    return ps->tokens->t;
+    return ps->tokens[ps->curr];
 } 
 
 static bool ps_is_done(struct Parser* ps) {
@@ -40,10 +41,7 @@ static bool ps_is_done(struct Parser* ps) {
 }
 
 static struct Token ps_advance(struct Parser* ps) {
-    struct Token tok = ps->tokens->t;
-    ps->prev = ps->tokens;
-    ps->tokens = ps->tokens->next;
-    return tok;
+    return ps->tokens[ps->curr++];
 }
 
 static bool ps_check(struct Parser* ps, enum TokenType t) {
@@ -60,343 +58,487 @@ static bool ps_match(struct Parser* ps, enum TokenType t) {
 }
 
 static struct Token ps_prev(struct Parser* ps) {
-    return ps->prev->t;
+    return ps->tokens[ps->curr - 1];
 }
 
-// Lambda calculus application, abstraction + successor 
-static struct AST* parse_unary(struct Parser* ps);
-static struct AST* parse_app(struct Parser* ps);
-static struct AST* parse_abs(struct Parser* ps);
-static struct AST* parse_expr(struct Parser* ps);
-static struct AST* parse_binding(struct Parser* ps);
-static struct AST* parse_cond(struct Parser* ps);
-static struct AST* parse_letrec(struct Parser* ps);
-
-static struct AST* parse_letrec(struct Parser* ps) {
-    // should've just used parse_binding but oh well
-    if (!ps_match(ps, TOK_LETREC)) { // should never be reached
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line, 
-                string_create("Expected 'letrec' keyword.")
-            )
-        );
-    }
-    if (!ps_match(ps, TOK_IDENTIFIER)) {
-        return make_err(
-            err_line_pref(
-                ps->prev->t.line, 
-                string_create("Expected identifier after 'letrec'.")
-            )
-        );
-    }
-    struct Token id_tok = ps_prev(ps);
-    struct String id_tok_str = string_ncreate(ps->src + id_tok.str_start, id_tok.str_end - id_tok.str_start);
-    struct AST* value = parse_expr(ps);
-    if (value->tag == AST_ERR) {
-        free_ast(value);
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line,
-                string_create("Expected valid <expr> to be bound after 'letrec ...'")
-            )
-        );
-    }
-    if (!ps_match(ps, TOK_IN)) {
-        return make_err(
-            err_line_pref(
-                ps->prev->t.line, 
-                string_create("Expected 'in' keyword.")
-            )
-        );
-    }
-    struct AST* expr = parse_expr(ps);
-    if (expr->tag == AST_ERR) {
-        free_ast(expr);
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line,
-                string_create("Expected valid <expr> in 'let ... = ... in <expr>.'")
-            )
-        );
-    }
-    return make_letrec(id_tok_str, value, expr);
+static struct AST* syntax_err(struct Parser* ps, unsigned int line, const char* msg) {
+    return make_err(&ps->alloc, err_line_pref(line, string_create(msg)));
 }
 
-static struct AST* parse_cond(struct Parser* ps) {
-    if (!ps_match(ps, TOK_IF)) {
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line, 
-                string_create("Expected 'if' keyword.")
-            )
-        );
-    } 
-    struct AST* cond = parse_expr(ps);
-    if (cond->tag == AST_ERR) {
-        free_ast(cond);
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line,
-                string_create("Expected valid <expr> after 'if'")
-            )
-        );
-    }
-    if (!ps_match(ps, TOK_THEN)) {
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line, 
-                string_create("Expected 'then' keyword.")
-            )
-        );
-    } 
-    struct AST* then_value = parse_expr(ps);
-    if (cond->tag == AST_ERR) {
-        free_ast(cond);
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line,
-                string_create("Expected valid <expr> after 'if' ... 'then'")
-            )
-        );
-    }
-    if (!ps_match(ps, TOK_ELSE)) {
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line, 
-                string_create("Expected 'else' keyword.")
-            )
-        );
-    }
-    struct AST* else_value = parse_expr(ps);
-    if (cond->tag == AST_ERR) {
-        free_ast(cond);
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line,
-                string_create("Expected valid <expr> after 'if' ... 'then' ...")
-            )
-        );
-    }
-    return make_cond(cond, then_value, else_value);
+// symbol of the identifier just matched (validation skips interning)
+static uint32_t ps_prev_sym(struct Parser* ps) {
+    if (!ps->build) return 0;
+    struct Token tok = ps_prev(ps);
+    return symbol_intern(ps->src + tok.str_start, tok.str_end - tok.str_start);
 }
 
-static struct AST* parse_binding(struct Parser* ps) {
-    if (!ps_match(ps, TOK_LET)) { // should never be reached
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line, 
-                string_create("Expected 'let' keyword.")
-            )
-        );
-    }
-    if (!ps_match(ps, TOK_IDENTIFIER)) {
-        return make_err(
-            err_line_pref(
-                ps->prev->t.line, 
-                string_create("Expected identifier after 'let'.")
-            )
-        );
+// Stands in for every successfully recognised sub-expression while
+// validating (ps->build unset); errors are still real AST_ERR nodes.
+static struct AST validated = {.tag = AST_NUM};
+#define BUILD(ps, node) ((ps)->build ? (node) : &validated)
+
+// drops a partial result on an error path; arena trees go all at once
+static void discard(struct Parser* ps, struct AST* ast) {
+    if (ast != &validated && !ps->alloc.arena) free_ast(ast);
+}
+
+/*
+LAZY FUNCTION BODIES
+
+With ps->lazy_bodies set, the body of a `fn` is not parsed: it becomes an
+AST_LAZY node holding its token range, found by matching brackets and
+let/in, if/then/else pairs. In a valid program a body always ends at the
+first `)`, `in`, `then` or `else` it did not open itself, or at EOF, so
+parse() validates the whole program first (building nothing) and only then
+skips. force_abs_body() parses the range on first use; nested bodies are
+lazy again.
+*/
+
+static int skip_body(struct Parser* ps, int i) {
+    int parens = 0, lets = 0, ifs = 0, thens = 0;
+    for (;; i++) {
+        switch (ps->tokens[i].type) {
+            case TOK_EOF:
+                return i;
+            case TOK_LEFT_PAREN:
+                parens++;
+                break;
+            case TOK_RIGHT_PAREN:
+                if (!parens) return i;
+                parens--;
+                break;
+            case TOK_LET:
+            case TOK_LETREC:
+                lets++;
+                break;
+            case TOK_IN:
+                if (!lets) return i;
+                lets--;
+                break;
+            case TOK_IF:
+                ifs++;
+                break;
+            case TOK_THEN:
+                if (!ifs) return i;
+                ifs--;
+                thens++;
+                break;
+            case TOK_ELSE:
+                if (!thens) return i;
+                thens--;
+                break;
+            default:
+                break;
+        }
     }
-    struct Token id_tok = ps_prev(ps);
-    struct String id_tok_str = string_ncreate(ps->src + id_tok.str_start, id_tok.str_end - id_tok.str_start);
-    struct AST* value = parse_expr(ps);
-    if (value->tag == AST_ERR) {
-        free_ast(value);
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line,
-                string_create("Expected valid <expr> to be bound after let ...'")
-            )
-        );
+}
+
+/*
+The grammar (see bnf.txt) is parsed by a loop over an explicit, heap
+allocated stack of continuations instead of by recursive descent, so a
+`let ... in let ... in` chain or a run of `+++...` is bounded by memory and
+not by the C stack. Each frame is what a parse_* function used to do after
+its recursive call returned: it receives the sub-result (or the error that
+aborted it) and either builds a node or asks for the next sub-expression.
+*/
+
+enum ParseGoal {
+    GOAL_EXPR,  // <expr>
+    GOAL_UNARY, // <unary>
+    GOAL_NONE   // a result is ready for the frame on top of the stack
+};
+
+enum FrameKind {
+    FRAME_ABS,        // fn id . <expr>
+    FRAME_LET_VALUE,  // let/letrec id . <expr> in <expr>
+    FRAME_LET_BODY,   // let/letrec id <expr> in . <expr>
+    FRAME_IF_COND,    // if . <expr> then <expr> else <expr>
+    FRAME_IF_THEN,    // if <expr> then . <expr> else <expr>
+    FRAME_IF_ELSE,    // if <expr> then <expr> else . <expr>
+    FRAME_PAREN,      // ( . <expr> )
+    FRAME_UNARY,      // op . <unary>
+    FRAME_APP_HEAD,   // . <unary> { ( <expr> ) }
+    FRAME_APP_ARG     // <unary> { ( <expr> ) } ( . <expr> )
+};
+
+struct ParseFrame {
+    enum FrameKind kind;
+    enum TokenType tok; // LET/LETREC or the unary operator
+    uint32_t id;        // symbol bound by fn, let or letrec
+    int name;           // the token of id
+    struct AST* a;      // value, cond, or the applied function
+    struct AST* b;      // then branch
+    int args_base;      // this application's arguments start here in args
+};
+
+struct ParseStack {
+    struct ParseFrame* frames;
+    int len;
+    int cap;
+    // arguments of the applications being parsed; the argument list is
+    // built back to front once the last one is in, so that no node is
+    // changed after it is made (which hash-consing relies on)
+    struct AST** args;
+    int n_args;
+    int cap_args;
+};
+
+static void push_arg(struct ParseStack* st, struct AST* arg) {
+    if (st->n_args == st->cap_args) {
+        st->cap_args = st->cap_args ? st->cap_args * 2 : 64;
+        st->args = realloc(st->args, sizeof(struct AST*) * st->cap_args);
+        if (!st->args) {
+            fprintf(stderr, "lamb: err: out of memory while parsing.\n");
+            exit(1);
+        }
     }
-    if (!ps_match(ps, TOK_IN)) {
-        return make_err(
-            err_line_pref(
-                ps->prev->t.line, 
-                string_create("Expected 'in' keyword.")
-            )
-        );
+    st->args[st->n_args++] = arg;
+}
+
+// drops the arguments collected for frame f
+static void discard_args(struct Parser* ps, struct ParseStack* st, struct ParseFrame* f) {
+    while (st->n_args > f->args_base)
+        discard(ps, st->args[--st->n_args]);
+}
+
+static struct ParseFrame* push_frame(struct ParseStack* st, enum FrameKind kind) {
+    if (st->len == st->cap) {
+        st->cap = st->cap ? st->cap * 2 : 64;
+        st->frames = realloc(st->frames, sizeof(struct ParseFrame) * st->cap);
+        if (!st->frames) {
+            fprintf(stderr, "lamb: err: out of memory while parsing.\n");
+            exit(1);
+        }
     }
-    struct AST* expr = parse_expr(ps);
-    if (expr->tag == AST_ERR) {
-        free_ast(expr);
-        return make_err(
-            err_line_pref(
-                ps->tokens->t.line,
-                string_create("Expected valid <expr> in 'let ... = ... in <expr>.'")
-            )
-        );
+    struct ParseFrame* f = &st->frames[st->len++];
+    *f = (struct ParseFrame) {.kind = kind};
+    return f;
+}
+
+// start on an <expr>: returns the goal for the next step, or sets *result
+static enum ParseGoal begin_expr(struct Parser* ps, struct ParseStack* st, struct AST** result) {
+    if (ps_match(ps, TOK_FN)) {
+        if (!ps_match(ps, TOK_IDENTIFIER)) {
+            *result = syntax_err(ps, ps_prev(ps).line, "Expected identifier after 'fn'.");
+            return GOAL_NONE;
+        }
+        if (ps->build && ps->lazy_bodies) {
+            uint32_t id = ps_prev_sym(ps);
+            int start = ps->curr;
+            ps->curr = skip_body(ps, start);
+            *result = make_abs(&ps->alloc, make_identifier(&ps->alloc, id), make_lazy(&ps->alloc, ps, start, ps->curr));
+            return GOAL_NONE;
+        }
+        struct ParseFrame* f = push_frame(st, FRAME_ABS);
+        f->id = ps_prev_sym(ps);
+        f->name = ps->curr - 1;
+        return GOAL_EXPR;
+    } else if (ps_check(ps, TOK_LET) || ps_check(ps, TOK_LETREC)) {
+        enum TokenType kw = ps_advance(ps).type;
+        if (!ps_match(ps, TOK_IDENTIFIER)) {
+            *result = syntax_err(ps, ps_prev(ps).line, kw == TOK_LET
+                ? "Expected identifier after 'let'."
+                : "Expected identifier after 'letrec'.");
+            return GOAL_NONE;
+        }
+        struct ParseFrame* f = push_frame(st, FRAME_LET_VALUE);
+        f->tok = kw;
+        f->id = ps_prev_sym(ps);
+        f->name = ps->curr - 1;
+        return GOAL_EXPR;
+    } else if (ps_match(ps, TOK_IF)) {
+        push_frame(st, FRAME_IF_COND);
+        return GOAL_EXPR;
     }
-    return make_binding(id_tok_str, value, expr);
+    push_frame(st, FRAME_APP_HEAD);
+    return GOAL_UNARY;
 }
 
-static struct AST* parse_unary(struct Parser* ps) {
+static enum ParseGoal begin_unary(struct Parser* ps, struct ParseStack* st, struct AST** result) {
     if (ps_match(ps, TOK_IDENTIFIER)) {
-        struct Token id_tok = ps_prev(ps);
-        struct String name = string_ncreate(
-            &ps->src[id_tok.str_start], id_tok.str_end - id_tok.str_start);
-        return make_identifier(name); 
+        *result = BUILD(ps, make_identifier(&ps->alloc, ps_prev_sym(ps)));
     } else if (ps_match(ps, TOK_NUMBER)) {
         struct Token num_tok = ps_prev(ps);
-        (void)num_tok;
-        struct String num_str = string_ncreate(
-            &ps->src[ps_prev(ps).str_start], ps_prev(ps).str_end - ps_prev(ps).str_start);
-        char* endptr;
-        long val = strtol(num_str.b, &endptr, 10);
-        if (*endptr != '\0' || val > INT_MAX) {
-            string_free(&num_str);
-            return make_err(
-                err_line_pref(
-                    ps_prev(ps).line,
-                    string_create("Invalid number literal.")
-                )
-            );
-        }
-        string_free(&num_str);
-        return make_num(val); //TODO Read number
+        if (num_tok.value < 0) // decoded by the lexer, -1 on overflow
+            *result = syntax_err(ps, num_tok.line, "Invalid number literal.");
+        else
+            *result = BUILD(ps, make_num(&ps->alloc, num_tok.value));
     } else if (ps_match(ps, TOK_LEFT_PAREN)) {
-        struct AST* expr = parse_expr(ps);
-        if (expr->tag == AST_ERR) return expr;
-        if (!ps_match(ps, TOK_RIGHT_PAREN)) {
-            free_ast(expr);
-            return make_err(
-                err_line_pref(
-                    ps->tokens->t.line, 
-                    string_create("Expected ')' after expression.")
-                )
-            );
-        }
-        return expr;
-    } else if (ps_match(ps, TOK_PLUS)) {
-        struct AST* inner = parse_unary(ps);
-        if (inner->tag == AST_ERR) return inner;
-        return make_succ(inner);
-    } else if (ps_match(ps, TOK_MINUS)) {
-        struct AST* inner = parse_unary(ps);
-        if (inner->tag == AST_ERR) return inner;
-        return make_dec(inner);
-    } else if (ps_match(ps, TOK_GEQ)) {
-        struct AST* inner = parse_unary(ps);
-        if (inner->tag == AST_ERR) return inner;
-        return make_neg(inner);
-    } else if (ps_match(ps, TOK_LEQ)) {
-        struct AST* inner = parse_unary(ps);
-        if (inner->tag == AST_ERR) return inner;
-        return make_pos(inner);
-    }
-    return make_err(
-        err_line_pref(
-            ps->tokens->t.line,
-            string_concat(
-                string_create("Unexpected token "), 
-                string_create(ps->tokens->t.str_type)
-            )
-        )
-    );
-}
-static struct AST* parse_expr(struct Parser* ps) {
-    if (!ps) return NULL;
-    if (!ps->tokens) return NULL; //
-    static struct AST* expr = NULL;
-    if (ps_check(ps, TOK_FN)) {
-        expr = parse_abs(ps);
-    } else if (ps_check(ps, TOK_LET)) {
-        expr = parse_binding(ps);
-    } else if (ps_check(ps, TOK_IF)) {
-        expr = parse_cond(ps);
-    } else if (ps_check(ps, TOK_LETREC)) {
-        expr = parse_letrec(ps);
+        push_frame(st, FRAME_PAREN);
+        return GOAL_EXPR;
+    } else if (ps_match(ps, TOK_PLUS) || ps_match(ps, TOK_MINUS)
+            || ps_match(ps, TOK_GEQ) || ps_match(ps, TOK_LEQ)) {
+        push_frame(st, FRAME_UNARY)->tok = ps_prev(ps).type;
+        return GOAL_UNARY;
     } else {
-        expr = parse_app(ps);
-    }
-    return expr;
-}
-
-static struct AST* parse_abs(struct Parser* ps) {
-    if (!ps_match(ps, TOK_FN)) {
-        return make_err(
+        *result = make_err(&ps->alloc,
             err_line_pref(
-                ps->tokens->t.line, 
-                string_create("Expected 'fn' keyword.")
+                ps_peek(ps).line,
+                string_concat(
+                    string_create("Unexpected token "),
+                    string_create(token_type_str(ps_peek(ps).type))
+                )
             )
         );
     }
-    if (!ps_match(ps, TOK_IDENTIFIER)) {
-        return make_err(
-            err_line_pref(
-                ps->prev->t.line, 
-                string_create("Expected identifier after 'fn'.")
-            )
-        );
+    return GOAL_NONE;
+}
 
+// Hands *result to the frame on top of the stack and pops it, unless the
+// frame needs another sub-expression, in which case it stays and the goal
+// for that sub-expression is returned.
+static enum ParseGoal resume_frame(struct Parser* ps, struct ParseStack* st, struct AST** result) {
+    struct ParseFrame* f = &st->frames[st->len - 1];
+    struct AST* r = *result;
+    bool err = r->tag == AST_ERR;
+    switch (f->kind) {
+        case FRAME_ABS:
+            if (err) break;
+            if (ps->binds) ps->binds[f->name] = (struct BindRange) {f->name + 1, ps->curr};
+            *result = BUILD(ps, make_abs(&ps->alloc, make_identifier(&ps->alloc, f->id), r));
+            break;
+        case FRAME_LET_VALUE:
+            if (err) {
+                discard(ps, r);
+                *result = syntax_err(ps, ps_peek(ps).line, f->tok == TOK_LET
+                    ? "Expected valid <expr> to be bound after let ...'"
+                    : "Expected valid <expr> to be bound after 'letrec ...'");
+                break;
+            }
+            if (!ps_match(ps, TOK_IN)) {
+                discard(ps, r);
+                *result = syntax_err(ps, ps_prev(ps).line, "Expected 'in' keyword.");
+                break;
+            }
+            // a let name is bound in the body only, a letrec name in both
+            if (ps->binds) ps->binds[f->name].from = f->tok == TOK_LET ? ps->curr : f->name + 1;
+            f->kind = FRAME_LET_BODY;
+            f->a = r;
+            return GOAL_EXPR;
+        case FRAME_LET_BODY:
+            if (err) {
+                discard(ps, r);
+                discard(ps, f->a);
+                *result = syntax_err(ps, ps_peek(ps).line,
+                    "Expected valid <expr> in 'let ... = ... in <expr>.'");
+                break;
+            }
+            if (ps->binds) ps->binds[f->name].to = ps->curr;
+            if (ps->build) {
+                *result = f->tok == TOK_LET
+                    ? make_binding(&ps->alloc, f->id, f->a, r)
+                    : make_letrec(&ps->alloc, f->id, f->a, r);
+            }
+            break;
+        case FRAME_IF_COND:
+        case FRAME_IF_THEN:
+        case FRAME_IF_ELSE:
+            if (err) {
+                discard(ps, r);
+                discard(ps, f->a);
+                discard(ps, f->b);
+                *result = syntax_err(ps, ps_peek(ps).line,
+                    f->kind == FRAME_IF_COND ? "Expected valid <expr> after 'if'"
+                    : f->kind == FRAME_IF_THEN ? "Expected valid <expr> after 'if' ... 'then'"
+                    : "Expected valid <expr> after 'if' ... 'then' ...");
+                break;
+            }
+            if (f->kind == FRAME_IF_ELSE) {
+                *result = BUILD(ps, make_cond(&ps->alloc, f->a, f->b, r));
+                break;
+            }
+            enum TokenType next_kw = f->kind == FRAME_IF_COND ? TOK_THEN : TOK_ELSE;
+            if (!ps_match(ps, next_kw)) {
+                discard(ps, r);
+                discard(ps, f->a);
+                *result = syntax_err(ps, ps_peek(ps).line, next_kw == TOK_THEN
+                    ? "Expected 'then' keyword."
+                    : "Expected 'else' keyword.");
+                break;
+            }
+            if (f->kind == FRAME_IF_COND) {
+                f->a = r;
+                f->kind = FRAME_IF_THEN;
+            } else {
+                f->b = r;
+                f->kind = FRAME_IF_ELSE;
+            }
+            return GOAL_EXPR;
+        case FRAME_PAREN:
+            if (!err && !ps_match(ps, TOK_RIGHT_PAREN)) {
+                discard(ps, r);
+                *result = syntax_err(ps, ps_peek(ps).line, "Expected ')' after expression.");
+            }
+            break;
+        case FRAME_UNARY:
+            if (err || !ps->build) break;
+            switch (f->tok) {
+                case TOK_PLUS: *result = make_succ(&ps->alloc, r); break;
+                case TOK_MINUS: *result = make_dec(&ps->alloc, r); break;
+                case TOK_GEQ: *result = make_neg(&ps->alloc, r); break;
+                default: *result = make_pos(&ps->alloc, r); break;
+            }
+            break;
+        case FRAME_APP_HEAD:
+            if (err || !ps_match(ps, TOK_LEFT_PAREN)) break;
+            f->kind = FRAME_APP_ARG;
+            f->a = r;
+            f->args_base = st->n_args;
+            return GOAL_EXPR;
+        case FRAME_APP_ARG:
+            if (err) {
+                discard(ps, f->a);
+                discard_args(ps, st, f);
+                break;
+            }
+            if (!ps_match(ps, TOK_RIGHT_PAREN)) {
+                discard(ps, r);
+                discard(ps, f->a);
+                discard_args(ps, st, f);
+                *result = syntax_err(ps, ps_prev(ps).line, "Expected ')' after application");
+                break;
+            }
+            if (ps->build) push_arg(st, r);
+            if (ps_match(ps, TOK_LEFT_PAREN))
+                return GOAL_EXPR;
+            if (ps->build) {
+                struct AST* alist = NULL;
+                while (st->n_args > f->args_base)
+                    alist = cons_alist(&ps->alloc, st->args[--st->n_args], alist);
+                *result = make_app(&ps->alloc, f->a, alist);
+            }
+            break;
     }
-    struct Token id_tok = ps_prev(ps);
-    struct String id_tok_str = string_ncreate(ps->src + id_tok.str_start, id_tok.str_end - id_tok.str_start);
-    struct AST* body = parse_expr(ps);
-    if (body->tag == AST_ERR) {
-        string_free(&id_tok_str);
-        return body; 
-    }
-    return make_abs(make_identifier(id_tok_str), body);
+    st->len--;
+    return GOAL_NONE;
 }
 
-static struct AST* parse_app(struct Parser *ps) {
-    struct AST* unary = parse_unary(ps);
-    if (unary->tag == AST_ERR) 
-        return unary;
-    if (ps_peek(ps).type != TOK_LEFT_PAREN) 
-        return unary;
-    struct AST* alist = cons_alist(NULL, NULL);
-    struct AST* curr = alist;
-    while (ps_match(ps, TOK_LEFT_PAREN)) {
-        struct AST* arg = parse_expr(ps);
-        if (arg->tag == AST_ERR) {
-            free_ast(unary);
-            free_ast(alist);
-            return arg;
-        }
-        if (!ps_match(ps, TOK_RIGHT_PAREN)) {
-            free_ast(unary);
-            free_ast(alist);
-            return make_err(
-                err_line_pref(
-                    ps->prev->t.line, 
-                    string_create("Expected ')' after application")
-                )
-            );
-        }
-        curr->u.app_list.arg = arg;
-        if (ps_peek(ps).type != TOK_LEFT_PAREN) break;
-        curr->u.app_list.next = cons_alist(NULL, NULL);
-        curr = curr->u.app_list.next;
+static struct AST* parse_expr(struct Parser* ps) {
+    struct ParseStack st = {NULL, 0, 0, NULL, 0, 0};
+    struct AST* result = NULL;
+    enum ParseGoal goal = GOAL_EXPR;
+    for (;;) {
+        if (goal == GOAL_EXPR)
+            goal = begin_expr(ps, &st, &result);
+        else if (goal == GOAL_UNARY)
+            goal = begin_unary(ps, &st, &result);
+        else if (st.len)
+            goal = resume_frame(ps, &st, &result);
+        else
+            break;
     }
-    return make_app(unary, alist);
+    free(st.frames);
+    free(st.args);
+    return result;
 }
 
-struct Parser* parser_init(struct TokenList* tv, const char* src) {
+struct Parser* parser_init(struct TokenBuffer* tb, const char* src, struct Arena* arena) {
     struct Parser* ps = malloc(sizeof(struct Parser));
+    ps->alloc = (struct ASTAlloc) {.arena = arena, .cons = NULL};
     ps->src = src;
-    ps->tokens = tv;
-    ps->prev = NULL;
+    ps->tokens = tb->tokens;
+    ps->n_tokens = tb->len;
+    ps->curr = 0;
+    ps->build = true;
+    ps->lazy_bodies = false;
+    ps->binds = NULL;
+    ps->n_bound = NULL;
+    ps->cap_bound = 0;
     return ps;
 }
 
 void parser_free(struct Parser* ps) {
+    free(ps->binds);
+    free(ps->n_bound);
     free(ps);
 }
 
-struct AST* parse(struct Parser* ps) {
+static struct AST* parse_program(struct Parser* ps) {
+    ps->curr = 0;
     ps_advance(ps);
     struct AST* program = parse_expr(ps);
     if (!ps_is_done(ps)) {
-        free_ast(program);
-        return make_err(
+        discard(ps, program);
+        return make_err(&ps->alloc,
             err_line_pref(
-                ps->tokens->t.line, 
+                ps_peek(ps).line, 
                 string_create("Expected EOF, but received tokens after program end.")
             )
         );
     }
     return program;
-}
\ No newline at end of file
+}
+
+struct AST* parse(struct Parser* ps) {
+    if (ps->lazy_bodies) {
+        free(ps->binds);
+        ps->binds = calloc(ps->n_tokens, sizeof(struct BindRange));
+        if (!ps->binds) {
+            fprintf(stderr, "lamb: err: out of memory while parsing.\n");
+            exit(1);
+        }
+        ps->build = false;
+        struct AST* checked = parse_program(ps);
+        ps->build = true;
+        if (checked != &validated)
+            return checked;
+    }
+    return parse_program(ps);
+}
+
+static uint32_t token_sym(struct Parser* ps, int i) {
+    struct Token tok = ps->tokens[i];
+    return symbol_intern(ps->src + tok.str_start, tok.str_end - tok.str_start);
+}
+
+// The bindings within the range nest, so those still open when a token is
+// reached form a stack, and ps->n_bound counts, by symbol, those of them in
+// scope there: a name is free where its count is 0.
+void lazy_names(struct AST* lazy, void (*each)(void* ctx, uint32_t sym), void* ctx) {
+    struct Parser* ps = lazy->u.lazy.parser;
+    const struct BindRange* binds = ps->binds;
+    int* open = NULL;
+    int n_open = 0, cap_open = 0;
+    for (int i = lazy->u.lazy.start; i <= lazy->u.lazy.end; i++) {
+        while (n_open && (i == lazy->u.lazy.end || binds[open[n_open - 1]].to <= i))
+            ps->n_bound[token_sym(ps, open[--n_open])]--;
+        if (i == lazy->u.lazy.end) break;
+        // a let name comes into scope only after its value
+        if (n_open && binds[open[n_open - 1]].from == i)
+            ps->n_bound[token_sym(ps, open[n_open - 1])]++;
+        if (ps->tokens[i].type != TOK_IDENTIFIER) continue;
+        uint32_t sym = token_sym(ps, i);
+        if (binds[i].to) {
+            if (n_open == cap_open) {
+                cap_open = cap_open ? cap_open * 2 : 16;
+                open = realloc(open, sizeof(int) * cap_open);
+            }
+            if (sym >= ps->cap_bound) {
+                uint32_t cap = ps->cap_bound ? ps->cap_bound : 64;
+                while (cap <= sym) cap *= 2;
+                ps->n_bound = realloc(ps->n_bound, sizeof(uint32_t) * cap);
+                if (ps->n_bound) memset(ps->n_bound + ps->cap_bound, 0, sizeof(uint32_t) * (cap - ps->cap_bound));
+                ps->cap_bound = cap;
+            }
+            if (!open || !ps->n_bound) {
+                fprintf(stderr, "lamb: err: out of memory while parsing.\n");
+                exit(1);
+            }
+            open[n_open++] = i;
+        } else if (sym >= ps->cap_bound || !ps->n_bound[sym]) {
+            each(ctx, sym);
+        }
+    }
+    free(open);
+}
+
+void force_abs_body(struct AST* abs) {
+    struct AST* lazy = abs->u.abs.body;
+    if (lazy->tag != AST_LAZY) return;
+    struct Parser* ps = lazy->u.lazy.parser;
+    ps->curr = lazy->u.lazy.start;
+    struct AST* body = parse_expr(ps);
+    assert(body->tag == AST_ERR || ps->curr == lazy->u.lazy.end);
+    abs->u.abs.body = body;
+    if (!ps->alloc.arena) free_ast(lazy);
+}
@@ -1,17 +1,42 @@
 #ifndef LAMB_PARSER_H
 #define LAMB_PARSER_H
 #include "lexer.h"
+#include <stdint.h>
+#include <stdbool.h>
 #include "ast.h"
 // recursive descent parser
 
+// the tokens [from, to) that a fn, let or letrec binds its name over
+struct BindRange {
+    int from;
+    int to;
+};
+
 struct Parser {
-    struct TokenList* tokens; 
-    struct TokenList* prev; // what happens if you use a singly-linked list
+    const struct Token* tokens;
+    int n_tokens;
+    int curr; // index of the next unconsumed token
     const char* src;
+    struct ASTAlloc alloc; // where nodes and names go; no arena for malloc
+    bool build;        // false while only validating
+    bool lazy_bodies;  // leave fn bodies as AST_LAZY until force_abs_body
+    // with lazy_bodies, by the token naming a binding (to is 0 elsewhere);
+    // filled by the validation pass
+    struct BindRange* binds;
+    uint32_t* n_bound; // lazy_names: by symbol, the bindings in scope
+    uint32_t cap_bound;
 };
 
 struct AST* parse(struct Parser* parser_state);
-struct Parser* parser_init(struct TokenList* tv, const char* src);
+// The AST is owned by arena if one is given: free it with arena_free after
+// the last use instead of free_ast. Set alloc.cons to share equal subtrees.
+struct Parser* parser_init(struct TokenBuffer* tb, const char* src, struct Arena* arena);
 void parser_free(struct Parser* ps);
+// Parses an AST_LAZY body of abs in place. The parser, its tokens and the
+// source must outlive the AST when lazy_bodies is set.
+void force_abs_body(struct AST* abs);
+// calls each on every name in the token range of an AST_LAZY that is not
+// bound there, repeats included: the body's free names
+void lazy_names(struct AST* lazy, void (*each)(void* ctx, uint32_t sym), void* ctx);
 
 #endif
\ No newline at end of file
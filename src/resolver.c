@@ -0,0 +1,621 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resolver.h"
+#include "arena.h"
+#include "symbol.h"
+#include "parser.h"
+
+#define GROW(arr, n, cap) do { \
+    if ((n) == (cap)) { \
+        (cap) = (cap) ? (cap) * 2 : 64; \
+        (arr) = realloc((arr), sizeof(*(arr)) * (cap)); \
+        if (!(arr)) { \
+            fprintf(stderr, "lamb: err: out of memory (resolve).\n"); \
+            exit(1); \
+        } \
+    } \
+} while (0)
+
+#define MAX_SLOT ((1u << 24) - 1) // FlatNode.slot is 24 bits
+#define NEW_RECORD UINT32_MAX
+
+// One binding. The chain of them is the scope; it is never freed before the
+// resolver, as bodies parsed on their first call are resolved in it later.
+struct Scope {
+    uint32_t sym;
+    uint32_t level; // frame, counting from the top level
+    uint32_t slot;
+    struct Scope* prev;     // next binding out
+    struct Scope* shadowed; // binding of sym this one hides
+};
+
+// a binding from outside a fn that its closure copies, and from where
+struct Capture {
+    struct Scope* scope;
+    uint32_t from; // address in the enclosing frame
+};
+
+// a fn being resolved
+struct Level {
+    uint32_t next_slot;
+    struct Scope* self; // the letrec name this fn is bound to, if any
+    struct Capture* caps;
+    uint32_t n_caps, cap_caps;
+};
+
+// what resolving an unparsed body later needs of the scope it appeared in
+struct LazyScope {
+    struct Scope* chain;
+    uint32_t level;
+    struct Scope* self;
+    struct Capture* caps;
+    uint32_t n_caps;
+};
+
+enum ResolveOp {
+    R_VISIT,
+    R_BIND,  // a let's value is done: bind its name
+    R_FINISH // children are done: settle the node
+};
+
+// the ownership walk (see OWNERSHIP), on the same stack
+enum OwnOp {
+    O_VISIT,
+    O_LIVE,   // a borrowed fn: its slot is read at the call
+    O_BRANCH, // an if's branches: entering the else branch,
+    O_SWITCH, // leaving it for the then branch,
+    O_JOIN    // and leaving that
+};
+
+struct ResolveItem {
+    uint32_t op;
+    uint32_t node;
+    // R_VISIT: 1 for the fn of a letrec; R_FINISH: the slot of a let/letrec;
+    // R_BIND: where its R_FINISH is; O_LIVE: the slot
+    uint32_t slot;
+};
+
+struct Resolver {
+    struct Arena* arena; // of Scopes and LazyScope captures
+    struct Scope* chain;
+    struct Scope** top;  // innermost binding of each symbol
+    uint32_t cap_top;
+    bool in_body;        // resolving a forced body; top is stale, walk chain
+    uint32_t level;
+    uint32_t floor;      // level of the forced body's fn, whose captures are fixed
+    struct Level* levels;
+    uint32_t cap_levels;
+    uint8_t* done;       // by node: resolved, maybe from another place
+    uint32_t cap_done;
+    struct LazyScope* lazies; // by lazy slot
+    uint32_t cap_lazies;
+    struct ResolveItem* items;
+    uint32_t n_items, cap_items;
+    uint32_t* results;   // resolved nodes of finished children
+    uint32_t n_results, cap_results;
+    uint32_t* record;    // closure record being built
+    uint32_t cap_record;
+    uint8_t* reported;   // by symbol
+    uint32_t cap_reported;
+    uint32_t n_unbound;
+    bool ownership;
+    uint8_t* owned;      // by node: walked for ownership
+    uint32_t cap_owned;
+    uint8_t* later;      // by slot of the frame being walked: read later
+    uint32_t cap_later;
+    uint32_t* flips;     // slots whose later was set, in order
+    uint32_t n_flips, cap_flips;
+    uint32_t* marks;     // positions in flips where open branches start
+    uint32_t n_marks, cap_marks;
+    uint32_t* bodies;    // fns whose bodies are still to be walked
+    uint32_t n_bodies, cap_bodies;
+};
+
+// a zero-filled array indexed up to at least i
+static void* fit(void* arr, uint32_t* cap, uint32_t i, size_t size) {
+    if (i < *cap) return arr;
+    uint32_t old = *cap, n = old ? old : 64;
+    while (n <= i) n *= 2;
+    arr = realloc(arr, size * n);
+    if (!arr) {
+        fprintf(stderr, "lamb: err: out of memory (resolve).\n");
+        exit(1);
+    }
+    memset((char*)arr + size * old, 0, size * (n - old));
+    *cap = n;
+    return arr;
+}
+
+static void push(struct Resolver* r, enum ResolveOp op, uint32_t node, uint32_t slot) {
+    GROW(r->items, r->n_items, r->cap_items);
+    r->items[r->n_items++] = (struct ResolveItem) {op, node, slot};
+}
+
+static void push_own(struct Resolver* r, enum OwnOp op, uint32_t node, uint32_t slot) {
+    GROW(r->items, r->n_items, r->cap_items);
+    r->items[r->n_items++] = (struct ResolveItem) {op, node, slot};
+}
+
+static void push_result(struct Resolver* r, uint32_t node) {
+    GROW(r->results, r->n_results, r->cap_results);
+    r->results[r->n_results++] = node;
+}
+
+static void bind(struct Resolver* r, uint32_t sym, uint32_t slot) {
+    struct Scope* s = arena_alloc(r->arena, sizeof(struct Scope));
+    *s = (struct Scope) {sym, r->level, slot, r->chain, NULL};
+    if (!r->in_body) {
+        r->top = fit(r->top, &r->cap_top, sym, sizeof(struct Scope*));
+        s->shadowed = r->top[sym];
+        r->top[sym] = s;
+    }
+    r->chain = s;
+}
+
+static void unbind(struct Resolver* r) {
+    struct Scope* s = r->chain;
+    if (!r->in_body) r->top[s->sym] = s->shadowed;
+    r->chain = s->prev;
+}
+
+static struct Scope* lookup(struct Resolver* r, uint32_t sym) {
+    if (!r->in_body) return sym < r->cap_top ? r->top[sym] : NULL;
+    struct Scope* s = r->chain;
+    while (s && s->sym != sym) s = s->prev;
+    return s;
+}
+
+static uint32_t new_slot(struct Resolver* r) {
+    uint32_t slot = r->levels[r->level].next_slot++;
+    if (slot > MAX_SLOT) {
+        fprintf(stderr, "lamb: err: too many bindings in one fn body.\n");
+        exit(1);
+    }
+    return slot;
+}
+
+static void enter_fn(struct Resolver* r, uint32_t param, struct Scope* self) {
+    r->level++;
+    r->levels = fit(r->levels, &r->cap_levels, r->level, sizeof(struct Level));
+    struct Level* l = &r->levels[r->level];
+    l->next_slot = 1;
+    l->self = self;
+    l->n_caps = 0;
+    bind(r, param, 0);
+}
+
+// the capture of s by the fn at level, added if new
+static uint32_t capture(struct Resolver* r, uint32_t level, struct Scope* s, uint32_t from) {
+    struct Level* l = &r->levels[level];
+    for (uint32_t i = 0; i < l->n_caps; i++) {
+        if (l->caps[i].scope == s) return ADDR_CAPTURED | i;
+    }
+    if (level == r->floor) return RESOLVE_UNBOUND; // not in the token range; cannot happen
+    if (l->n_caps == ADDR_MOVE) {
+        fprintf(stderr, "lamb: err: too many names captured by one fn.\n");
+        exit(1);
+    }
+    GROW(l->caps, l->n_caps, l->cap_caps);
+    l->caps[l->n_caps] = (struct Capture) {s, from};
+    return ADDR_CAPTURED | l->n_caps++;
+}
+
+// where the current fn finds binding s, capturing it into every fn between
+// the two that does not have it yet
+static uint32_t address(struct Resolver* r, struct Scope* s) {
+    uint32_t k = s->level, addr = ADDR_LOCAL | s->slot;
+    if (k < r->floor) {
+        k = r->floor;
+        addr = r->levels[k].self == s ? ADDR_SELF : capture(r, k, s, 0);
+    }
+    while (k < r->level && addr != RESOLVE_UNBOUND) {
+        k++;
+        addr = r->levels[k].self == s ? ADDR_SELF : capture(r, k, s, addr);
+    }
+    return addr;
+}
+
+static void unbound(struct Resolver* r, uint32_t sym) {
+    if (r->in_body) return;
+    r->reported = fit(r->reported, &r->cap_reported, sym, 1);
+    if (r->reported[sym]) return;
+    r->reported[sym] = 1;
+    r->n_unbound++;
+    printf("name error: attempted to use an undefined name: %s\n", symbol_name(sym).b);
+}
+
+// lazy_names callback: a name free in an unparsed body, whose binding the
+// fn must capture in case the body is run; with none it is reported now, as
+// it would be were the body parsed
+static void capture_name(void* ctx, uint32_t sym) {
+    struct Resolver* r = ctx;
+    struct Scope* s = lookup(r, sym);
+    if (!s) unbound(r, sym);
+    else if (s->level < r->level) address(r, s);
+}
+
+static uint32_t append(uint32_t** arr, uint32_t* n, uint32_t* cap, const uint32_t* words, uint32_t count) {
+    uint32_t at = *n;
+    for (uint32_t i = 0; i < count; i++) {
+        GROW(*arr, *n, *cap);
+        (*arr)[(*n)++] = words[i];
+    }
+    return at;
+}
+
+// The node to use for n resolved as want (and side, the arguments of an
+// AST_APP or the closure record of an AST_ABS): n itself the first time, or
+// if it was already resolved the same way from somewhere else; otherwise a
+// copy, as n is shared with a different scope.
+static uint32_t settle(struct Resolver* r, struct FlatProgram* p, uint32_t n,
+                       struct FlatNode want, const uint32_t* side) {
+    uint32_t n_side = want.tag == AST_APP ? want.c : want.tag == AST_ABS ? 2 + side[1] : 0;
+    r->done = fit(r->done, &r->cap_done, n, 1);
+    if (r->done[n]) {
+        struct FlatNode have = p->nodes[n];
+        if (want.tag == AST_ABS) {
+            const uint32_t* rec = p->closures + have.c;
+            if (rec[1] == side[1] && !memcmp(rec, side, sizeof(uint32_t) * n_side)) want.c = have.c;
+        }
+        if (have.slot == want.slot && have.a == want.a && have.b == want.b && have.c == want.c
+                && (want.tag != AST_APP || !memcmp(p->args + have.b, side, sizeof(uint32_t) * n_side)))
+            return n;
+        if (want.tag == AST_APP) want.b = append(&p->args, &p->n_args, &p->cap_args, side, n_side);
+        GROW(p->nodes, p->n_nodes, p->cap_nodes);
+        n = p->n_nodes++;
+        r->done = fit(r->done, &r->cap_done, n, 1);
+    } else if (want.tag == AST_APP && n_side) {
+        memcpy(p->args + want.b, side, sizeof(uint32_t) * n_side);
+    }
+    if (want.tag == AST_ABS && want.c == NEW_RECORD)
+        want.c = append(&p->closures, &p->n_closures, &p->cap_closures, side, n_side);
+    p->nodes[n] = want;
+    r->done[n] = 1;
+    return n;
+}
+
+static void visit(struct Resolver* r, struct FlatProgram* p, struct ResolveItem it) {
+    uint32_t node = it.node;
+    struct FlatNode n = p->nodes[node];
+    uint32_t slot;
+    // children are pushed last-first, after the R_FINISH that collects them
+    switch (n.tag) {
+        case AST_ABS:
+            enter_fn(r, n.a, it.slot ? r->chain : NULL);
+            push(r, R_FINISH, node, 0);
+            push(r, R_VISIT, n.b, 0);
+            break;
+        case AST_APP:
+            push(r, R_FINISH, node, 0);
+            for (uint32_t i = n.c; i > 0; i--) push(r, R_VISIT, p->args[n.b + i - 1], 0);
+            push(r, R_VISIT, n.a, 0);
+            break;
+        case AST_SUCC:
+        case AST_DEC:
+        case AST_POS:
+        case AST_NEG:
+            push(r, R_FINISH, node, 0);
+            push(r, R_VISIT, n.a, 0);
+            break;
+        case AST_LET_IN:
+            // the name is only bound in the body
+            push(r, R_FINISH, node, 0);
+            push(r, R_VISIT, n.c, 0);
+            push(r, R_BIND, node, r->n_items - 2);
+            push(r, R_VISIT, n.b, 0);
+            break;
+        case AST_LETREC: {
+            // a value other than a fn (a thunk is not one) still sees the
+            // name's outer binding, if there is one, as it did before slots
+            bool fn = p->nodes[n.b].tag == AST_ABS && !(p->nodes[n.b].slot & ABS_THUNK);
+            if (!fn && lookup(r, n.a)) {
+                push(r, R_FINISH, node, 0);
+                push(r, R_VISIT, n.c, 0);
+                push(r, R_BIND, node, r->n_items - 2);
+                push(r, R_VISIT, n.b, 0);
+                break;
+            }
+            slot = new_slot(r);
+            bind(r, n.a, slot);
+            push(r, R_FINISH, node, slot);
+            push(r, R_VISIT, n.c, 0);
+            push(r, R_VISIT, n.b, fn);
+            break;
+        }
+        case AST_IF_ELSE:
+            push(r, R_FINISH, node, 0);
+            push(r, R_VISIT, n.c, 0);
+            push(r, R_VISIT, n.b, 0);
+            push(r, R_VISIT, n.a, 0);
+            break;
+        case AST_IDENTIFIER: {
+            struct Scope* s = lookup(r, n.a);
+            n.b = s ? address(r, s) : RESOLVE_UNBOUND;
+            n.c = 0;
+            if (!s) unbound(r, n.a);
+            push_result(r, settle(r, p, node, n, NULL));
+            break;
+        }
+        case AST_LAZY: {
+            // the fn's captures have to be known before its body is parsed
+            lazy_names(p->lazy[n.a]->u.abs.body, capture_name, r);
+            struct Level* l = &r->levels[r->level];
+            r->lazies = fit(r->lazies, &r->cap_lazies, n.a, sizeof(struct LazyScope));
+            struct LazyScope* ls = &r->lazies[n.a];
+            *ls = (struct LazyScope) {r->chain, r->level, l->self, NULL, l->n_caps};
+            if (l->n_caps) {
+                ls->caps = arena_alloc(r->arena, sizeof(struct Capture) * l->n_caps);
+                memcpy(ls->caps, l->caps, sizeof(struct Capture) * l->n_caps);
+            }
+            push_result(r, node);
+            break;
+        }
+        default:
+            push_result(r, node); // AST_NUM, AST_ERR
+    }
+}
+
+static void finish(struct Resolver* r, struct FlatProgram* p, struct ResolveItem it) {
+    struct FlatNode n = p->nodes[it.node];
+    uint32_t n_kids;
+    switch (n.tag) {
+        case AST_APP: n_kids = 1 + n.c; break;
+        case AST_LET_IN: case AST_LETREC: n_kids = 2; break;
+        case AST_IF_ELSE: n_kids = 3; break;
+        default: n_kids = 1;
+    }
+    r->n_results -= n_kids;
+    uint32_t* kids = r->results + r->n_results;
+    const uint32_t* side = kids + 1;
+    struct Level* l;
+    switch (n.tag) {
+        case AST_ABS:
+            l = &r->levels[r->level];
+            r->record = fit(r->record, &r->cap_record, 2 + l->n_caps, sizeof(uint32_t));
+            r->record[0] = l->next_slot;
+            r->record[1] = l->n_caps;
+            for (uint32_t i = 0; i < l->n_caps; i++) r->record[2 + i] = l->caps[i].from;
+            side = r->record;
+            n.b = kids[0];
+            n.c = NEW_RECORD;
+            unbind(r);
+            r->level--;
+            break;
+        case AST_APP:
+            n.a = kids[0];
+            break;
+        case AST_LET_IN:
+        case AST_LETREC:
+            n.slot = it.slot;
+            n.b = kids[0];
+            n.c = kids[1];
+            unbind(r);
+            break;
+        case AST_IF_ELSE:
+            n.a = kids[0];
+            n.b = kids[1];
+            n.c = kids[2];
+            break;
+        default:
+            n.a = kids[0];
+    }
+    uint32_t resolved = settle(r, p, it.node, n, side);
+    push_result(r, resolved);
+}
+
+static uint32_t resolve_from(struct Resolver* r, struct FlatProgram* p, uint32_t root) {
+    push(r, R_VISIT, root, 0);
+    while (r->n_items) {
+        struct ResolveItem it = r->items[--r->n_items];
+        uint32_t slot;
+        switch (it.op) {
+            case R_VISIT:
+                visit(r, p, it);
+                break;
+            case R_BIND:
+                slot = new_slot(r);
+                bind(r, p->nodes[it.node].a, slot);
+                r->items[it.slot].slot = slot;
+                break;
+            case R_FINISH:
+                finish(r, p, it);
+                break;
+        }
+    }
+    return r->results[--r->n_results];
+}
+
+/*
+OWNERSHIP
+
+A frame is walked backward from the end of its evaluation, keeping track
+of the slots read later on. A read of a slot not read later is its last,
+and moves. The branches of an if both start from the state after the if
+and join by union: what the else branch set is undone for the then branch
+and set again after it. The order here has to be the evaluator's: an
+application with one argument evaluates it before the fn, one with more
+evaluates the fn first. A borrowed fn is read at its (first) call, after
+the first argument. Fn bodies are frames of their own, walked after the
+frame they appear in.
+
+A node shared by hash-consing can be reached from several places, and in
+several frames. Its flags are set the first time it is walked and only
+cleared after, so they hold in every place.
+*/
+
+// true if this is the last read of slot
+static bool read_slot(struct Resolver* r, uint32_t slot) {
+    if (r->later[slot]) return false;
+    r->later[slot] = 1;
+    GROW(r->flips, r->n_flips, r->cap_flips);
+    r->flips[r->n_flips++] = slot;
+    return true;
+}
+
+static void mark_move(struct Resolver* r, uint32_t* addr, bool first) {
+    if (ADDR_KIND(*addr) != ADDR_LOCAL) return;
+    bool last = read_slot(r, ADDR_INDEX(*addr));
+    if (last && first) *addr |= ADDR_MOVE;
+    else if (!last) *addr &= ~ADDR_MOVE;
+}
+
+// pushes the parts of node that it evaluates, first-evaluated first, so
+// that the last is walked first
+static void own_visit(struct Resolver* r, struct FlatProgram* p, uint32_t node) {
+    r->owned = fit(r->owned, &r->cap_owned, node, 1);
+    bool first = !r->owned[node];
+    r->owned[node] = 1;
+    struct FlatNode* n = &p->nodes[node];
+    uint32_t* rec;
+    struct FlatNode fn;
+    bool borrow;
+    switch (n->tag) {
+        case AST_IDENTIFIER:
+            mark_move(r, &n->b, first);
+            break;
+        case AST_ABS:
+            rec = p->closures + n->c;
+            for (uint32_t i = 0; i < rec[1]; i++) mark_move(r, &rec[2 + i], first);
+            if (first && p->nodes[n->b].tag != AST_LAZY) { // else walked once parsed
+                GROW(r->bodies, r->n_bodies, r->cap_bodies);
+                r->bodies[r->n_bodies++] = node;
+            }
+            break;
+        case AST_APP:
+            if (!n->c) {
+                push_own(r, O_VISIT, n->a, 0);
+                break;
+            }
+            fn = p->nodes[n->a];
+            borrow = fn.tag == AST_IDENTIFIER && fn.b != RESOLVE_UNBOUND;
+            n->slot = borrow ? APP_BORROW : 0;
+            if (n->c > 1 && !borrow) push_own(r, O_VISIT, n->a, 0);
+            push_own(r, O_VISIT, p->args[n->b], 0);
+            if (borrow && ADDR_KIND(fn.b) == ADDR_LOCAL) push_own(r, O_LIVE, 0, ADDR_INDEX(fn.b));
+            if (n->c == 1 && !borrow) push_own(r, O_VISIT, n->a, 0);
+            for (uint32_t i = 1; i < n->c; i++) push_own(r, O_VISIT, p->args[n->b + i], 0);
+            break;
+        case AST_SUCC:
+        case AST_DEC:
+        case AST_POS:
+        case AST_NEG:
+            push_own(r, O_VISIT, n->a, 0);
+            break;
+        case AST_LET_IN:
+        case AST_LETREC:
+            push_own(r, O_VISIT, n->b, 0);
+            push_own(r, O_VISIT, n->c, 0);
+            break;
+        case AST_IF_ELSE:
+            push_own(r, O_VISIT, n->a, 0);
+            push_own(r, O_JOIN, 0, 0);
+            push_own(r, O_VISIT, n->b, 0);
+            push_own(r, O_SWITCH, 0, 0);
+            push_own(r, O_VISIT, n->c, 0);
+            push_own(r, O_BRANCH, 0, 0);
+            break;
+        default:
+            break; // AST_NUM, AST_ERR, AST_LAZY
+    }
+}
+
+static void own_frame(struct Resolver* r, struct FlatProgram* p, uint32_t body, uint32_t n_slots) {
+    r->later = fit(r->later, &r->cap_later, n_slots, 1);
+    push_own(r, O_VISIT, body, 0);
+    while (r->n_items) {
+        struct ResolveItem it = r->items[--r->n_items];
+        uint32_t from, to;
+        switch (it.op) {
+            case O_VISIT:
+                own_visit(r, p, it.node);
+                break;
+            case O_LIVE:
+                read_slot(r, it.slot);
+                break;
+            case O_BRANCH:
+                GROW(r->marks, r->n_marks, r->cap_marks);
+                r->marks[r->n_marks++] = r->n_flips;
+                break;
+            case O_SWITCH:
+                for (uint32_t i = r->marks[r->n_marks - 1]; i < r->n_flips; i++) r->later[r->flips[i]] = 0;
+                GROW(r->marks, r->n_marks, r->cap_marks);
+                r->marks[r->n_marks++] = r->n_flips;
+                break;
+            case O_JOIN:
+                to = r->marks[--r->n_marks];
+                from = r->marks[--r->n_marks];
+                for (uint32_t i = from; i < to; i++) r->later[r->flips[i]] = 1;
+                break;
+        }
+    }
+    for (uint32_t i = 0; i < r->n_flips; i++) r->later[r->flips[i]] = 0;
+    r->n_flips = 0;
+}
+
+static void infer_ownership(struct Resolver* r, struct FlatProgram* p, uint32_t body, uint32_t n_slots) {
+    own_frame(r, p, body, n_slots);
+    while (r->n_bodies) {
+        struct FlatNode abs = p->nodes[r->bodies[--r->n_bodies]];
+        own_frame(r, p, abs.b, p->closures[abs.c]);
+    }
+}
+
+bool resolve(struct FlatProgram* p, bool ownership) {
+    struct Resolver* r = calloc(1, sizeof(struct Resolver));
+    r->arena = arena_create(ARENA_DEFAULT_CHUNK, false);
+    r->levels = fit(NULL, &r->cap_levels, 0, sizeof(struct Level));
+    r->ownership = ownership;
+    p->root = resolve_from(r, p, p->root);
+    p->root_slots = r->levels[0].next_slot;
+    if (ownership) infer_ownership(r, p, p->root, p->root_slots);
+    p->resolver = r;
+    // only forced bodies are left, and they look names up along the chain
+    free(r->top);
+    free(r->reported);
+    r->top = NULL;
+    r->reported = NULL;
+    r->cap_top = r->cap_reported = 0;
+    return r->n_unbound == 0;
+}
+
+void resolve_body(struct FlatProgram* p, uint32_t abs, uint32_t lazy) {
+    struct Resolver* r = p->resolver;
+    if (!r) return;
+    struct LazyScope ls = r->lazies[lazy];
+    r->in_body = true;
+    r->chain = ls.chain;
+    r->level = r->floor = ls.level;
+    struct Level* l = &r->levels[ls.level];
+    l->next_slot = 1;
+    l->self = ls.self;
+    l->n_caps = 0;
+    for (uint32_t i = 0; i < ls.n_caps; i++) {
+        GROW(l->caps, l->n_caps, l->cap_caps);
+        l->caps[l->n_caps++] = ls.caps[i];
+    }
+    uint32_t body = resolve_from(r, p, p->nodes[abs].b);
+    p->nodes[abs].b = body;
+    p->closures[p->nodes[abs].c] = r->levels[ls.level].next_slot;
+    if (r->ownership) infer_ownership(r, p, body, r->levels[ls.level].next_slot);
+}
+
+void resolver_free(struct Resolver* r) {
+    if (!r) return;
+    arena_free(r->arena);
+    free(r->top);
+    for (uint32_t i = 0; i < r->cap_levels; i++) free(r->levels[i].caps);
+    free(r->levels);
+    free(r->done);
+    free(r->lazies);
+    free(r->items);
+    free(r->results);
+    free(r->record);
+    free(r->reported);
+    free(r->owned);
+    free(r->later);
+    free(r->flips);
+    free(r->marks);
+    free(r->bodies);
+    free(r);
+}
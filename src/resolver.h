@@ -0,0 +1,57 @@
+#ifndef LAMB_RESOLVER_H
+#define LAMB_RESOLVER_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "flat.h"
+
+// Lexical addressing and closure conversion. Each fn call gets one frame:
+// slot 0 holds the parameter, and the let/letrec bindings in the body
+// (outside nested fns) take slots 1, 2, ... in source order. The top level
+// is a frame of its own. Frames are never captured: a closure copies the
+// values of the names free in its fn when it is made, so it keeps exactly
+// those alive. The name of `letrec f fn ...` is not captured by its own
+// closure but read as the running closure, which leaves no cycle. In a
+// letrec value other than a fn, the name is the outer binding if there is
+// one, and otherwise the letrec's own slot, still empty there.
+//
+// The resolver rewrites every AST_IDENTIFIER to an address and gives each
+// AST_ABS a closure record in FlatProgram.closures:
+//
+//   frame size | number of captures | address of each capture
+//
+// the capture addresses being read in the frame the closure is made in.
+//
+// A node shared by hash-consing stays shared where it resolves the same in
+// every place it appears, and is copied where it does not.
+//
+// With ownership inference on, the resolver then marks where the evaluator
+// can skip reference counting. A read of a local slot that nothing later in
+// the frame reads again moves the value out of the slot (ADDR_MOVE on the
+// identifier's address, or on the closure record entry that captures it),
+// rather than taking a reference that the frame drops when it is freed. An
+// application whose fn is a name borrows the fn for its call (APP_BORROW)
+// rather than taking a reference and dropping it after.
+
+// an address: the kind in the top two bits and an index below
+#define ADDR_LOCAL    0u         // slot of the current frame
+#define ADDR_CAPTURED (1u << 30) // value captured by the running closure
+#define ADDR_SELF     (2u << 30) // the running closure itself
+#define ADDR_MOVE     (1u << 29) // on ADDR_LOCAL: the slot's last read, which empties it
+#define ADDR_KIND(addr) ((addr) & (3u << 30))
+#define ADDR_INDEX(addr) ((addr) & ~(7u << 29))
+#define RESOLVE_UNBOUND UINT32_MAX // a name with no binding
+
+#define APP_BORROW 1 // in the slot field of an AST_APP
+
+struct Resolver;
+
+// resolves prog in place, inferring ownership if asked; prints every
+// undefined name, those in unparsed bodies too (see lazy_names), and
+// returns false if there were any
+bool resolve(struct FlatProgram* prog, bool ownership);
+// resolves the body just parsed for abs (see flat_force_body) in the scope
+// the fn appeared in, where resolve has found every name it uses
+void resolve_body(struct FlatProgram* prog, uint32_t abs, uint32_t lazy);
+void resolver_free(struct Resolver* r);
+
+#endif
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "slab.h"
+
+struct SlabChunk {
+    struct SlabChunk* next;
+    _Alignas(16) char blocks[];
+};
+
+// a freed big block of a reserved slab
+struct SlabBig {
+    struct SlabBig* next;
+    size_t size;
+};
+
+static void* slab_malloc(size_t size) {
+    void* p = malloc(size);
+    if (!p) {
+        fprintf(stderr, "lamb: err: out of memory (slab).\n");
+        exit(1);
+    }
+    return p;
+}
+
+struct Slab* slab_create(const char* name) {
+    struct Slab* s = calloc(1, sizeof(struct Slab));
+    if (!s) {
+        fprintf(stderr, "lamb: err: out of memory (slab).\n");
+        exit(1);
+    }
+    s->name = name;
+    return s;
+}
+
+struct Slab* slab_create_reserved(const char* name, size_t reserve) {
+    struct Slab* s = slab_create(name);
+    void* region = mmap(NULL, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        fprintf(stderr, "lamb: err: could not reserve %zu MB (slab).\n", reserve >> 20);
+        exit(1);
+    }
+    s->region = s->region_top = region;
+    s->region_end = s->region + reserve;
+    return s;
+}
+
+// size bytes for a chunk or a big block: from the region, if reserved
+static void* slab_take(struct Slab* s, size_t size) {
+    if (!s->region) return slab_malloc(size);
+    size = (size + 15) & ~(size_t)15;
+    if (s->region_end - s->region_top < (ptrdiff_t)size) {
+        fprintf(stderr, "lamb: err: out of memory (slab %s is %zu MB).\n", s->name, (size_t)(s->region_end - s->region) >> 20);
+        exit(1);
+    }
+    void* p = s->region_top;
+    s->region_top += size;
+    return p;
+}
+
+static void* big_alloc(struct Slab* s, size_t size) {
+    if (!s->region) return slab_malloc(size);
+    for (struct SlabBig** b = &s->big; *b; b = &(*b)->next) {
+        if ((*b)->size == size) {
+            struct SlabBig* block = *b;
+            *b = block->next;
+            s->n_reused++;
+            return block;
+        }
+    }
+    return slab_take(s, size);
+}
+
+static void big_dealloc(struct Slab* s, void* block, size_t size) {
+    if (!s->region) {
+        free(block);
+        return;
+    }
+    struct SlabBig* b = block;
+    b->size = size;
+    b->next = s->big;
+    s->big = b;
+}
+
+static size_t block_size(size_t size) {
+    return size > SLAB_MAX ? size : (size ? (size - 1) / SLAB_GRAIN + 1 : 1) * SLAB_GRAIN;
+}
+
+void* slab_alloc(struct Slab* s, size_t size) {
+    s->n_allocs++;
+    if (++s->n_live > s->n_peak) s->n_peak = s->n_live;
+    s->bytes_live += block_size(size);
+    if (s->bytes_live > s->bytes_peak) s->bytes_peak = s->bytes_live;
+#ifdef LAMB_SLAB_MALLOC
+    if (!s->region) return slab_malloc(size);
+#endif
+    if (size > SLAB_MAX) return big_alloc(s, size);
+    size_t class = size ? (size - 1) / SLAB_GRAIN : 0;
+    void* block = s->free_lists[class];
+    if (block) {
+        s->free_lists[class] = *(void**)block;
+        s->n_reused++;
+        return block;
+    }
+    size_t bytes = (class + 1) * SLAB_GRAIN;
+    if (s->bump_end - s->bump < (ptrdiff_t)bytes) {
+        // the tail of the old chunk is given up
+        struct SlabChunk* c = slab_take(s, SLAB_CHUNK);
+        c->next = s->chunks;
+        s->chunks = c;
+        s->bump = c->blocks;
+        s->bump_end = (char*)c + SLAB_CHUNK;
+        s->n_chunks++;
+    }
+    block = s->bump;
+    s->bump += bytes;
+    return block;
+}
+
+void slab_dealloc(struct Slab* s, void* block, size_t size) {
+    s->n_live--;
+    s->bytes_live -= block_size(size);
+#ifdef LAMB_SLAB_MALLOC
+    if (!s->region) {
+        free(block);
+        return;
+    }
+#endif
+    if (size > SLAB_MAX) {
+        big_dealloc(s, block, size);
+        return;
+    }
+    size_t class = size ? (size - 1) / SLAB_GRAIN : 0;
+    *(void**)block = s->free_lists[class];
+    s->free_lists[class] = block;
+}
+
+void slab_free(struct Slab* s) {
+    if (!s) return;
+    if (s->region) {
+        munmap(s->region, s->region_end - s->region);
+    } else {
+        struct SlabChunk* c = s->chunks;
+        while (c) {
+            struct SlabChunk* next = c->next;
+            free(c);
+            c = next;
+        }
+    }
+    free(s);
+}
@@ -0,0 +1,57 @@
+#ifndef LAMB_SLAB_H
+#define LAMB_SLAB_H
+#include <stddef.h>
+
+// Freelist allocator for small objects of many sizes. Blocks are carved
+// from malloc'd chunks in size classes of SLAB_GRAIN bytes, and a freed
+// block goes on its class's list for the next allocation of that class.
+// Blocks over SLAB_MAX bytes are passed on to malloc and must be given
+// back one by one; slab_free returns every chunk at once, with any small
+// blocks still live in them.
+//
+// A slab is not locked: each belongs to one interpreter, on one thread.
+//
+// A reserved slab takes its chunks and big blocks from one address range,
+// mapped up front but only backed as it is touched, so that every block
+// lies within the reserve of every other (for compressed handles, see
+// interpreter.h). Its big blocks are kept for reuse by exact size.
+//
+// Built with -DLAMB_SLAB_MALLOC every block of an unreserved slab is
+// malloc'd and freed on its own, so that sanitizers see each object;
+// slab_free then releases nothing and anything left live shows up as a
+// leak.
+#define SLAB_GRAIN 8
+#define SLAB_MAX 512
+#define SLAB_CHUNK (64 * 1024)
+
+struct SlabChunk;
+struct SlabBig;
+
+struct Slab {
+    const char* name;
+    void* free_lists[SLAB_MAX / SLAB_GRAIN]; // by class
+    struct SlabChunk* chunks;
+    char* bump; // unused part of the newest chunk
+    char* bump_end;
+    char* region; // reserved range, or NULL
+    char* region_top;
+    char* region_end;
+    struct SlabBig* big; // freed big blocks of the region
+    // statistics
+    size_t n_live;
+    size_t n_peak; // high-water mark of n_live
+    size_t n_allocs;
+    size_t n_reused; // of n_allocs, blocks that came off a free list
+    size_t n_chunks;
+    size_t bytes_live; // in blocks handed out, by their size class
+    size_t bytes_peak;
+};
+
+struct Slab* slab_create(const char* name);
+struct Slab* slab_create_reserved(const char* name, size_t reserve);
+void* slab_alloc(struct Slab* s, size_t size);
+// size is what the block was allocated with
+void slab_dealloc(struct Slab* s, void* block, size_t size);
+void slab_free(struct Slab* s);
+
+#endif
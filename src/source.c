@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "source.h"
+
+#define READ_CHUNK (64 * 1024)
+
+static struct Source* source_read_fd(int fd) {
+    long cap = READ_CHUNK;
+    long len = 0;
+    char* buf = malloc(cap);
+    if (!buf) return NULL;
+    for (;;) {
+        if (len == cap) {
+            cap *= 2;
+            char* grown = realloc(buf, cap);
+            if (!grown) {
+                free(buf);
+                return NULL;
+            }
+            buf = grown;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(buf);
+            return NULL;
+        }
+        len += n;
+    }
+    struct Source* src = malloc(sizeof(struct Source));
+    src->chars = buf;
+    src->len = len;
+    src->kind = SOURCE_BUFFER;
+    return src;
+}
+
+static struct Source* source_map_fd(int fd, long len) {
+    // mmap refuses zero-length mappings
+    void* map = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if (map == MAP_FAILED)
+        return NULL;
+    if (map)
+        madvise(map, len, MADV_SEQUENTIAL);
+    struct Source* src = malloc(sizeof(struct Source));
+    src->chars = map;
+    src->len = len;
+    src->kind = SOURCE_MMAP;
+    return src;
+}
+
+struct Source* source_open(const char* path) {
+    int fd = strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    struct Source* src = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        src = source_map_fd(fd, st.st_size);
+    if (!src) // pipes, ttys, or a file that would not map
+        src = source_read_fd(fd);
+    if (fd != STDIN_FILENO) {
+        int saved = errno;
+        close(fd); // a mapping outlives its descriptor
+        errno = saved;
+    }
+    return src;
+}
+
+void source_close(struct Source* src) {
+    if (!src) return;
+    if (src->kind == SOURCE_MMAP) {
+        if (src->len)
+            munmap((void*)src->chars, src->len);
+    } else {
+        free((void*)src->chars);
+    }
+    free(src);
+}
@@ -0,0 +1,22 @@
+#ifndef LAMB_SOURCE_H
+#define LAMB_SOURCE_H
+
+// Program text as the lexer sees it. Regular files are mapped read-only and
+// never copied; pipes, terminals and "-" (stdin) are read into a growing
+// buffer. The chars are not NUL-terminated, everything downstream goes by len.
+enum SourceKind {
+    SOURCE_MMAP,
+    SOURCE_BUFFER
+};
+
+struct Source {
+    const char* chars;
+    long len;
+    enum SourceKind kind;
+};
+
+// NULL (with errno set) if the file cannot be opened or read
+struct Source* source_open(const char* path);
+void source_close(struct Source* src);
+
+#endif
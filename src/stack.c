@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "stack.h"
+
+#define ALIGN_UP(n) (((n) + 15) & ~(size_t)15)
+
+struct StackChunk {
+    struct StackChunk* prev;
+    char* prev_top; // where the previous chunk was popped back to
+    char* end;
+    _Alignas(16) char data[];
+};
+
+static void* stack_malloc(size_t size) {
+    void* p = malloc(size);
+    if (!p) {
+        fprintf(stderr, "lamb: err: out of memory (stack).\n");
+        exit(1);
+    }
+    return p;
+}
+
+struct Stack* stack_create(const char* name) {
+    struct Stack* s = calloc(1, sizeof(struct Stack));
+    if (!s) {
+        fprintf(stderr, "lamb: err: out of memory (stack).\n");
+        exit(1);
+    }
+    s->name = name;
+    return s;
+}
+
+// a chunk that takes size bytes, the spare if it is big enough
+static struct StackChunk* next_chunk(struct Stack* s, size_t size) {
+    struct StackChunk* c = s->spare;
+    s->spare = NULL;
+    if (c && c->end - c->data >= (ptrdiff_t)size) return c;
+    free(c);
+    size_t bytes = sizeof(struct StackChunk) + size;
+    if (bytes < STACK_CHUNK) bytes = STACK_CHUNK;
+    c = stack_malloc(bytes);
+    c->end = (char*)c + bytes;
+    s->n_chunks++;
+    return c;
+}
+
+void* stack_push(struct Stack* s, size_t size) {
+    s->n_allocs++;
+    if (++s->n_live > s->n_peak) s->n_peak = s->n_live;
+#ifdef LAMB_SLAB_MALLOC
+    return stack_malloc(size);
+#else
+    size = ALIGN_UP(size);
+    if (!s->chunk || s->chunk->end - s->top < (ptrdiff_t)size) {
+        struct StackChunk* c = next_chunk(s, size);
+        c->prev = s->chunk;
+        c->prev_top = s->top;
+        s->chunk = c;
+        s->top = c->data;
+    }
+    void* block = s->top;
+    s->top += size;
+    return block;
+#endif
+}
+
+void stack_pop(struct Stack* s, void* block) {
+    s->n_live--;
+#ifdef LAMB_SLAB_MALLOC
+    free(block);
+#else
+    s->top = block;
+    struct StackChunk* c = s->chunk;
+    if (s->top == c->data && c->prev) {
+        free(s->spare);
+        s->spare = c;
+        s->chunk = c->prev;
+        s->top = c->prev_top;
+    }
+#endif
+}
+
+void stack_free(struct Stack* s) {
+    if (!s) return;
+    struct StackChunk* c = s->chunk;
+    while (c) {
+        struct StackChunk* prev = c->prev;
+        free(c);
+        c = prev;
+    }
+    free(s->spare);
+    free(s);
+}
@@ -0,0 +1,34 @@
+#ifndef LAMB_STACK_H
+#define LAMB_STACK_H
+#include <stddef.h>
+
+// LIFO region: blocks are bumped from malloc'd chunks and freed in the
+// reverse order they were made, by popping back to each. A chunk emptied by
+// popping is kept as a spare for the next push that overflows, so a depth
+// that swings across a chunk boundary does not malloc and free each time.
+//
+// Built with -DLAMB_SLAB_MALLOC (see slab.h) every block is malloc'd and
+// freed on its own.
+#define STACK_CHUNK (64 * 1024)
+
+struct StackChunk;
+
+struct Stack {
+    const char* name;
+    struct StackChunk* chunk; // being bumped
+    char* top;
+    struct StackChunk* spare;
+    // statistics
+    size_t n_live;
+    size_t n_peak; // high-water mark of n_live
+    size_t n_allocs;
+    size_t n_chunks;
+};
+
+struct Stack* stack_create(const char* name);
+void* stack_push(struct Stack* s, size_t size);
+// block is the latest push not yet popped
+void stack_pop(struct Stack* s, void* block);
+void stack_free(struct Stack* s);
+
+#endif
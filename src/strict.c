@@ -0,0 +1,223 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "strict.h"
+#include "resolver.h"
+
+// what is known of the slots of a frame, as the walk goes down the program
+struct Frame {
+    struct Frame* parent;
+    uint32_t abs;     // 0 at the top level
+    uint32_t* fns;    // by slot: the fn bound there, if known
+    uint32_t* forces; // by slot: the parameters of the fn analysed that forcing it forces
+};
+
+struct Strict {
+    struct FlatProgram* prog;
+    uint32_t* params; // by AST_ABS node: the number of parameters of the fn it starts
+    uint32_t* mask;   // by AST_ABS node: bit j-1 for each xj the fn is strict in
+    struct Frame* head; // the frame of x1 of the fn analysed
+    bool changed;
+};
+
+static void* alloc(size_t n, size_t size) {
+    void* p = calloc(n, size);
+    if (!p) {
+        fprintf(stderr, "lamb: err: out of memory (strict).\n");
+        exit(1);
+    }
+    return p;
+}
+
+static bool is_fn(struct Strict* s, uint32_t node) {
+    return NODE(s, node).tag == AST_ABS && !(NODE(s, node).slot & ABS_THUNK);
+}
+
+static void frame_enter(struct Strict* s, struct Frame* f, struct Frame* parent, uint32_t abs) {
+    uint32_t size = (abs ? RECORD(s, abs)[0] : s->prog->root_slots) + 1;
+    *f = (struct Frame) {parent, abs, alloc(size, sizeof(uint32_t)), alloc(size, sizeof(uint32_t))};
+}
+
+static void frame_leave(struct Frame* f) {
+    free(f->fns);
+    free(f->forces);
+}
+
+// the parameters that forcing the value at addr forces
+static uint32_t forces(struct Strict* s, struct Frame* f, uint32_t addr) {
+    for (;;) {
+        if (addr == RESOLVE_UNBOUND) return 0;
+        switch (ADDR_KIND(addr)) {
+            case ADDR_LOCAL:
+                return f->forces[ADDR_INDEX(addr)];
+            case ADDR_CAPTURED:
+                if (f == s->head) return 0; // from outside the fn
+                addr = RECORD(s, f->abs)[2 + ADDR_INDEX(addr)];
+                f = f->parent;
+                break;
+            default:
+                return 0;
+        }
+    }
+}
+
+// the fn the value at addr is, if known
+static uint32_t known(struct Strict* s, struct Frame* f, uint32_t addr) {
+    for (;;) {
+        if (addr == RESOLVE_UNBOUND) return 0;
+        switch (ADDR_KIND(addr)) {
+            case ADDR_LOCAL:
+                return f->fns[ADDR_INDEX(addr)];
+            case ADDR_CAPTURED:
+                addr = RECORD(s, f->abs)[2 + ADDR_INDEX(addr)];
+                f = f->parent;
+                break;
+            case ADDR_SELF:
+                return f->abs;
+            default:
+                return 0;
+        }
+    }
+}
+
+static uint32_t demand(struct Strict* s, struct Frame* f, uint32_t expr);
+
+// the parameters forced by forcing v, an argument or let value
+static uint32_t demand_value(struct Strict* s, struct Frame* f, uint32_t v) {
+    if (NODE(s, v).tag == AST_IDENTIFIER) return forces(s, f, NODE(s, v).b);
+    if (NODE(s, v).tag != AST_ABS || is_fn(s, v)) return 0;
+    struct Frame thunk;
+    frame_enter(s, &thunk, f, v);
+    uint32_t mask = demand(s, &thunk, NODE(s, v).b);
+    frame_leave(&thunk);
+    return mask;
+}
+
+// the parameters certainly forced by evaluating expr
+static uint32_t demand(struct Strict* s, struct Frame* f, uint32_t expr) {
+    for (;;) {
+        struct FlatNode n = NODE(s, expr);
+        switch (n.tag) {
+            case AST_IDENTIFIER:
+                return forces(s, f, n.b);
+            case AST_SUCC:
+            case AST_DEC:
+            case AST_POS:
+            case AST_NEG:
+                expr = n.a;
+                break;
+            case AST_IF_ELSE:
+                return demand(s, f, n.a) | (demand(s, f, n.b) & demand(s, f, n.c));
+            case AST_LET_IN:
+            case AST_LETREC:
+                f->fns[n.slot] = is_fn(s, n.b) ? n.b : 0;
+                f->forces[n.slot] = n.tag == AST_LET_IN ? demand_value(s, f, n.b) : 0;
+                expr = n.c;
+                break;
+            case AST_APP: {
+                uint32_t mask = demand(s, f, n.a);
+                uint32_t fn = NODE(s, n.a).tag == AST_IDENTIFIER ? known(s, f, NODE(s, n.a).b)
+                            : is_fn(s, n.a) ? n.a : 0;
+                if (fn && s->params[fn] && n.c >= s->params[fn]) {
+                    for (uint32_t j = 0; j < s->params[fn]; j++) {
+                        if (s->mask[fn] >> j & 1) mask |= demand_value(s, f, s->prog->args[n.b + j]);
+                    }
+                }
+                return mask;
+            }
+            default:
+                return 0;
+        }
+    }
+}
+
+static void visit(struct Strict* s, struct Frame* f, uint32_t expr);
+
+// fn x1 ... fn xn body, made in f
+static void analyse(struct Strict* s, struct Frame* f, uint32_t fn) {
+    uint32_t n = s->params[fn];
+    struct Frame frames[STRICT_MAX_PARAMS];
+    uint32_t last = fn;
+    for (uint32_t j = 0; j < n; j++) {
+        if (j) last = NODE(s, last).b;
+        frame_enter(s, &frames[j], j ? &frames[j - 1] : f, last);
+        frames[j].forces[0] = 1u << j;
+    }
+    s->head = &frames[0];
+    uint32_t mask = demand(s, &frames[n - 1], NODE(s, last).b) & s->mask[fn];
+    if (mask != s->mask[fn]) {
+        s->mask[fn] = mask;
+        s->changed = true;
+    }
+    // xj is forced once n - j more arguments follow it
+    for (uint32_t j = 0, abs = fn; j < n; j++, abs = NODE(s, abs).b) {
+        s->prog->strict[abs] = mask >> j & 1 ? n - j : 0;
+    }
+    visit(s, &frames[n - 1], NODE(s, last).b);
+    for (uint32_t j = 0; j < n; j++) frame_leave(&frames[j]);
+}
+
+static void visit(struct Strict* s, struct Frame* f, uint32_t expr) {
+    for (;;) {
+        struct FlatNode n = NODE(s, expr);
+        switch (n.tag) {
+            case AST_ABS:
+                if (is_fn(s, expr) && s->params[expr]) {
+                    analyse(s, f, expr);
+                } else {
+                    struct Frame inner;
+                    frame_enter(s, &inner, f, expr);
+                    visit(s, &inner, n.b);
+                    frame_leave(&inner);
+                }
+                return;
+            case AST_APP:
+                visit(s, f, n.a);
+                for (uint32_t j = 0; j < n.c; j++) visit(s, f, s->prog->args[n.b + j]);
+                return;
+            case AST_SUCC:
+            case AST_DEC:
+            case AST_POS:
+            case AST_NEG:
+                expr = n.a;
+                break;
+            case AST_IF_ELSE:
+                visit(s, f, n.a);
+                visit(s, f, n.b);
+                expr = n.c;
+                break;
+            case AST_LET_IN:
+            case AST_LETREC:
+                f->fns[n.slot] = is_fn(s, n.b) ? n.b : 0;
+                visit(s, f, n.b);
+                expr = n.c;
+                break;
+            default:
+                return;
+        }
+    }
+}
+
+void strict_analyse(struct FlatProgram* prog) {
+    struct Strict s = {.prog = prog};
+    s.params = alloc(prog->n_nodes, sizeof(uint32_t));
+    s.mask = alloc(prog->n_nodes, sizeof(uint32_t));
+    free(prog->strict);
+    prog->strict = alloc(prog->n_nodes, sizeof(uint8_t));
+    for (uint32_t i = 1; i < prog->n_nodes; i++) {
+        uint32_t n = 0;
+        for (uint32_t abs = i; is_fn(&s, abs) && n <= STRICT_MAX_PARAMS; abs = prog->nodes[abs].b) n++;
+        if (n <= STRICT_MAX_PARAMS) s.params[i] = n;
+        // a fn is first taken to be strict in everything, and then in less
+        if (s.params[i]) s.mask[i] = n == STRICT_MAX_PARAMS ? UINT32_MAX : (1u << n) - 1;
+    }
+    do {
+        s.changed = false;
+        struct Frame top;
+        frame_enter(&s, &top, NULL, 0);
+        visit(&s, &top, prog->root);
+        frame_leave(&top);
+    } while (s.changed);
+    free(s.params);
+    free(s.mask);
+}
@@ -0,0 +1,28 @@
+#ifndef LAMB_STRICT_H
+#define LAMB_STRICT_H
+#include "flat.h"
+
+// Strictness analysis for call by need (see interpreter.h). A fn of
+// parameters x1 ... xn, written fn x1 fn x2 ... body, is strict in xj if
+// evaluating body, once all n are passed, certainly forces xj: it is the
+// result, or an operand of +, -, pos or neg, or the condition of an if, or
+// forced by both branches, or the value of a let so forced, or passed where
+// a known fn is strict itself. So
+//
+//   letrec add fn x fn y if y then add(+x)(-y) else x
+//
+// is strict in x and y. A call that passes all n evaluates such an
+// argument at once rather than making a thunk of it, which would otherwise
+// build a chain as long as the loop, as an accumulator does, and force it
+// as deep in the C stack.
+//
+// Known fns are those bound by let or letrec to a fn. Recursion is solved by
+// iterating from "strict in everything" until nothing changes. A fn may then
+// force an argument where call by need would have stopped early at an error
+// elsewhere; that argument diverging is the only difference it makes.
+#define STRICT_MAX_PARAMS 32 // longer fns are not analysed
+
+// fills prog->strict; runs after resolve
+void strict_analyse(struct FlatProgram* prog);
+
+#endif
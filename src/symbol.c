@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbol.h"
+#include "arena.h"
+#include "table.h"
+
+static struct Arena* names_arena;
+static struct String* names; // by id
+static uint32_t n_names, cap_names;
+static struct Table* ids; // hash of the name -> id
+
+struct Probe {
+    const char* chars;
+    int len;
+};
+
+static bool same_name(void* ctx, uint64_t id) {
+    struct Probe* probe = ctx;
+    struct String s = names[id];
+    return s.length == probe->len && !memcmp(s.b, probe->chars, probe->len);
+}
+
+uint32_t symbol_intern(const char* chars, int len) {
+    if (!ids) ids = table_create(1024);
+    uint64_t hash = table_hash_bytes(chars, len);
+    struct Probe probe = {chars, len};
+    uint64_t* found = table_find(ids, hash, same_name, &probe);
+    if (found) return *found;
+    if (n_names == cap_names) {
+        cap_names = cap_names ? cap_names * 2 : 256;
+        names = realloc(names, sizeof(struct String) * cap_names);
+        if (!names) {
+            fprintf(stderr, "lamb: err: out of memory (symbols).\n");
+            exit(1);
+        }
+    }
+    if (!names_arena) names_arena = arena_create(ARENA_DEFAULT_CHUNK, false);
+    char* b = arena_alloc(names_arena, len + 1);
+    memcpy(b, chars, len);
+    b[len] = '\0';
+    names[n_names] = (struct String) {.length = len, .b = b};
+    table_add(ids, hash, n_names);
+    return n_names++;
+}
+
+struct String symbol_name(uint32_t sym) {
+    return names[sym];
+}
+
+uint32_t symbol_count(void) {
+    return n_names;
+}
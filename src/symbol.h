@@ -0,0 +1,15 @@
+#ifndef LAMB_SYMBOL_H
+#define LAMB_SYMBOL_H
+#include <stdint.h>
+#include "stringt.h"
+
+// Interned names: the parser turns every identifier into a small integer,
+// the same for equal names, so that the AST and environments compare and
+// hash names as integers. Ids count up from 0 in order of first appearance.
+// There is one table for the whole process; it is never freed.
+uint32_t symbol_intern(const char* chars, int len);
+// NUL-terminated and owned by the table
+struct String symbol_name(uint32_t sym);
+uint32_t symbol_count(void);
+
+#endif
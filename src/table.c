@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "table.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xfe // both have the top bit set, full slots do not
+#define H2(hash) ((uint8_t)((hash) & 0x7f))
+#define NONE UINT32_MAX
+
+/*
+GROUPS
+
+Each returns a bit per slot of the group starting at ctrl.
+*/
+
+#ifdef __SSE2__
+static uint32_t group_match(const uint8_t* ctrl, uint8_t byte) {
+    __m128i g = _mm_loadu_si128((const __m128i*)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)byte)));
+}
+
+static uint32_t group_free(const uint8_t* ctrl) { // empty or deleted
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+}
+#else
+static uint32_t group_match(const uint8_t* ctrl, uint8_t byte) {
+    uint32_t m = 0;
+    for (int i = 0; i < TABLE_GROUP; i++) m |= (uint32_t)(ctrl[i] == byte) << i;
+    return m;
+}
+
+static uint32_t group_free(const uint8_t* ctrl) {
+    uint32_t m = 0;
+    for (int i = 0; i < TABLE_GROUP; i++) m |= (uint32_t)(ctrl[i] >> 7) << i;
+    return m;
+}
+#endif
+
+uint64_t table_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+uint64_t table_hash_bytes(const void* data, size_t len) {
+    const unsigned char* p = data;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len, w;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&w, p + i, 8);
+        h = table_mix(h ^ w) + 0x9e3779b97f4a7c15ULL;
+    }
+    w = 0;
+    memcpy(&w, p + i, len - i);
+    return table_mix(h ^ w);
+}
+
+static void* table_alloc(size_t size) {
+    void* p = malloc(size);
+    if (!p) {
+        fprintf(stderr, "lamb: err: out of memory (table).\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void table_init(struct Table* t, uint32_t cap) {
+    t->cap = cap;
+    t->len = 0;
+    t->growth_left = cap - cap / 8;
+    t->ctrl = table_alloc(cap);
+    memset(t->ctrl, CTRL_EMPTY, cap);
+    t->entries = table_alloc(sizeof(struct TableEntry) * cap);
+}
+
+static uint32_t cap_for(uint32_t n) {
+    uint32_t cap = TABLE_GROUP;
+    while (cap - cap / 8 < n) cap *= 2;
+    return cap;
+}
+
+struct Table* table_create(uint32_t expected) {
+    struct Table* t = table_alloc(sizeof(struct Table));
+    table_init(t, cap_for(expected));
+    return t;
+}
+
+void table_free(struct Table* t) {
+    if (!t) return;
+    free(t->ctrl);
+    free(t->entries);
+    free(t);
+}
+
+size_t table_bytes(struct Table* t) {
+    return sizeof(struct Table) + t->cap + sizeof(struct TableEntry) * t->cap;
+}
+
+/*
+PROBING
+
+Groups are visited in triangular order (g, g+1, g+3, g+6, ...), which
+reaches every group of a power-of-two table. A lookup stops at the first
+group with an empty slot, as an insert would have used it.
+*/
+
+static uint32_t find_index(struct Table* t, uint64_t hash, bool (*eq)(void* ctx, uint64_t value), void* ctx) {
+    uint32_t mask = t->cap / TABLE_GROUP - 1;
+    uint32_t g = (hash >> 7) & mask;
+    for (uint32_t step = 1;; step++) {
+        const uint8_t* ctrl = t->ctrl + g * TABLE_GROUP;
+        for (uint32_t m = group_match(ctrl, H2(hash)); m; m &= m - 1) {
+            uint32_t i = g * TABLE_GROUP + __builtin_ctz(m);
+            if (t->entries[i].hash == hash && (!eq || eq(ctx, t->entries[i].value))) return i;
+        }
+        if (group_match(ctrl, CTRL_EMPTY)) return NONE;
+        g = (g + step) & mask;
+    }
+}
+
+static uint32_t free_index(struct Table* t, uint64_t hash) {
+    uint32_t mask = t->cap / TABLE_GROUP - 1;
+    uint32_t g = (hash >> 7) & mask;
+    for (uint32_t step = 1;; step++) {
+        uint32_t m = group_free(t->ctrl + g * TABLE_GROUP);
+        if (m) return g * TABLE_GROUP + __builtin_ctz(m);
+        g = (g + step) & mask;
+    }
+}
+
+static void set_ctrl(struct Table* t, uint32_t i, uint64_t hash, uint64_t value) {
+    t->ctrl[i] = H2(hash);
+    t->entries[i] = (struct TableEntry) {hash, value};
+}
+
+// sized for twice the live entries: this doubles a full table and cleans
+// out one that is mostly tombstones
+static void rehash(struct Table* t) {
+    struct Table old = *t;
+    table_init(t, cap_for(2 * old.len + 1));
+    for (uint32_t i = 0; i < old.cap; i++) {
+        if (old.ctrl[i] & 0x80) continue;
+        set_ctrl(t, free_index(t, old.entries[i].hash), old.entries[i].hash, old.entries[i].value);
+    }
+    t->len = old.len;
+    t->growth_left -= old.len;
+    free(old.ctrl);
+    free(old.entries);
+}
+
+void table_add(struct Table* t, uint64_t hash, uint64_t value) {
+    if (!t->growth_left) rehash(t);
+    uint32_t i = free_index(t, hash);
+    if (t->ctrl[i] == CTRL_EMPTY) t->growth_left--;
+    set_ctrl(t, i, hash, value);
+    t->len++;
+}
+
+uint64_t* table_find(struct Table* t, uint64_t hash, bool (*eq)(void* ctx, uint64_t value), void* ctx) {
+    uint32_t i = find_index(t, hash, eq, ctx);
+    return i == NONE ? NULL : &t->entries[i].value;
+}
+
+bool table_get(struct Table* t, uint64_t key, uint64_t* value) {
+    uint32_t i = find_index(t, table_mix(key), NULL, NULL);
+    if (i == NONE) return false;
+    *value = t->entries[i].value;
+    return true;
+}
+
+void table_put(struct Table* t, uint64_t key, uint64_t value) {
+    uint64_t hash = table_mix(key);
+    uint32_t i = find_index(t, hash, NULL, NULL);
+    if (i != NONE) {
+        t->entries[i].value = value;
+        return;
+    }
+    table_add(t, hash, value);
+}
+
+bool table_remove(struct Table* t, uint64_t key) {
+    uint32_t i = find_index(t, table_mix(key), NULL, NULL);
+    if (i == NONE) return false;
+    // a group with an empty slot ends every probe that reaches it, so a slot
+    // there can be empty again; elsewhere it has to stay a tombstone
+    if (group_match(t->ctrl + i / TABLE_GROUP * TABLE_GROUP, CTRL_EMPTY)) {
+        t->ctrl[i] = CTRL_EMPTY;
+        t->growth_left++;
+    } else {
+        t->ctrl[i] = CTRL_DELETED;
+    }
+    t->len--;
+    return true;
+}
+
+void table_each(struct Table* t, void (*each)(void* ctx, uint64_t value), void* ctx) {
+    for (uint32_t i = 0; i < t->cap; i++) {
+        if (!(t->ctrl[i] & 0x80)) each(ctx, t->entries[i].value);
+    }
+}
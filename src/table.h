@@ -0,0 +1,58 @@
+#ifndef LAMB_TABLE_H
+#define LAMB_TABLE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// An open-addressing hash table in the style of Abseil's Swiss tables.
+// Slots come in groups of TABLE_GROUP, each with a control byte: empty,
+// deleted, or the low 7 bits of the hash of its entry. A probe compares a
+// whole group of control bytes at once (with SSE2 where there is SSE2) and
+// only looks at the entries whose 7 bits match. The capacity is a power of
+// two, grown at 7/8 full.
+//
+// An entry is a 64-bit hash and a 64-bit value. Entries keep their hash, so
+// growing never hashes a key again. The table is used two ways:
+//  - as a map from integer keys: table_get/put/remove. The hash is a
+//    bijective mix of the key, so equal hashes mean equal keys.
+//  - as a set of things the caller hashes and compares: table_find/add.
+//    The hash must be mixed in all its bits (see table_mix).
+#define TABLE_GROUP 16
+
+struct TableEntry {
+    uint64_t hash;
+    uint64_t value;
+};
+
+struct Table {
+    uint8_t* ctrl;
+    struct TableEntry* entries;
+    uint32_t cap;         // slots; a multiple of TABLE_GROUP
+    uint32_t len;         // entries
+    uint32_t growth_left; // empty slots that may be filled before growing
+};
+
+// room for at least expected entries before the first grow
+struct Table* table_create(uint32_t expected);
+void table_free(struct Table* t);
+// bytes held by t, for statistics
+size_t table_bytes(struct Table* t);
+
+// a bijection on 64-bit words that spreads every input bit to every output
+// bit (the MurmurHash3 finalizer)
+uint64_t table_mix(uint64_t x);
+uint64_t table_hash_bytes(const void* data, size_t len);
+
+bool table_get(struct Table* t, uint64_t key, uint64_t* value);
+// adds key or replaces its value
+void table_put(struct Table* t, uint64_t key, uint64_t value);
+bool table_remove(struct Table* t, uint64_t key);
+
+// the value of the first entry with this hash that eq accepts, or NULL
+uint64_t* table_find(struct Table* t, uint64_t hash, bool (*eq)(void* ctx, uint64_t value), void* ctx);
+// adds an entry without looking for an equal one
+void table_add(struct Table* t, uint64_t hash, uint64_t value);
+// calls each on every value, in no particular order
+void table_each(struct Table* t, void (*each)(void* ctx, uint64_t value), void* ctx);
+
+#endif
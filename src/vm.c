@@ -0,0 +1,585 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "vm.h"
+#include "interpreter.h"
+#include "flat.h"
+#include "resolver.h"
+#include "symbol.h"
+
+#if defined(__GNUC__) && !defined(LAMB_VM_SWITCH)
+#define VM_THREADED
+#endif
+
+// Nodes are read through these rather than cached, since forcing a lazy fn
+// body appends to (and may move) the node arrays.
+
+// An instruction is its opcode and the operands listed, one word each.
+enum VmOp {
+    OP_NUM,           // value
+    OP_LOCAL,         // slot, symbol: a new reference to the slot's value
+    OP_MOVE,          // slot, symbol: the slot's value, which empties it
+    OP_LOAD,          // address, symbol: a new reference, by env_get
+    OP_CLOSURE,       // AST_ABS node
+    OP_SUCC,
+    OP_DEC,
+    OP_POS,
+    OP_NEG,
+    OP_SET,           // slot: pops the value of a let
+    OP_LETREC,        // slot: pops the fn of a letrec
+    OP_JZ,            // target: pops a condition, and jumps if it is 0
+    OP_JUMP,          // target
+    OP_CHECKFN,       // the fn of the next call of a chain is a closure
+    OP_SWAP,          // the top two
+    OP_CALL,          // pops the argument, then the fn
+    OP_CALL_NAME,     // address, symbol: pops the argument; the fn is borrowed
+    OP_TAILCALL,
+    OP_TAILCALL_NAME, // address, symbol
+    OP_RET,
+    OP_HALT,          // the end of the root
+    OP_ERR,           // message string: a fn body that failed to parse
+};
+
+// what an error leaving the operand of +, -, pos or neg is turned into
+enum VmWrapKind {
+    WRAP_NONE,
+    WRAP_PLUS,
+    WRAP_MINUS,
+};
+
+// code offsets [start, end)
+struct VmWrap {
+    uint32_t start, end;
+    uint32_t kind;
+};
+
+struct VmFn {
+    uint32_t n_locals; // the resolver's frame size
+    uint32_t n_slots;  // with the operand stack after the locals
+    struct VmWrap* wraps; // outermost only
+    uint32_t n_wraps;
+    uint32_t n_code;
+    uint32_t code[];
+};
+
+struct VmFrame {
+    struct VmFn* fn;
+    struct Environment* env;
+    const uint32_t* pc;   // to resume at, while it calls
+    struct LambValue* sp; // likewise
+    bool owns;            // holds a reference to env->closure
+};
+
+static void* vm_realloc(void* p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        fprintf(stderr, "lamb: err: out of memory (vm).\n");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+COMPILER
+*/
+
+struct VmCompiler {
+    struct Interpreter* state;
+    uint32_t* code;
+    uint32_t n_code, cap_code;
+    struct VmWrap* wraps;
+    uint32_t n_wraps, cap_wraps;
+    uint32_t depth, max_depth; // of the operand stack
+    uint32_t in_operand; // of +, -, pos or neg
+    bool in_fn; // not the root: calls in tail position are tail calls
+};
+
+static uint32_t emit(struct VmCompiler* c, uint32_t word) {
+    if (c->n_code == c->cap_code) {
+        c->cap_code = c->cap_code ? 2 * c->cap_code : 64;
+        c->code = vm_realloc(c->code, sizeof(uint32_t) * c->cap_code);
+    }
+    c->code[c->n_code] = word;
+    return c->n_code++;
+}
+
+static void push(struct VmCompiler* c) {
+    if (++c->depth > c->max_depth) c->max_depth = c->depth;
+}
+
+static void add_wrap(struct VmCompiler* c, uint32_t start, uint32_t kind) {
+    if (c->n_wraps == c->cap_wraps) {
+        c->cap_wraps = c->cap_wraps ? 2 * c->cap_wraps : 8;
+        c->wraps = vm_realloc(c->wraps, sizeof(struct VmWrap) * c->cap_wraps);
+    }
+    c->wraps[c->n_wraps++] = (struct VmWrap) {start, c->n_code, kind};
+}
+
+// a borrowed read takes a reference all the same, and so never moves
+static void compile_load(struct VmCompiler* c, uint32_t addr, uint32_t sym, bool borrowed) {
+    if (addr != RESOLVE_UNBOUND && ADDR_KIND(addr) == ADDR_LOCAL) {
+        emit(c, (addr & ADDR_MOVE) && !borrowed ? OP_MOVE : OP_LOCAL);
+        emit(c, ADDR_INDEX(addr));
+    } else {
+        emit(c, OP_LOAD);
+        emit(c, addr);
+    }
+    emit(c, sym);
+    push(c);
+}
+
+static void compile_expr(struct VmCompiler* c, uint32_t expr, bool tail);
+
+static void compile_unary(struct VmCompiler* c, uint32_t operand, enum VmOp op, uint32_t kind) {
+    uint32_t start = c->n_code;
+    c->in_operand++;
+    compile_expr(c, operand, false);
+    c->in_operand--;
+    if (!c->in_operand) add_wrap(c, start, kind);
+    emit(c, op);
+}
+
+// in the tree walker's order: a single argument before its fn, a chain's
+// fn before its arguments
+static void compile_app(struct VmCompiler* c, uint32_t expr, bool tail) {
+    struct FlatNode app = NODE(c->state, expr);
+    struct FlatNode fn = NODE(c->state, app.a);
+    bool borrowed = (app.slot & APP_BORROW) && fn.tag == AST_IDENTIFIER;
+    tail = tail && c->in_fn;
+    if (!app.c) {
+        compile_expr(c, app.a, tail);
+        return;
+    }
+    if (app.c == 1) {
+        compile_expr(c, ARG(c->state, app.b), false);
+        if (borrowed) {
+            emit(c, tail ? OP_TAILCALL_NAME : OP_CALL_NAME);
+            emit(c, fn.b);
+            emit(c, fn.a);
+        } else {
+            compile_expr(c, app.a, false);
+            emit(c, OP_SWAP);
+            emit(c, tail ? OP_TAILCALL : OP_CALL);
+            c->depth--;
+        }
+        return;
+    }
+    if (borrowed) {
+        compile_load(c, fn.b, fn.a, true);
+    } else {
+        compile_expr(c, app.a, false);
+    }
+    for (uint32_t i = 0; i < app.c; i++) {
+        emit(c, OP_CHECKFN);
+        compile_expr(c, ARG(c->state, app.b + i), false);
+        emit(c, tail && i + 1 == app.c ? OP_TAILCALL : OP_CALL);
+        c->depth--;
+    }
+}
+
+static void compile_expr(struct VmCompiler* c, uint32_t expr, bool tail) {
+    struct FlatNode n = NODE(c->state, expr);
+    uint32_t jz, jump;
+    switch (n.tag) {
+        case AST_NUM:
+            emit(c, OP_NUM);
+            emit(c, n.a);
+            push(c);
+            break;
+        case AST_IDENTIFIER:
+            compile_load(c, n.b, n.a, false);
+            break;
+        case AST_ABS:
+            emit(c, OP_CLOSURE);
+            emit(c, expr);
+            push(c);
+            break;
+        case AST_SUCC:
+            compile_unary(c, n.a, OP_SUCC, WRAP_PLUS);
+            break;
+        case AST_DEC:
+            compile_unary(c, n.a, OP_DEC, WRAP_MINUS);
+            break;
+        case AST_POS:
+            compile_unary(c, n.a, OP_POS, WRAP_PLUS);
+            break;
+        case AST_NEG:
+            compile_unary(c, n.a, OP_NEG, WRAP_PLUS);
+            break;
+        case AST_LET_IN:
+        case AST_LETREC:
+            compile_expr(c, n.b, false);
+            emit(c, n.tag == AST_LET_IN ? OP_SET : OP_LETREC);
+            emit(c, n.slot);
+            c->depth--;
+            compile_expr(c, n.c, tail);
+            break;
+        case AST_IF_ELSE:
+            compile_expr(c, n.a, false);
+            emit(c, OP_JZ);
+            jz = emit(c, 0);
+            c->depth--;
+            compile_expr(c, n.b, tail);
+            emit(c, OP_JUMP);
+            jump = emit(c, 0);
+            c->depth--;
+            c->code[jz] = c->n_code;
+            compile_expr(c, n.c, tail);
+            c->code[jump] = c->n_code;
+            break;
+        case AST_APP:
+            compile_app(c, expr, tail);
+            break;
+        case AST_ERR:
+            emit(c, OP_ERR);
+            emit(c, n.a);
+            push(c);
+            break;
+        default:
+            assert(0);
+    }
+}
+
+static struct VmFn* compile_fn(struct Interpreter* state, uint32_t body, uint32_t n_locals, bool in_fn) {
+    struct VmCompiler c = {.state = state, .in_fn = in_fn};
+    compile_expr(&c, body, true);
+    emit(&c, in_fn ? OP_RET : OP_HALT);
+    struct VmFn* fn = vm_realloc(NULL, sizeof(struct VmFn) + sizeof(uint32_t) * c.n_code);
+    fn->n_locals = n_locals;
+    fn->n_slots = n_locals + c.max_depth;
+    fn->wraps = c.wraps;
+    fn->n_wraps = c.n_wraps;
+    fn->n_code = c.n_code;
+    memcpy(fn->code, c.code, sizeof(uint32_t) * c.n_code);
+    free(c.code);
+    state->vm->n_compiled++;
+    state->vm->code_bytes += sizeof(uint32_t) * c.n_code;
+    return fn;
+}
+
+// the code of abs, parsing and compiling its body on the first call
+static struct VmFn* fn_code(struct Interpreter* state, uint32_t abs) {
+    struct Vm* vm = state->vm;
+    if (abs < vm->cap_fns && vm->fns[abs]) return vm->fns[abs];
+    flat_force_body(state->prog, abs);
+    if (abs >= vm->cap_fns) {
+        uint32_t cap = state->prog->n_nodes;
+        vm->fns = vm_realloc(vm->fns, sizeof(struct VmFn*) * cap);
+        memset(vm->fns + vm->cap_fns, 0, sizeof(struct VmFn*) * (cap - vm->cap_fns));
+        vm->cap_fns = cap;
+    }
+    vm->fns[abs] = compile_fn(state, NODE(state, abs).b, RECORD(state, abs)[0], true);
+    return vm->fns[abs];
+}
+
+static uint32_t wrap_at(struct VmFn* fn, const uint32_t* pc) {
+    uint32_t at = pc - fn->code;
+    for (uint32_t i = 0; i < fn->n_wraps; i++) {
+        if (fn->wraps[i].start <= at && at < fn->wraps[i].end) return fn->wraps[i].kind;
+    }
+    return WRAP_NONE;
+}
+
+/*
+VM
+*/
+
+static struct LambValue vm_error(struct Interpreter* state, struct String message) {
+    return LV_FROM_OBJ(make_lamb_err(state, message));
+}
+
+// a frame's closure, if it holds a reference, goes after the frame
+static void frame_free(struct Interpreter* state, struct VmFrame* frame) {
+    struct LambObject* closure = frame->env->closure;
+    env_free(state, frame->env);
+    if (frame->owns) lv_release(state, LV_FROM_OBJ(closure));
+}
+
+#define USE(v) do { if (!LV_IS_NUM(v)) lv_use(state, (v)); } while (0)
+#define DROP(v) do { if (!LV_IS_NUM(v)) lv_release(state, (v)); } while (0)
+#define POP(v) do { (v) = *--sp; *sp = LV_NONE; } while (0)
+#define RAISE(message) do { err = vm_error(state, string_create(message)); goto raise; } while (0)
+
+#ifdef VM_THREADED
+#define CASE(op) L_##op
+#define DISPATCH() do { steps++; goto *labels[*pc]; } while (0)
+#else
+#define CASE(op) case op
+#define DISPATCH() do { steps++; goto dispatch; } while (0)
+#endif
+
+#ifdef VM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic" // labels as values
+#endif
+struct LambValue vm_run(struct Interpreter* state) {
+#ifdef VM_THREADED
+    static const void* const labels[] = {
+        [OP_NUM] = &&L_OP_NUM, [OP_LOCAL] = &&L_OP_LOCAL, [OP_MOVE] = &&L_OP_MOVE,
+        [OP_LOAD] = &&L_OP_LOAD, [OP_CLOSURE] = &&L_OP_CLOSURE, [OP_SUCC] = &&L_OP_SUCC,
+        [OP_DEC] = &&L_OP_DEC, [OP_POS] = &&L_OP_POS, [OP_NEG] = &&L_OP_NEG,
+        [OP_SET] = &&L_OP_SET, [OP_LETREC] = &&L_OP_LETREC, [OP_JZ] = &&L_OP_JZ,
+        [OP_JUMP] = &&L_OP_JUMP, [OP_CHECKFN] = &&L_OP_CHECKFN, [OP_SWAP] = &&L_OP_SWAP,
+        [OP_CALL] = &&L_OP_CALL,
+        [OP_CALL_NAME] = &&L_OP_CALL_NAME, [OP_TAILCALL] = &&L_OP_TAILCALL,
+        [OP_TAILCALL_NAME] = &&L_OP_TAILCALL_NAME, [OP_RET] = &&L_OP_RET,
+        [OP_HALT] = &&L_OP_HALT, [OP_ERR] = &&L_OP_ERR,
+    };
+#endif
+    if (!state->vm) {
+        state->vm = calloc(1, sizeof(struct Vm));
+        if (!state->vm) {
+            fprintf(stderr, "lamb: err: out of memory (vm).\n");
+            exit(1);
+        }
+    }
+    struct Vm* vm = state->vm;
+    struct VmFn* fn = vm->root = compile_fn(state, state->prog->root, state->prog->root_slots, false);
+    if (!vm->cap_frames) {
+        vm->cap_frames = 256;
+        vm->frames = vm_realloc(NULL, sizeof(struct VmFrame) * vm->cap_frames);
+    }
+    uint32_t n_frames = 1;
+    struct VmFrame* frame = vm->frames;
+    struct Environment* env = env_create(state, NULL, fn->n_slots);
+    *frame = (struct VmFrame) {.fn = fn, .env = env};
+    const uint32_t* pc = fn->code;
+    struct LambValue* sp = env->slots + fn->n_locals;
+    struct LambValue v, arg, callee, err, result;
+    const uint32_t* next; // after a call
+    bool owns;
+    size_t steps = 0;
+    DISPATCH();
+#ifndef VM_THREADED
+dispatch:
+    switch (*pc) {
+#endif
+    CASE(OP_NUM):
+        *sp++ = make_lamb_num((int)pc[1]);
+        pc += 2;
+        DISPATCH();
+    CASE(OP_LOCAL):
+        v = env->slots[pc[1]];
+        if (LV_IS_NONE(v)) goto undefined;
+        USE(v);
+        *sp++ = v;
+        pc += 3;
+        DISPATCH();
+    CASE(OP_MOVE):
+        v = env->slots[pc[1]];
+        if (LV_IS_NONE(v)) goto undefined;
+        env->slots[pc[1]] = LV_NONE;
+        *sp++ = v;
+        pc += 3;
+        DISPATCH();
+    CASE(OP_LOAD):
+        v = env_get(env, pc[1]);
+        if (LV_IS_NONE(v)) goto undefined;
+        USE(v);
+        *sp++ = v;
+        pc += 3;
+        DISPATCH();
+    CASE(OP_CLOSURE):
+        v = LV_FROM_OBJ(close_over(state, pc[1], env));
+        *sp++ = v;
+        pc += 2;
+        DISPATCH();
+    CASE(OP_SUCC):
+        if (!LV_IS_NUM(sp[-1])) goto not_num_plus;
+        sp[-1] = make_lamb_num(NUM_SUCC(LV_NUM(sp[-1])));
+        pc++;
+        DISPATCH();
+    CASE(OP_DEC):
+        if (!LV_IS_NUM(sp[-1])) {
+            POP(v);
+            DROP(v);
+            RAISE("[type error] - applied to a non-Num argument.");
+        }
+        sp[-1] = make_lamb_num(NUM_DEC(LV_NUM(sp[-1])));
+        pc++;
+        DISPATCH();
+    CASE(OP_POS):
+        if (!LV_IS_NUM(sp[-1])) goto not_num_plus;
+        sp[-1] = make_lamb_num(LV_NUM(sp[-1]) > 0);
+        pc++;
+        DISPATCH();
+    CASE(OP_NEG):
+        if (!LV_IS_NUM(sp[-1])) goto not_num_plus;
+        sp[-1] = make_lamb_num(LV_NUM(sp[-1]) < 0);
+        pc++;
+        DISPATCH();
+    CASE(OP_SET):
+        POP(v);
+        env_put(state, env, pc[1], v);
+        pc += 2;
+        DISPATCH();
+    CASE(OP_LETREC):
+        POP(v);
+        if (LV_TYPE(v) != LOBJ_CLOSURE) {
+            DROP(v);
+            RAISE("[type error] Expected a function to be recursively defined in letrec expression");
+        }
+        env_put(state, env, pc[1], v);
+        pc += 2;
+        DISPATCH();
+    CASE(OP_JZ):
+        POP(v);
+        if (!LV_IS_NUM(v)) {
+            DROP(v);
+            RAISE("[type error] - tried to use a non-Num condition in if-else expression.");
+        }
+        pc = LV_NUM(v) ? pc + 2 : fn->code + pc[1];
+        DISPATCH();
+    CASE(OP_JUMP):
+        pc = fn->code + pc[1];
+        DISPATCH();
+    CASE(OP_CHECKFN):
+        if (LV_TYPE(sp[-1]) != LOBJ_CLOSURE) {
+            POP(v);
+            DROP(v);
+            RAISE("[type error] Expected a function to be applied");
+        }
+        pc++;
+        DISPATCH();
+    CASE(OP_SWAP):
+        v = sp[-1];
+        sp[-1] = sp[-2];
+        sp[-2] = v;
+        pc++;
+        DISPATCH();
+    CASE(OP_CALL):
+        POP(arg);
+        POP(callee);
+        owns = true;
+        next = pc + 1;
+        goto call;
+    CASE(OP_CALL_NAME):
+        callee = env_get(env, pc[1]);
+        if (LV_IS_NONE(callee)) goto undefined;
+        POP(arg);
+        owns = false;
+        next = pc + 3;
+        goto call;
+    CASE(OP_TAILCALL):
+        POP(arg);
+        POP(callee);
+        goto tail_call;
+    CASE(OP_TAILCALL_NAME):
+        callee = env_get(env, pc[1]);
+        if (LV_IS_NONE(callee)) goto undefined;
+        USE(callee);
+        POP(arg);
+        goto tail_call;
+    CASE(OP_RET):
+        POP(result);
+        frame_free(state, frame);
+        frame--;
+        n_frames--;
+        fn = frame->fn;
+        env = frame->env;
+        pc = frame->pc;
+        sp = frame->sp;
+        *sp++ = result;
+        DISPATCH();
+    CASE(OP_HALT):
+        POP(result);
+        frame_free(state, frame);
+        goto done;
+    CASE(OP_ERR):
+        printf("%s\n", flat_string(state->prog, pc[1]).b);
+        err = LV_NONE;
+        goto raise;
+#ifndef VM_THREADED
+    }
+#endif
+
+not_num_plus:
+    POP(v);
+    DROP(v);
+    RAISE("[type error] + applied to a non-Num argument.");
+
+undefined:
+    err = vm_error(state, string_concat(string_create("[run-time error] attempted to use an undefined name: "),
+                                        string_clone(symbol_name(pc[2]))));
+    goto raise;
+
+call:
+    if (LV_TYPE(callee) != LOBJ_CLOSURE) {
+        DROP(arg);
+        if (owns) DROP(callee);
+        RAISE("[run-time error]: tried to apply something that's not a function");
+    }
+    frame->pc = next;
+    frame->sp = sp;
+    if (n_frames == vm->cap_frames) {
+        vm->cap_frames *= 2;
+        vm->frames = vm_realloc(vm->frames, sizeof(struct VmFrame) * vm->cap_frames);
+    }
+    frame = &vm->frames[n_frames++];
+    if (n_frames > vm->peak_frames) vm->peak_frames = n_frames;
+    fn = fn_code(state, LOBJ_CLOSURE(LV_OBJ(callee))->code);
+    env = env_create(state, LV_OBJ(callee), fn->n_slots);
+    env->slots[0] = arg;
+    *frame = (struct VmFrame) {.fn = fn, .env = env, .owns = owns};
+    pc = fn->code;
+    sp = env->slots + fn->n_locals;
+    DISPATCH();
+
+// the callee owns its closure and returns straight to this frame's caller
+tail_call:
+    if (LV_TYPE(callee) != LOBJ_CLOSURE) {
+        DROP(arg);
+        DROP(callee);
+        RAISE("[run-time error]: tried to apply something that's not a function");
+    }
+    frame_free(state, frame);
+    fn = fn_code(state, LOBJ_CLOSURE(LV_OBJ(callee))->code);
+    env = env_create(state, LV_OBJ(callee), fn->n_slots);
+    env->slots[0] = arg;
+    *frame = (struct VmFrame) {.fn = fn, .env = env, .owns = true};
+    pc = fn->code;
+    sp = env->slots + fn->n_locals;
+    DISPATCH();
+
+// err, made at pc, leaves every frame; an operand of +, -, pos or neg it
+// passes through on the way out turns it into that op's error, the
+// outermost such op winning
+raise: {
+        uint32_t wrap = WRAP_NONE;
+        for (;;) {
+            uint32_t kind = wrap_at(frame->fn, pc);
+            if (kind) wrap = kind;
+            frame_free(state, frame);
+            if (frame == vm->frames) break;
+            frame--;
+            pc = frame->pc - 1; // within the call
+        }
+        if (wrap) {
+            DROP(err);
+            err = vm_error(state, string_create(wrap == WRAP_PLUS
+                ? "[type error] + applied to a non-Num argument."
+                : "[type error] - applied to a non-Num argument."));
+        }
+        result = err;
+    }
+done:
+    state->n_steps += steps;
+    return result;
+}
+#ifdef VM_THREADED
+#pragma GCC diagnostic pop
+#endif
+
+void vm_free(struct Vm* vm) {
+    if (!vm) return;
+    for (uint32_t i = 0; i < vm->cap_fns; i++) {
+        if (vm->fns[i]) free(vm->fns[i]->wraps);
+        free(vm->fns[i]);
+    }
+    if (vm->root) free(vm->root->wraps);
+    free(vm->root);
+    free(vm->fns);
+    free(vm->frames);
+    free(vm);
+}
@@ -0,0 +1,42 @@
+#ifndef LAMB_VM_H
+#define LAMB_VM_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytecode engine, used under --vm instead of walking the flat AST. Each
+// fn body is compiled on its first call into a VmFn: a stack machine whose
+// operand stack sits in the fn's frame, after the resolver's slots, so the
+// frame stack, reference counting and the collector's roots all work as
+// they do for the tree walker. Dispatch is threaded through computed gotos
+// (a switch with -DLAMB_VM_SWITCH or compilers without them).
+//
+// Calls do not recurse in C: the VM keeps its own stack of VmFrames, and a
+// call in tail position replaces the caller's frame. An error is not passed
+// back up as a value but unwinds every frame at once, as nothing in the
+// language catches one; what the tree walker's +, -, pos and neg make of
+// an error passing through them is recorded per fn as ranges of code.
+//
+// The DEBUG trace is the tree walker's; the VM prints none. Its steps (see
+// Interpreter) are instructions run.
+struct Interpreter;
+struct LambValue;
+struct VmFn;
+struct VmFrame;
+
+struct Vm {
+    struct VmFn** fns; // by AST_ABS node, compiled on the first call
+    uint32_t cap_fns;
+    struct VmFn* root;
+    struct VmFrame* frames; // innermost last
+    uint32_t cap_frames;
+    // statistics
+    size_t n_compiled; // fns
+    size_t code_bytes;
+    uint32_t peak_frames;
+};
+
+// evaluates the program's root; the caller owns the result
+struct LambValue vm_run(struct Interpreter* state);
+void vm_free(struct Vm* vm);
+
+#endif